@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+struct BenchmarkOptions
+{
+    size_t sourceBytes = 32 * 1024 * 1024;
+    int iterations = 5;
+    // When set, one row per result is appended here so throughput can be tracked across runs
+    std::string csvPath;
+    std::string filter;
+    std::string buildLabel;
+};
+
+// Generates a valid Emerald program of roughly the requested size that exercises every token
+// kind the lexer handles, including both comment forms.
+inline std::string generateProgram(size_t bytes)
+{
+    std::string program = "let v0 = 1;\n";
+    for (size_t i = 1; program.size() < bytes; ++i)
+    {
+        const auto name = "v" + std::to_string(i);
+        const auto prev = "v" + std::to_string(i - 1);
+        program += "let " + name + " = (" + prev + " + " + std::to_string(i % 977) + ") * 3 - 4 / 2; # running total\n";
+        program += "{\n    let tmp = " + name + ";\n    #* scratch scope\n       for the benchmark *#\n}\n";
+        program += "if (" + name + ") {\n    " + name + " = " + name + " + 1;\n} else {\n    " + name + " = 0;\n}\n";
+    }
+    program += "return 0;\n";
+    return program;
+}
+
+// Runs fn the given number of times and returns the fastest wall-clock time in seconds
+template<typename F>
+double bestOfSeconds(int iterations, F&& fn)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+inline bool shouldRun(const BenchmarkOptions& options, const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+inline void reportThroughput(const BenchmarkOptions& options, const std::string& name, size_t bytes, double seconds)
+{
+    const double megabytesPerSecond = (static_cast<double>(bytes) / (1024.0 * 1024.0)) / seconds;
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(1) << megabytesPerSecond << " MB/s"
+              << std::setw(12) << std::setprecision(3) << seconds * 1000.0 << " ms" << std::endl;
+
+    if (!options.csvPath.empty())
+    {
+        const bool writeHeader = !std::ifstream(options.csvPath).good();
+        std::ofstream csv(options.csvPath, std::ios::app);
+        if (writeHeader)
+        {
+            csv << "timestamp,build,benchmark,bytes,seconds,mb_per_s\n";
+        }
+        const auto now = std::time(nullptr);
+        std::tm utc{};
+#if defined(_WIN32)
+        gmtime_s(&utc, &now);
+#else
+        gmtime_r(&now, &utc);
+#endif
+        csv << std::put_time(&utc, "%Y-%m-%dT%H:%M:%SZ") << ","
+            << options.buildLabel << ","
+            << name << ","
+            << bytes << ","
+            << std::setprecision(6) << seconds << ","
+            << std::setprecision(1) << megabytesPerSecond << "\n";
+    }
+}
@@ -0,0 +1,50 @@
+#include "Benchmark.hpp"
+
+#include <Tokeniser.hpp>
+#include <Scanner.hpp>
+
+#include <iostream>
+#include <thread>
+
+void runLexerBenchmarks(const BenchmarkOptions& options)
+{
+    const auto source = generateProgram(options.sourceBytes);
+
+    if (shouldRun(options, "lexer/tokenise"))
+    {
+        size_t tokenCount = 0;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            ErrorHandler handler;
+            Tokeniser tokeniser(source, "bench.emd", handler);
+            tokenCount = tokeniser.tokenise().size();
+        });
+        reportThroughput(options, "lexer/tokenise", source.size(), seconds);
+        std::cout << "    " << tokenCount << " tokens" << std::endl;
+    }
+
+    if (shouldRun(options, "lexer/tokenise-parallel"))
+    {
+        size_t tokenCount = 0;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            ErrorHandler handler;
+            Tokeniser tokeniser(source, "bench.emd", handler);
+            tokenCount = tokeniser.tokeniseParallel().size();
+        });
+        reportThroughput(options, "lexer/tokenise-parallel", source.size(), seconds);
+        std::cout << "    " << tokenCount << " tokens on " << std::thread::hardware_concurrency() << " threads" << std::endl;
+    }
+
+    if (shouldRun(options, "lexer/skip-whitespace"))
+    {
+        const std::string spaces(options.sourceBytes, ' ');
+        const char* stop = nullptr;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            stop = Scanner::skipWhitespace(spaces.data(), spaces.data() + spaces.size());
+        });
+        reportThroughput(options, "lexer/skip-whitespace", spaces.size(), seconds);
+        if (stop != spaces.data() + spaces.size())
+        {
+            std::cerr << "skipWhitespace stopped early" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#include "Benchmark.hpp"
+
+#include <Scanner.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+void runLexerBenchmarks(const BenchmarkOptions& options);
+void runParserBenchmarks(const BenchmarkOptions& options);
+
+// Usage: EmeraldBenchmarks [-size <MB>] [-iterations <n>] [-filter <name>] [-csv <file>] [-label <build>]
+//
+// Pass -csv to append every result to a file, e.g. from CI, to track throughput over time.
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    options.buildLabel = std::string(Scanner::implementation());
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string flag = argv[i];
+        const std::string value = argv[i + 1];
+        if (flag == "-size") {
+            options.sourceBytes = std::stoul(value) * 1024 * 1024;
+        } else if (flag == "-iterations") {
+            options.iterations = std::stoi(value);
+        } else if (flag == "-filter") {
+            options.filter = value;
+        } else if (flag == "-csv") {
+            options.csvPath = value;
+        } else if (flag == "-label") {
+            options.buildLabel = value;
+        } else {
+            std::cerr << "Unknown argument " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Scanner implementation: " << Scanner::implementation() << std::endl;
+    runLexerBenchmarks(options);
+    runParserBenchmarks(options);
+    return 0;
+}
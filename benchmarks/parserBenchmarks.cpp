@@ -0,0 +1,127 @@
+#include "Benchmark.hpp"
+
+#include <Tokeniser.hpp>
+#include <Parser.hpp>
+#include <Generator.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    // Parses and generates asm for a source that is one deeply nested statement, which the
+    // recursive parser and generator used to overflow the stack on
+    void runDeepBenchmark(const BenchmarkOptions& options, const std::string& name, const std::string& source)
+    {
+        ErrorHandler handler;
+        Tokeniser tokeniser(source, "bench.emd", handler);
+        const auto tokens = tokeniser.tokenise();
+
+        size_t asmBytes = 0;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            Parser parser(tokens, handler);
+            Generator generator(parser.parse(), handler);
+            asmBytes = generator.generateProgram().size();
+        });
+        reportThroughput(options, name, source.size(), seconds);
+        std::cout << "    " << tokens.size() << " tokens, " << asmBytes << " bytes of asm" << std::endl;
+        if (handler.hasErrored())
+        {
+            std::cerr << name << " reported errors" << std::endl;
+        }
+    }
+}
+
+void runParserBenchmarks(const BenchmarkOptions& options)
+{
+    const auto source = generateProgram(options.sourceBytes);
+
+    if (shouldRun(options, "parser/parse"))
+    {
+        ErrorHandler handler;
+        Tokeniser tokeniser(source, "bench.emd", handler);
+        const auto tokens = tokeniser.tokenise();
+
+        size_t statementCount = 0;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            Parser parser(tokens, handler);
+            statementCount = parser.parse().statements.count;
+        });
+        reportThroughput(options, "parser/parse", source.size(), seconds);
+        std::cout << "    " << tokens.size() << " tokens, " << statementCount << " top-level statements" << std::endl;
+        if (handler.hasErrored())
+        {
+            std::cerr << "parser/parse reported errors" << std::endl;
+        }
+    }
+
+    if (shouldRun(options, "parser/lex-then-parse"))
+    {
+        ErrorHandler handler;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            Tokeniser tokeniser(source, "bench.emd", handler);
+            Parser parser(tokeniser.tokenise(), handler);
+            parser.parse();
+        });
+        reportThroughput(options, "parser/lex-then-parse", source.size(), seconds);
+    }
+
+    if (shouldRun(options, "parser/lex-parse-pipelined"))
+    {
+        ErrorHandler handler;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            Tokeniser tokeniser(source, "bench.emd", handler);
+            TokenBlockQueue blocks(4);
+            std::jthread lexer([&] { tokeniser.tokeniseInto(blocks, 4096); });
+            Parser parser(blocks, tokeniser.fileId(), handler);
+            parser.parse();
+        });
+        reportThroughput(options, "parser/lex-parse-pipelined", source.size(), seconds);
+    }
+
+    if (shouldRun(options, "parser/reparse-edit"))
+    {
+        ErrorHandler handler;
+        Tokeniser tokeniser(source, "bench.emd", handler);
+        Parser parser(tokeniser.tokenise(), handler);
+        parser.parse();
+
+        // Toggle one character inside a scope half way through, so each reparse has a live buffer
+        // to refer to
+        const auto at = static_cast<uint32_t>(source.find("let tmp", source.size() / 2) + 4);
+        std::string edited = source;
+        edited[at] = 'T';
+        const Parser::Edit edit{ .begin = at, .oldEnd = at + 1, .newEnd = at + 1 };
+        bool toEdited = true;
+        bool reparsed = true;
+        const double seconds = bestOfSeconds(options.iterations, [&] {
+            reparsed = reparsed && parser.reparse(toEdited ? edited : source, edit).has_value();
+            toEdited = !toEdited;
+        });
+        // Reported against the whole file, as that is what a full parse would have to get through
+        reportThroughput(options, "parser/reparse-edit", source.size(), seconds);
+        if (!reparsed)
+        {
+            std::cerr << "parser/reparse-edit fell back to a full parse" << std::endl;
+        }
+    }
+
+    constexpr size_t NestingDepth = 100000;
+    if (shouldRun(options, "parser/deep-parens"))
+    {
+        const std::string source = "let x = " + std::string(NestingDepth, '(') + "1" + std::string(NestingDepth, ')') + ";\nreturn x;\n";
+        runDeepBenchmark(options, "parser/deep-parens", source);
+    }
+
+    if (shouldRun(options, "parser/long-chain"))
+    {
+        std::string source = "let a = 1;\nlet x = a";
+        for (size_t i = 1; i < NestingDepth; ++i)
+        {
+            source += " + a";
+        }
+        source += ";\nreturn x;\n";
+        runDeepBenchmark(options, "parser/long-chain", source);
+    }
+}
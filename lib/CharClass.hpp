@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Token.hpp"
+
+#include <array>
+#include <cstdint>
+
+// 256-entry lookup tables used by the tokeniser to classify a byte with a single load, replacing
+// the locale-dependent <cctype> calls and the symbol map lookups.
+namespace CharClass
+{
+    enum : uint8_t
+    {
+        None = 0,
+        Whitespace = 1 << 0,
+        Alpha = 1 << 1,
+        Digit = 1 << 2,
+        Symbol = 1 << 3,
+        Alnum = Alpha | Digit
+    };
+
+    inline constexpr std::array<uint8_t, 256> Table = [] {
+        std::array<uint8_t, 256> table{};
+        for (const unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+        {
+            table[c] = Whitespace;
+        }
+        for (unsigned char c = 'a'; c <= 'z'; ++c)
+        {
+            table[c] = Alpha;
+            table[c - 'a' + 'A'] = Alpha;
+        }
+        for (unsigned char c = '0'; c <= '9'; ++c)
+        {
+            table[c] = Digit;
+        }
+        for (const unsigned char c : {';', '(', ')', '=', '+', '*', '-', '/', '\\', '{', '}', '[', ']', '<', '>', '.', ',', ':', '\'', '\"', '|', '!'})
+        {
+            table[c] = Symbol;
+        }
+        return table;
+    }();
+
+    inline constexpr std::array<Token::Kind, 256> SymbolKinds = [] {
+        std::array<Token::Kind, 256> kinds{};
+        kinds.fill(Token::Kind::Unexpected);
+        kinds[';'] = Token::Kind::SemiColon;
+        kinds['('] = Token::Kind::OpenParen;
+        kinds[')'] = Token::Kind::CloseParen;
+        kinds['='] = Token::Kind::Equals;
+        kinds['+'] = Token::Kind::Plus;
+        kinds['*'] = Token::Kind::Asterisk;
+        kinds['-'] = Token::Kind::Minus;
+        kinds['/'] = Token::Kind::ForwardSlash;
+        kinds['\\'] = Token::Kind::BackSlash;
+        kinds['{'] = Token::Kind::OpenCurly;
+        kinds['}'] = Token::Kind::CloseCurly;
+        kinds['['] = Token::Kind::OpenSquare;
+        kinds[']'] = Token::Kind::CloseSquare;
+        kinds['<'] = Token::Kind::LessThan;
+        kinds['>'] = Token::Kind::GreaterThan;
+        kinds['.'] = Token::Kind::Dot;
+        kinds[','] = Token::Kind::Comma;
+        kinds[':'] = Token::Kind::Colon;
+        kinds['\''] = Token::Kind::SingleQuote;
+        kinds['\"'] = Token::Kind::DoubleQuote;
+        kinds['|'] = Token::Kind::Pipe;
+        kinds['!'] = Token::Kind::Bang;
+        return kinds;
+    }();
+
+    // Kind of the two character operator made by a symbol followed by =, or Unexpected where
+    // the symbol doesn't start one
+    inline constexpr std::array<Token::Kind, 256> EqualsSuffixKinds = [] {
+        std::array<Token::Kind, 256> kinds{};
+        kinds.fill(Token::Kind::Unexpected);
+        kinds['='] = Token::Kind::EqualsEquals;
+        kinds['!'] = Token::Kind::BangEquals;
+        kinds['<'] = Token::Kind::LessThanEquals;
+        kinds['>'] = Token::Kind::GreaterThanEquals;
+        return kinds;
+    }();
+
+    constexpr uint8_t of(char c)
+    {
+        return Table[static_cast<uint8_t>(c)];
+    }
+
+    constexpr Token::Kind symbolKind(char c)
+    {
+        return SymbolKinds[static_cast<uint8_t>(c)];
+    }
+
+    constexpr Token::Kind equalsSuffixKind(char c)
+    {
+        return EqualsSuffixKinds[static_cast<uint8_t>(c)];
+    }
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "Token.hpp"
+#include "SourceManager.hpp"
+
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 
 struct Message
 {
@@ -15,16 +19,8 @@ struct Message
     Kind Kind;
     Token::Info Info;
     std::string Description;
-
-    friend std::ostream& operator<<(std::ostream& os, const Message& error);
 };
 
-inline std::ostream& operator<<(std::ostream& os, const Message& error)
-{
-    os << "Error: Ln " << error.Info.Line << ":" << error.Info.Pos << ": " << error.Description;
-    return os;
-}
-
 inline Message makeError(Token::Info info, std::string description) {
     return { .Kind = Message::Kind::Error, .Info = info, .Description = std::move(description) };
 }
@@ -38,27 +34,91 @@ public:
 
     ErrorHandler() = default;
 
-    [[nodiscard]] bool hasErrored() const {
-        const size_t errorCount = std::count_if(
-                m_messages.begin(),
-                m_messages.end(),
-                [](const Message& m) {
-                    return m.Kind == Message::Kind::Error;
-                });
-        return errorCount != 0;
+    [[nodiscard]] bool hasErrored() const { return m_errorCount != 0; }
+    [[nodiscard]] size_t errorCount() const { return m_errorCount; }
+    [[nodiscard]] size_t warningCount() const { return m_warningCount; }
+
+    // Once limit errors have been reported any more are dropped, and the stages stop early. 0 means
+    // there is no limit.
+    void setErrorLimit(size_t limit) { m_errorLimit = limit; }
+    [[nodiscard]] bool errorLimitReached() const { return m_errorLimit != 0 && m_errorCount >= m_errorLimit; }
+    // Errors that can still be reported before the limit is reached
+    [[nodiscard]] size_t errorsBeforeLimit() const
+    {
+        if (m_errorLimit == 0)
+        {
+            return SIZE_MAX;
+        }
+        return m_errorLimit > m_errorCount ? m_errorLimit - m_errorCount : 0;
     }
 
     inline ErrorHandler& operator<<(Message e)
     {
+        if (errorLimitReached())
+        {
+            return *this;
+        }
+        tally(e.Kind, 1);
         m_messages.push_back(std::move(e));
         return *this;
     }
 
+    [[nodiscard]] size_t size() const { return m_messages.size(); }
+    // Drops every message after the first count, for undoing a speculative parse
+    void truncate(size_t count)
+    {
+        if (count < m_messages.size())
+        {
+            for (auto it = m_messages.begin() + static_cast<ptrdiff_t>(count); it != m_messages.end(); ++it)
+            {
+                tally(it->Kind, -1);
+            }
+            m_messages.erase(m_messages.begin() + static_cast<ptrdiff_t>(count), m_messages.end());
+        }
+    }
+
+    // Message locations are only turned into lines and columns here, when they are printed
+    void print(std::ostream& os, const Message& message) const
+    {
+        switch (message.Kind)
+        {
+            case Message::Kind::Error: os << "Error: "; break;
+            case Message::Kind::Warning: os << "Warning: "; break;
+            case Message::Kind::Info: os << "Info: "; break;
+        }
+        if (message.Info.FileId != Token::Info::NoFile)
+        {
+            const auto location = m_sources.resolve(message.Info);
+            os << location.File << " Ln " << location.Line << ":" << location.Pos << ": ";
+        }
+        os << message.Description;
+    }
+
+    SourceManager& sources() { return m_sources; }
+    [[nodiscard]] const SourceManager& sources() const { return m_sources; }
+
     iterator begin() { return m_messages.begin(); }
     iterator end() { return m_messages.end(); }
     [[nodiscard]] const_iterator begin() const { return m_messages.begin(); }
     [[nodiscard]] const_iterator end() const { return m_messages.end(); }
 
+private:
+    void tally(enum Message::Kind kind, ptrdiff_t delta)
+    {
+        if (kind == Message::Kind::Error)
+        {
+            m_errorCount += delta;
+        }
+        else if (kind == Message::Kind::Warning)
+        {
+            m_warningCount += delta;
+        }
+    }
+
 private:
     std::vector<Message> m_messages;
-};
\ No newline at end of file
+    size_t m_errorCount = 0;
+    size_t m_warningCount = 0;
+    size_t m_errorLimit = 0;
+    SourceManager m_sources;
+};
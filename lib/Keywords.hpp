@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Token.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Keyword recognition through a perfect hash that is searched for at compile time. Every keyword
+// lands in its own slot, so a lookup is one hash, one table load and one string compare.
+namespace Keywords
+{
+    struct Entry
+    {
+        std::string_view text;
+        Token::Kind kind;
+    };
+
+    inline constexpr std::array<Entry, 6> List = {{
+        {"return", Token::Kind::Return},
+        {"let", Token::Kind::Let},
+        {"if", Token::Kind::If},
+        {"for", Token::Kind::For},
+        {"else", Token::Kind::Else},
+        {"while", Token::Kind::While}
+    }};
+
+    inline constexpr uint32_t SlotBits = 3;
+    inline constexpr size_t SlotCount = size_t(1) << SlotBits;
+
+    inline constexpr size_t MinLength = [] {
+        size_t length = List[0].text.size();
+        for (const auto& entry : List) { length = std::min(length, entry.text.size()); }
+        return length;
+    }();
+
+    inline constexpr size_t MaxLength = [] {
+        size_t length = 0;
+        for (const auto& entry : List) { length = std::max(length, entry.text.size()); }
+        return length;
+    }();
+
+    constexpr uint32_t hash(std::string_view text, uint32_t seed)
+    {
+        const uint32_t key = (static_cast<uint8_t>(text.front()) * 31u + static_cast<uint8_t>(text.back())) ^ static_cast<uint32_t>(text.size() << 12);
+        return (key * seed) >> (32 - SlotBits);
+    }
+
+    // Finds the first multiplier that maps every keyword to a distinct slot. The search starts from
+    // the golden ratio constant so the top bits of the product are well mixed from the outset
+    inline constexpr uint32_t Seed = [] {
+        for (uint32_t attempt = 0; attempt < 100'000; ++attempt)
+        {
+            const uint32_t seed = 0x9E3779B1u + 2 * attempt;
+            std::array<bool, SlotCount> used{};
+            bool collision = false;
+            for (const auto& entry : List)
+            {
+                const auto slot = hash(entry.text, seed);
+                collision = collision || used[slot];
+                used[slot] = true;
+            }
+            if (!collision)
+            {
+                return seed;
+            }
+        }
+        return 0u;
+    }();
+    static_assert(Seed != 0, "No perfect hash seed found for the keyword set.");
+
+    inline constexpr std::array<int8_t, SlotCount> Slots = [] {
+        std::array<int8_t, SlotCount> slots{};
+        slots.fill(-1);
+        for (size_t i = 0; i < List.size(); ++i)
+        {
+            slots[hash(List[i].text, Seed)] = static_cast<int8_t>(i);
+        }
+        return slots;
+    }();
+
+    constexpr std::optional<Token::Kind> lookup(std::string_view text)
+    {
+        if (text.size() < MinLength || text.size() > MaxLength)
+        {
+            return {};
+        }
+        const auto slot = Slots[hash(text, Seed)];
+        if (slot < 0 || List[slot].text != text)
+        {
+            return {};
+        }
+        return List[slot].kind;
+    }
+}
@@ -0,0 +1,214 @@
+#include "Scanner.hpp"
+#include "CharClass.hpp"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EMERALD_SCANNER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EMERALD_SCANNER_SSE2
+#endif
+
+namespace Scanner::Scalar
+{
+    const char* skipWhitespace(const char* begin, const char* end)
+    {
+        while (begin != end && (CharClass::of(*begin) & CharClass::Whitespace)) { ++begin; }
+        return begin;
+    }
+
+    const char* skipAlnum(const char* begin, const char* end)
+    {
+        while (begin != end && (CharClass::of(*begin) & CharClass::Alnum)) { ++begin; }
+        return begin;
+    }
+
+    const char* skipDigits(const char* begin, const char* end)
+    {
+        while (begin != end && (CharClass::of(*begin) & CharClass::Digit)) { ++begin; }
+        return begin;
+    }
+
+    const char* findNewline(const char* begin, const char* end)
+    {
+        while (begin != end && *begin != '\n') { ++begin; }
+        return begin;
+    }
+
+    const char* findCommentEnd(const char* begin, const char* end)
+    {
+        for (; begin != end; ++begin)
+        {
+            if (*begin == '*' && begin + 1 != end && begin[1] == '#')
+            {
+                return begin;
+            }
+        }
+        return end;
+    }
+}
+
+#if defined(EMERALD_SCANNER_AVX2) || defined(EMERALD_SCANNER_SSE2)
+namespace
+{
+#if defined(EMERALD_SCANNER_AVX2)
+    struct Vec
+    {
+        using Reg = __m256i;
+        static constexpr ptrdiff_t Width = 32;
+
+        static Reg load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+        static Reg splat(char c) { return _mm256_set1_epi8(c); }
+        static Reg eq(Reg a, Reg b) { return _mm256_cmpeq_epi8(a, b); }
+        static Reg orV(Reg a, Reg b) { return _mm256_or_si256(a, b); }
+        static Reg andV(Reg a, Reg b) { return _mm256_and_si256(a, b); }
+        static Reg sub(Reg a, Reg b) { return _mm256_sub_epi8(a, b); }
+        static Reg minU(Reg a, Reg b) { return _mm256_min_epu8(a, b); }
+        static uint32_t mask(Reg a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+        static constexpr uint32_t FullMask = 0xFFFFFFFFu;
+    };
+#else
+    struct Vec
+    {
+        using Reg = __m128i;
+        static constexpr ptrdiff_t Width = 16;
+
+        static Reg load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+        static Reg splat(char c) { return _mm_set1_epi8(c); }
+        static Reg eq(Reg a, Reg b) { return _mm_cmpeq_epi8(a, b); }
+        static Reg orV(Reg a, Reg b) { return _mm_or_si128(a, b); }
+        static Reg andV(Reg a, Reg b) { return _mm_and_si128(a, b); }
+        static Reg sub(Reg a, Reg b) { return _mm_sub_epi8(a, b); }
+        static Reg minU(Reg a, Reg b) { return _mm_min_epu8(a, b); }
+        static uint32_t mask(Reg a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+        static constexpr uint32_t FullMask = 0xFFFFu;
+    };
+#endif
+
+    // Lanes where lo <= c < lo + count, using the unsigned min trick as there is no unsigned compare
+    inline Vec::Reg inRange(Vec::Reg chars, char lo, uint8_t count)
+    {
+        const auto shifted = Vec::sub(chars, Vec::splat(lo));
+        return Vec::eq(Vec::minU(shifted, Vec::splat(static_cast<char>(count - 1))), shifted);
+    }
+
+    inline Vec::Reg whitespaceLanes(Vec::Reg chars)
+    {
+        // ' ' or any of \t \n \v \f \r, which are contiguous
+        return Vec::orV(Vec::eq(chars, Vec::splat(' ')), inRange(chars, '\t', 5));
+    }
+
+    inline Vec::Reg digitLanes(Vec::Reg chars)
+    {
+        return inRange(chars, '0', 10);
+    }
+
+    inline Vec::Reg alnumLanes(Vec::Reg chars)
+    {
+        // Setting bit 5 folds upper case onto lower case without pulling any other byte into a-z
+        const auto folded = Vec::orV(chars, Vec::splat(0x20));
+        return Vec::orV(digitLanes(chars), inRange(folded, 'a', 26));
+    }
+
+    // Advances over full vectors while every lane matches. Returns the first miss, or the start of
+    // the partial vector at the end, which the callers finish with the scalar scanner
+    template<typename Lanes>
+    inline const char* skipWhile(const char* begin, const char* end, Lanes lanes)
+    {
+        while (end - begin >= Vec::Width)
+        {
+            const uint32_t misses = ~Vec::mask(lanes(Vec::load(begin))) & Vec::FullMask;
+            if (misses != 0)
+            {
+                return begin + std::countr_zero(misses);
+            }
+            begin += Vec::Width;
+        }
+        return begin;
+    }
+
+    // As skipWhile, but stops at the first lane that does match
+    template<typename Lanes>
+    inline const char* findFirst(const char* begin, const char* end, Lanes lanes)
+    {
+        while (end - begin >= Vec::Width)
+        {
+            const uint32_t hits = Vec::mask(lanes(Vec::load(begin)));
+            if (hits != 0)
+            {
+                return begin + std::countr_zero(hits);
+            }
+            begin += Vec::Width;
+        }
+        return begin;
+    }
+}
+
+namespace Scanner
+{
+    const char* skipWhitespace(const char* begin, const char* end)
+    {
+        return Scalar::skipWhitespace(skipWhile(begin, end, whitespaceLanes), end);
+    }
+
+    const char* skipAlnum(const char* begin, const char* end)
+    {
+        return Scalar::skipAlnum(skipWhile(begin, end, alnumLanes), end);
+    }
+
+    const char* skipDigits(const char* begin, const char* end)
+    {
+        return Scalar::skipDigits(skipWhile(begin, end, digitLanes), end);
+    }
+
+    const char* findNewline(const char* begin, const char* end)
+    {
+        const auto newline = Vec::splat('\n');
+        return Scalar::findNewline(findFirst(begin, end, [&](Vec::Reg chars) { return Vec::eq(chars, newline); }), end);
+    }
+
+    const char* findCommentEnd(const char* begin, const char* end)
+    {
+        // Compare each lane with its right-hand neighbour, so stop one byte short to keep the
+        // second load in bounds
+        const auto star = Vec::splat('*');
+        const auto hash = Vec::splat('#');
+        while (end - begin > Vec::Width)
+        {
+            const uint32_t hits = Vec::mask(Vec::andV(Vec::eq(Vec::load(begin), star), Vec::eq(Vec::load(begin + 1), hash)));
+            if (hits != 0)
+            {
+                return begin + std::countr_zero(hits);
+            }
+            begin += Vec::Width;
+        }
+        return Scalar::findCommentEnd(begin, end);
+    }
+
+    std::string_view implementation()
+    {
+#if defined(EMERALD_SCANNER_AVX2)
+        return "AVX2";
+#else
+        return "SSE2";
+#endif
+    }
+}
+#else
+namespace Scanner
+{
+    const char* skipWhitespace(const char* begin, const char* end) { return Scalar::skipWhitespace(begin, end); }
+    const char* skipAlnum(const char* begin, const char* end) { return Scalar::skipAlnum(begin, end); }
+    const char* skipDigits(const char* begin, const char* end) { return Scalar::skipDigits(begin, end); }
+    const char* findNewline(const char* begin, const char* end) { return Scalar::findNewline(begin, end); }
+    const char* findCommentEnd(const char* begin, const char* end) { return Scalar::findCommentEnd(begin, end); }
+
+    std::string_view implementation()
+    {
+        return "scalar";
+    }
+}
+#endif
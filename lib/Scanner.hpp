@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string_view>
+
+// Run scanners used by the tokeniser for the spans of source it skips over wholesale. Each
+// function takes the half-open range [begin, end) and returns a pointer to the first character
+// that ends the run, or end if the run reaches the end of the range.
+//
+// The default implementations use AVX2 when the library is built with it enabled, otherwise SSE2
+// on x86-64, otherwise the scalar versions in Scanner::Scalar, which are always available and are
+// what the vector versions are tested against.
+namespace Scanner
+{
+    const char* skipWhitespace(const char* begin, const char* end);
+    const char* skipAlnum(const char* begin, const char* end);
+    const char* skipDigits(const char* begin, const char* end);
+    const char* findNewline(const char* begin, const char* end);
+    // Finds the "*#" that closes a multi-line comment, returning a pointer to the '*'
+    const char* findCommentEnd(const char* begin, const char* end);
+
+    // Name of the instruction set the default implementations were built for
+    std::string_view implementation();
+
+    namespace Scalar
+    {
+        const char* skipWhitespace(const char* begin, const char* end);
+        const char* skipAlnum(const char* begin, const char* end);
+        const char* skipDigits(const char* begin, const char* end);
+        const char* findNewline(const char* begin, const char* end);
+        const char* findCommentEnd(const char* begin, const char* end);
+    }
+}
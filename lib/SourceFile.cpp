@@ -0,0 +1,125 @@
+#include "SourceFile.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    std::string readStream(std::istream& stream)
+    {
+        return { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+    }
+}
+
+std::optional<SourceFile> SourceFile::open(const std::string& path)
+{
+    SourceFile file;
+    if (path == "-")
+    {
+        file.m_buffer = readStream(std::cin);
+        return file;
+    }
+
+#if !defined(_WIN32)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return {};
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) >= MapThreshold)
+    {
+        void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            // The tokeniser reads front to back exactly once
+            ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            ::close(fd);
+            file.m_mapping = mapping;
+            file.m_mappedSize = info.st_size;
+            return file;
+        }
+    }
+
+    // Small files, pipes and anything that fails to map are read into the buffer
+    if (S_ISREG(info.st_mode))
+    {
+        file.m_buffer.reserve(info.st_size);
+    }
+    char chunk[64 * 1024];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = ::read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        file.m_buffer.append(chunk, bytesRead);
+    }
+    ::close(fd);
+    if (bytesRead < 0)
+    {
+        return {};
+    }
+    return file;
+#else
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream)
+    {
+        return {};
+    }
+    file.m_buffer = readStream(stream);
+    return file;
+#endif
+}
+
+SourceFile::SourceFile(SourceFile&& other) noexcept
+    : m_buffer(std::move(other.m_buffer))
+    , m_mapping(std::exchange(other.m_mapping, nullptr))
+    , m_mappedSize(std::exchange(other.m_mappedSize, 0))
+{
+}
+
+SourceFile& SourceFile::operator=(SourceFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        m_buffer = std::move(other.m_buffer);
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+        m_mappedSize = std::exchange(other.m_mappedSize, 0);
+    }
+    return *this;
+}
+
+SourceFile::~SourceFile()
+{
+    unmap();
+}
+
+std::string_view SourceFile::contents() const
+{
+    if (m_mapping != nullptr)
+    {
+        return { static_cast<const char*>(m_mapping), m_mappedSize };
+    }
+    return m_buffer;
+}
+
+void SourceFile::unmap()
+{
+#if !defined(_WIN32)
+    if (m_mapping != nullptr)
+    {
+        ::munmap(m_mapping, m_mappedSize);
+    }
+#endif
+    m_mapping = nullptr;
+    m_mappedSize = 0;
+}
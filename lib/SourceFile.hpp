@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Read-only contents of a source file. Files of at least MapThreshold bytes are memory mapped so
+// the compiler works directly on the page cache instead of a copy; smaller files, and standard
+// input (path "-"), are read into a buffer.
+class SourceFile
+{
+public:
+    static constexpr size_t MapThreshold = 64 * 1024;
+
+    [[nodiscard]] static std::optional<SourceFile> open(const std::string& path);
+
+    SourceFile(const SourceFile& other) = delete;
+    SourceFile& operator=(const SourceFile& other) = delete;
+    SourceFile(SourceFile&& other) noexcept;
+    SourceFile& operator=(SourceFile&& other) noexcept;
+    ~SourceFile();
+
+    [[nodiscard]] std::string_view contents() const;
+    [[nodiscard]] bool isMapped() const { return m_mapping != nullptr; }
+
+private:
+    SourceFile() = default;
+    void unmap();
+
+private:
+    std::string m_buffer;
+    void* m_mapping = nullptr;
+    size_t m_mappedSize = 0;
+};
@@ -0,0 +1,54 @@
+#include "SourceManager.hpp"
+#include "Scanner.hpp"
+
+#include <algorithm>
+
+uint32_t SourceManager::addFile(std::string filename, std::string_view content)
+{
+    m_files.push_back({ .name = std::move(filename), .content = content, .lineStarts = {} });
+    return static_cast<uint32_t>(m_files.size() - 1);
+}
+
+void SourceManager::replaceContent(uint32_t fileId, std::string_view content)
+{
+    if (fileId < m_files.size())
+    {
+        m_files[fileId].content = content;
+        m_files[fileId].lineStarts.clear();
+    }
+}
+
+std::string_view SourceManager::filename(uint32_t fileId) const
+{
+    return fileId < m_files.size() ? std::string_view(m_files[fileId].name) : std::string_view();
+}
+
+std::string_view SourceManager::content(uint32_t fileId) const
+{
+    return fileId < m_files.size() ? m_files[fileId].content : std::string_view();
+}
+
+SourceLocation SourceManager::resolve(Token::Info info) const
+{
+    if (info.FileId >= m_files.size())
+    {
+        return {};
+    }
+
+    const File& file = m_files[info.FileId];
+    if (file.lineStarts.empty())
+    {
+        const char* const begin = file.content.data();
+        const char* const end = begin + file.content.size();
+        file.lineStarts.push_back(0);
+        for (const char* newline = Scanner::findNewline(begin, end); newline != end; newline = Scanner::findNewline(newline + 1, end))
+        {
+            file.lineStarts.push_back(static_cast<uint32_t>(newline + 1 - begin));
+        }
+    }
+
+    // The line is the last one starting at or before the offset
+    const auto next = std::upper_bound(file.lineStarts.begin(), file.lineStarts.end(), info.Offset);
+    const auto line = static_cast<size_t>(next - file.lineStarts.begin());
+    return { .File = file.name, .Line = line, .Pos = info.Offset - *(next - 1) + 1 };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Token.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A resolved, human readable position in a source file
+struct SourceLocation
+{
+    std::string_view File;
+    size_t Line = 0;
+    size_t Pos = 0;
+};
+
+// Owns the names of the files being compiled and maps the compact file id and byte offset that
+// tokens carry back to a line and column. The line table for a file is only built the first time
+// a location in it is resolved, which in practice is when a diagnostic is printed.
+class SourceManager
+{
+public:
+    SourceManager() = default;
+    SourceManager(const SourceManager& other) = delete;
+
+    // The content is not copied; it must outlive any resolve call for the returned file id
+    uint32_t addFile(std::string filename, std::string_view content);
+    // Swaps in the edited content of a file that is already registered
+    void replaceContent(uint32_t fileId, std::string_view content);
+
+    [[nodiscard]] std::string_view filename(uint32_t fileId) const;
+    [[nodiscard]] std::string_view content(uint32_t fileId) const;
+    [[nodiscard]] SourceLocation resolve(Token::Info info) const;
+
+private:
+    struct File
+    {
+        std::string name;
+        std::string_view content;
+        // Byte offset at which each line starts, built on demand
+        mutable std::vector<uint32_t> lineStarts;
+    };
+
+    // A deque so the names that resolved locations view stay put as files are added
+    std::deque<File> m_files;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one consumer thread. push
+// blocks while the ring is full, which gives the producer backpressure, and pop blocks while it is
+// empty. The consumer can cancel to stop the producer early. Blocking uses atomic wait/notify, so neither side spins or takes a lock.
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) : m_slots(capacity == 0 ? 1 : capacity) {}
+    SpscQueue(const SpscQueue& other) = delete;
+
+    // Producer only. Returns false, dropping value, once the consumer has cancelled.
+    bool push(T value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            // Read the signal first so a pop or cancel after the checks below still wakes us
+            const uint32_t signal = m_producerSignal.load(std::memory_order_acquire);
+            if (m_cancelled.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            if (tail - m_head.load(std::memory_order_acquire) != m_slots.size())
+            {
+                break;
+            }
+            m_producerSignal.wait(signal, std::memory_order_acquire);
+        }
+        m_slots[tail % m_slots.size()] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        signalConsumer();
+        return true;
+    }
+
+    // Consumer only. Tells the producer to stop, as nothing more will be popped.
+    void cancel()
+    {
+        m_cancelled.store(true, std::memory_order_release);
+        signalProducer();
+    }
+
+    [[nodiscard]] bool cancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    // Producer only. Once the consumer has drained the ring, pop returns nothing.
+    void close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        signalConsumer();
+    }
+
+    // Consumer only
+    std::optional<T> pop()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            // Read the signal first so a push or close after the checks below still wakes us
+            const uint32_t signal = m_signal.load(std::memory_order_acquire);
+            if (m_tail.load(std::memory_order_acquire) != head)
+            {
+                break;
+            }
+            if (m_closed.load(std::memory_order_acquire))
+            {
+                if (m_tail.load(std::memory_order_acquire) == head)
+                {
+                    return {};
+                }
+                break;
+            }
+            m_signal.wait(signal, std::memory_order_acquire);
+        }
+        std::optional<T> value = std::move(m_slots[head % m_slots.size()]);
+        m_head.store(head + 1, std::memory_order_release);
+        signalProducer();
+        return value;
+    }
+
+private:
+    void signalConsumer()
+    {
+        m_signal.fetch_add(1, std::memory_order_release);
+        m_signal.notify_one();
+    }
+
+    void signalProducer()
+    {
+        m_producerSignal.fetch_add(1, std::memory_order_release);
+        m_producerSignal.notify_one();
+    }
+
+private:
+    std::vector<T> m_slots;
+    // Producer and consumer positions on separate cache lines so they don't false share
+    alignas(64) std::atomic<size_t> m_head = 0;
+    alignas(64) std::atomic<size_t> m_tail = 0;
+    alignas(64) std::atomic<uint32_t> m_signal = 0;
+    std::atomic<bool> m_closed = false;
+    alignas(64) std::atomic<uint32_t> m_producerSignal = 0;
+    std::atomic<bool> m_cancelled = false;
+};
@@ -0,0 +1,100 @@
+#include "StringInterner.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+StringInterner& StringInterner::global()
+{
+    static StringInterner interner;
+    return interner;
+}
+
+StringInterner::Symbol StringInterner::intern(std::string_view text)
+{
+    // Keep the table at most three quarters full so probe sequences stay short
+    if ((m_names.size() + 1) * 4 > m_slots.size() * 3)
+    {
+        grow();
+    }
+
+    const uint32_t textHash = hash(text);
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = textHash & mask;; i = (i + 1) & mask)
+    {
+        const uint32_t slot = m_slots[i];
+        if (slot == 0)
+        {
+            const auto symbol = static_cast<Symbol>(m_names.size());
+            m_names.push_back(store(text));
+            m_hashes.push_back(textHash);
+            m_slots[i] = symbol + 1;
+            return symbol;
+        }
+        if (m_hashes[slot - 1] == textHash && m_names[slot - 1] == text)
+        {
+            return slot - 1;
+        }
+    }
+}
+
+std::vector<StringInterner::Symbol> StringInterner::merge(const StringInterner& other)
+{
+    std::vector<Symbol> symbols;
+    symbols.reserve(other.size());
+    for (const auto name : other.m_names)
+    {
+        symbols.push_back(intern(name));
+    }
+    return symbols;
+}
+
+size_t StringInterner::memoryBytes() const
+{
+    return m_blockBytes
+        + m_names.capacity() * sizeof(std::string_view)
+        + m_hashes.capacity() * sizeof(uint32_t)
+        + m_slots.capacity() * sizeof(uint32_t)
+        + m_blocks.capacity() * sizeof(std::unique_ptr<char[]>);
+}
+
+uint32_t StringInterner::hash(std::string_view text)
+{
+    // FNV-1a, which is plenty for short identifiers
+    uint32_t value = 2166136261u;
+    for (const char c : text)
+    {
+        value = (value ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return value;
+}
+
+void StringInterner::grow()
+{
+    m_slots.assign(std::max<size_t>(64, m_slots.size() * 2), 0);
+    const size_t mask = m_slots.size() - 1;
+    for (Symbol symbol = 0; symbol < m_names.size(); ++symbol)
+    {
+        size_t i = m_hashes[symbol] & mask;
+        while (m_slots[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        m_slots[i] = symbol + 1;
+    }
+}
+
+std::string_view StringInterner::store(std::string_view text)
+{
+    if (m_blocks.empty() || text.size() > m_blockSize - m_blockUsed)
+    {
+        // Names longer than a block get a block to themselves
+        m_blockSize = std::max(BlockBytes, text.size());
+        m_blocks.push_back(std::make_unique<char[]>(m_blockSize));
+        m_blockUsed = 0;
+        m_blockBytes += m_blockSize;
+    }
+    char* destination = m_blocks.back().get() + m_blockUsed;
+    std::memcpy(destination, text.data(), text.size());
+    m_blockUsed += text.size();
+    return { destination, text.size() };
+}
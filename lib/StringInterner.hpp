@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Maps each distinct identifier to a dense integer symbol, so later stages compare and index by
+// symbol instead of by string. Each name is stored once, in blocks that never move, so the views
+// returned by name stay valid for the lifetime of the interner.
+class StringInterner
+{
+public:
+    using Symbol = uint32_t;
+    static constexpr Symbol NoSymbol = UINT32_MAX;
+
+    StringInterner() = default;
+    StringInterner(const StringInterner& other) = delete;
+    StringInterner(StringInterner&& other) = default;
+    StringInterner& operator=(StringInterner&& other) = default;
+
+    // The interner shared by every phase of the compiler. It is not synchronised: threads that
+    // tokenise concurrently intern into a table of their own, which is merged in afterwards.
+    static StringInterner& global();
+
+    Symbol intern(std::string_view text);
+    // Interns every name of other in symbol order, returning the symbol each has here
+    [[nodiscard]] std::vector<Symbol> merge(const StringInterner& other);
+
+    [[nodiscard]] std::string_view name(Symbol symbol) const { return m_names[symbol]; }
+    [[nodiscard]] size_t size() const { return m_names.size(); }
+    // Bytes held by the names, the lookup table and the symbol arrays
+    [[nodiscard]] size_t memoryBytes() const;
+
+private:
+    static uint32_t hash(std::string_view text);
+    void grow();
+    std::string_view store(std::string_view text);
+
+private:
+    static constexpr size_t BlockBytes = 64 * 1024;
+
+    std::vector<std::string_view> m_names;
+    std::vector<uint32_t> m_hashes;
+    // Open addressing table of symbol + 1, with 0 marking an empty slot. The size is a power of two.
+    std::vector<uint32_t> m_slots;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_blockUsed = 0;
+    size_t m_blockSize = 0;
+    size_t m_blockBytes = 0;
+};
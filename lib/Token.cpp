@@ -1,9 +1,10 @@
 #include "Token.hpp"
 
-Token::Token(Token::Kind kind, std::optional<Info> info, std::optional<std::string> value)
-    : m_kind(kind)
-    , m_info(info)
-    , m_value(std::move(value))
+Token::Token(Token::Kind kind, Info info, StringInterner::Symbol symbol, int64_t intValue)
+    : m_info(info)
+    , m_kind(kind)
+    , m_symbol(symbol)
+    , m_intValue(intValue)
 {
 
 }
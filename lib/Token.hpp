@@ -1,20 +1,28 @@
 #pragma once
 
+#include "StringInterner.hpp"
+
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
+#include <cstdint>
 
 class Token
 {
 public:
+    // Compact location of a token: the file it came from, as registered with the SourceManager,
+    // and its byte offset in that file. Lines and columns are only worked out when a diagnostic
+    // needs them, see SourceManager::resolve.
     struct Info
     {
-        std::string File;
-        size_t Line = 0;
-        size_t Pos = 0;
+        static constexpr uint32_t NoFile = UINT32_MAX;
+
+        uint32_t FileId = NoFile;
+        uint32_t Offset = 0;
     };
 
-    enum class Kind
+    enum class Kind : uint8_t
     {
         Return,
         Let,
@@ -46,45 +54,54 @@ public:
         SingleQuote,
         DoubleQuote,
         Pipe,
+        Bang,
+        // Two character operators, each a single character symbol followed by =
+        EqualsEquals,
+        BangEquals,
+        LessThanEquals,
+        GreaterThanEquals,
         Comment,
         Unexpected
     };
 
-    explicit Token(Kind kind, std::optional<Info> info, std::optional<std::string> value);
+    // An Unexpected token with no location, for nodes to be constructed before their token is stored
+    Token() = default;
+    explicit Token(Kind kind, Info info, StringInterner::Symbol symbol = StringInterner::NoSymbol, int64_t intValue = 0);
 
     [[nodiscard]] Kind kind() const { return m_kind; }
-    [[nodiscard]] std::optional<Info> info() const { return m_info; }
-    [[nodiscard]] std::optional<std::string> value() const { return m_value; }
+    [[nodiscard]] Info info() const { return m_info; }
+    // Interned text of an identifier or integer literal
+    [[nodiscard]] StringInterner::Symbol symbol() const { return m_symbol; }
+    [[nodiscard]] std::optional<std::string_view> value() const
+    {
+        if (m_symbol == StringInterner::NoSymbol)
+        {
+            return {};
+        }
+        return StringInterner::global().name(m_symbol);
+    }
+    // Decoded value of an IntLit token, 0 for every other kind
+    [[nodiscard]] int64_t intValue() const { return m_intValue; }
 
+    // Moves the token by offsetDelta bytes, for when the source before it has been edited
+    void relocate(int64_t offsetDelta)
+    {
+        m_info.Offset = static_cast<uint32_t>(m_info.Offset + offsetDelta);
+    }
 private:
-    Kind m_kind;
-    std::optional<Info> m_info;
-    std::optional<std::string> m_value;
+    Info m_info;
+    Kind m_kind = Kind::Unexpected;
+    StringInterner::Symbol m_symbol = StringInterner::NoSymbol;
+    int64_t m_intValue = 0;
 };
 
-using TokenVector = std::vector<Token>;
-
-inline Token makeToken(Token::Kind kind, std::optional<Token::Info> info, std::optional<std::string> value) {
-    Token t(kind, info, std::move(value));
+inline Token makeToken(Token::Kind kind, Token::Info info, std::optional<std::string_view> value, int64_t intValue = 0) {
+    const auto symbol = value.has_value() ? StringInterner::global().intern(value.value()) : StringInterner::NoSymbol;
+    Token t(kind, info, symbol, intValue);
     return t;
 }
 
-inline Token makeToken(Token::Kind kind, std::optional<Token::Info> info) {
-    Token t(kind, info, {});
+inline Token makeToken(Token::Kind kind, Token::Info info) {
+    Token t(kind, info);
     return t;
 }
-
-inline std::optional<uint8_t> binaryPrecedence(Token::Kind kind)
-{
-    switch (kind)
-    {
-        case Token::Kind::Minus:
-        case Token::Kind::Plus:
-            return 0;
-        case Token::Kind::Asterisk:
-        case Token::Kind::ForwardSlash:
-            return 1;
-        default:
-            return {};
-    }
-}
\ No newline at end of file
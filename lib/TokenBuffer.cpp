@@ -0,0 +1,118 @@
+#include "TokenBuffer.hpp"
+
+#include <algorithm>
+
+void TokenBuffer::reserve(size_t tokenCount)
+{
+    m_kinds.reserve(tokenCount);
+    m_offsets.reserve(tokenCount);
+    m_payloads.reserve(tokenCount);
+}
+
+void TokenBuffer::push(Token::Kind kind, uint32_t offset)
+{
+    m_kinds.push_back(kind);
+    m_offsets.push_back(offset);
+    m_payloads.push_back(NoPayload);
+}
+
+void TokenBuffer::pushWithPayload(Token::Kind kind, uint32_t offset, StringInterner::Symbol symbol, int64_t intValue)
+{
+    m_kinds.push_back(kind);
+    m_offsets.push_back(offset);
+    m_payloads.push_back(static_cast<uint32_t>(m_symbols.size()));
+    m_symbols.push_back(symbol);
+    m_intValues.push_back(intValue);
+}
+
+void TokenBuffer::append(const TokenBuffer& other)
+{
+    const auto payloadBase = static_cast<uint32_t>(m_symbols.size());
+    m_kinds.insert(m_kinds.end(), other.m_kinds.begin(), other.m_kinds.end());
+    m_offsets.insert(m_offsets.end(), other.m_offsets.begin(), other.m_offsets.end());
+    for (const auto payload : other.m_payloads)
+    {
+        m_payloads.push_back(payload == NoPayload ? NoPayload : payload + payloadBase);
+    }
+    m_symbols.insert(m_symbols.end(), other.m_symbols.begin(), other.m_symbols.end());
+    m_intValues.insert(m_intValues.end(), other.m_intValues.begin(), other.m_intValues.end());
+}
+
+void TokenBuffer::discardFront(size_t count)
+{
+    count = std::min(count, m_kinds.size());
+    const auto payloadCount = static_cast<uint32_t>(std::count_if(m_payloads.begin(), m_payloads.begin() + count, [](uint32_t payload) { return payload != NoPayload; }));
+    m_kinds.erase(m_kinds.begin(), m_kinds.begin() + count);
+    m_offsets.erase(m_offsets.begin(), m_offsets.begin() + count);
+    m_payloads.erase(m_payloads.begin(), m_payloads.begin() + count);
+    for (auto& payload : m_payloads)
+    {
+        if (payload != NoPayload)
+        {
+            payload -= payloadCount;
+        }
+    }
+    m_symbols.erase(m_symbols.begin(), m_symbols.begin() + payloadCount);
+    m_intValues.erase(m_intValues.begin(), m_intValues.begin() + payloadCount);
+}
+
+void TokenBuffer::splice(size_t first, size_t last, const TokenBuffer& replacement, int64_t offsetDelta)
+{
+    TokenBuffer result(m_fileId);
+    result.reserve(size() - (last - first) + replacement.size());
+    const auto copy = [&](const TokenBuffer& from, size_t begin, size_t end, int64_t delta) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto offset = static_cast<uint32_t>(from.m_offsets[i] + delta);
+            const auto payload = from.m_payloads[i];
+            if (payload == NoPayload)
+            {
+                result.push(from.m_kinds[i], offset);
+            }
+            else
+            {
+                result.pushWithPayload(from.m_kinds[i], offset, from.m_symbols[payload], from.m_intValues[payload]);
+            }
+        }
+    };
+    copy(*this, 0, first, 0);
+    copy(replacement, 0, replacement.size(), 0);
+    copy(*this, last, size(), offsetDelta);
+    *this = std::move(result);
+}
+
+void TokenBuffer::remapSymbols(const std::vector<StringInterner::Symbol>& symbols)
+{
+    for (auto& symbol : m_symbols)
+    {
+        symbol = symbols[symbol];
+    }
+}
+
+StringInterner::Symbol TokenBuffer::symbol(size_t index) const
+{
+    const auto payload = m_payloads[index];
+    return payload == NoPayload ? StringInterner::NoSymbol : m_symbols[payload];
+}
+
+std::string_view TokenBuffer::text(size_t index) const
+{
+    const auto payload = m_payloads[index];
+    return payload == NoPayload ? std::string_view() : StringInterner::global().name(m_symbols[payload]);
+}
+
+int64_t TokenBuffer::intValue(size_t index) const
+{
+    const auto payload = m_payloads[index];
+    return payload == NoPayload ? 0 : m_intValues[payload];
+}
+
+Token TokenBuffer::operator[](size_t index) const
+{
+    const auto payload = m_payloads[index];
+    if (payload == NoPayload)
+    {
+        return Token(m_kinds[index], info(index));
+    }
+    return Token(m_kinds[index], info(index), m_symbols[payload], m_intValues[payload]);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Token.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The token stream of one source file stored as parallel dense arrays. Every token has a kind and
+// a byte offset; identifiers and integer literals also have a payload index into the symbol and
+// value arrays. The parser walks this by index and only ever materialises a Token when it stores one in
+// the AST.
+class TokenBuffer
+{
+public:
+    static constexpr uint32_t NoPayload = UINT32_MAX;
+
+    TokenBuffer() = default;
+    explicit TokenBuffer(uint32_t fileId) : m_fileId(fileId) {}
+
+    void reserve(size_t tokenCount);
+    void push(Token::Kind kind, uint32_t offset);
+    void pushWithPayload(Token::Kind kind, uint32_t offset, StringInterner::Symbol symbol, int64_t intValue = 0);
+    // Appends every token of other, which must come later in the same file
+    void append(const TokenBuffer& other);
+    // Drops the first count tokens, shifting the rest down to index 0
+    void discardFront(size_t count);
+    // Replaces tokens [first, last) with replacement, which was tokenised from the edited source.
+    // Tokens after last move by offsetDelta.
+    void splice(size_t first, size_t last, const TokenBuffer& replacement, int64_t offsetDelta);
+    // Rewrites every symbol s as symbols[s], for tokens interned into a table of their own
+    void remapSymbols(const std::vector<StringInterner::Symbol>& symbols);
+
+    [[nodiscard]] size_t size() const { return m_kinds.size(); }
+    [[nodiscard]] bool empty() const { return m_kinds.empty(); }
+    [[nodiscard]] uint32_t fileId() const { return m_fileId; }
+
+    [[nodiscard]] Token::Kind kind(size_t index) const { return m_kinds[index]; }
+    [[nodiscard]] uint32_t offset(size_t index) const { return m_offsets[index]; }
+    [[nodiscard]] Token::Info info(size_t index) const { return { .FileId = m_fileId, .Offset = m_offsets[index] }; }
+    // Symbol of an identifier or integer literal, NoSymbol for every other kind
+    [[nodiscard]] StringInterner::Symbol symbol(size_t index) const;
+    // Text of an identifier or integer literal from the global interner, empty for every other kind
+    [[nodiscard]] std::string_view text(size_t index) const;
+    [[nodiscard]] int64_t intValue(size_t index) const;
+
+    // Materialises the token at index
+    [[nodiscard]] Token operator[](size_t index) const;
+
+private:
+    uint32_t m_fileId = Token::Info::NoFile;
+    std::vector<Token::Kind> m_kinds;
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_payloads;
+    std::vector<StringInterner::Symbol> m_symbols;
+    std::vector<int64_t> m_intValues;
+};
@@ -1,180 +1,327 @@
-#include <sstream>
 #include "Tokeniser.hpp"
+#include "CharClass.hpp"
+#include "Keywords.hpp"
+#include "Scanner.hpp"
 
-std::map<char, Token::Kind> Tokeniser::SymbolTokenMap = {
-    {';', Token::Kind::SemiColon},
-    {'(', Token::Kind::OpenParen},
-    {')', Token::Kind::CloseParen},
-    {'=', Token::Kind::Equals},
-    {'+', Token::Kind::Plus},
-    {'*', Token::Kind::Asterisk},
-    {'-', Token::Kind::Minus},
-    {'/', Token::Kind::ForwardSlash},
-    {'\\', Token::Kind::BackSlash},
-    {'{', Token::Kind::OpenCurly},
-    {'}', Token::Kind::CloseCurly},
-    {'[', Token::Kind::OpenSquare},
-    {']', Token::Kind::CloseSquare},
-    {'<', Token::Kind::LessThan},
-    {'>', Token::Kind::GreaterThan},
-    {'.', Token::Kind::Dot},
-    {',', Token::Kind::Comma},
-    {':', Token::Kind::Colon},
-    {'\'', Token::Kind::SingleQuote},
-    {'\"', Token::Kind::DoubleQuote},
-    {'|', Token::Kind::Pipe}
-};
-
-std::map<std::string, Token::Kind> Tokeniser::KeywordTokenMap = {
-    {"return", Token::Kind::Return},
-    {"let", Token::Kind::Let},
-    {"if", Token::Kind::If},
-    {"for", Token::Kind::For},
-    {"else", Token::Kind::Else},
-    {"while", Token::Kind::While}
-};
-
-Tokeniser::Tokeniser(std::string source, std::string filename, ErrorHandler& errorHandler)
-    : m_src(std::move(source))
-    , m_filename(std::move(filename))
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <thread>
+
+Tokeniser::Tokeniser(std::string_view source, std::string filename, ErrorHandler& errorHandler)
+    : m_src(source)
+    , m_fileId(errorHandler.sources().addFile(std::move(filename), source))
     , m_errorHandler(errorHandler)
 {
 }
 
-TokenVector Tokeniser::tokenise()
+Tokeniser::Tokeniser(std::string_view source, uint32_t fileId, ErrorHandler& errorHandler)
+    : m_src(source)
+    , m_fileId(fileId)
+    , m_errorHandler(errorHandler)
+{
+}
+
+TokenBuffer Tokeniser::tokenise()
+{
+    if (auto error = sourceSizeError())
+    {
+        m_errorHandler << std::move(error.value());
+        return TokenBuffer(m_fileId);
+    }
+
+    // Stops at the error limit, as the parser won't look at anything after it
+    auto result = tokeniseRange(0, m_src.size(), StringInterner::global(), SIZE_MAX, m_errorHandler.errorsBeforeLimit());
+    for (auto& error : result.errors)
+    {
+        m_errorHandler << std::move(error);
+    }
+    if (result.openComment.has_value())
+    {
+        m_errorHandler << unterminatedCommentError(result.openComment.value());
+    }
+    return std::move(result.tokens);
+}
+
+TokenBuffer Tokeniser::tokeniseParallel(size_t threadCount, size_t chunkBytes)
 {
-    std::vector<Token> tokens{};
-    std::vector<std::string> errors{};
-    std::stringstream buf;
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threadCount == 1 || m_src.size() <= chunkBytes || m_src.size() > UINT32_MAX)
+    {
+        return tokenise();
+    }
 
-    while(peek().has_value())
+    // Chunks start just after a newline, as no token other than a multi-line comment spans one
+    const char* const srcEnd = m_src.data() + m_src.size();
+    std::vector<size_t> boundaries = { 0 };
+    while (boundaries.back() + chunkBytes < m_src.size())
     {
-        if (std::isspace(peek().value()))
+        const char* newline = Scanner::findNewline(m_src.data() + boundaries.back() + chunkBytes, srcEnd);
+        if (newline == srcEnd)
         {
-            // Ignore whitespace but calculate the correct position in the source code
-            if (isNewline())
+            break;
+        }
+        boundaries.push_back(newline + 1 - m_src.data());
+    }
+    boundaries.push_back(m_src.size());
+    const size_t chunkCount = boundaries.size() - 1;
+
+    // The global interner can't be shared between threads, so each chunk interns into its own.
+    // A chunk stops once it alone has found enough errors to reach the limit, and chunks not yet
+    // started are left once any has, so garbage input gives up about as quickly as tokenise().
+    std::vector<RangeResult> chunks(chunkCount);
+    std::vector<StringInterner> chunkSymbols(chunkCount);
+    // Not vector<bool>, as its elements are written from different threads
+    std::vector<uint8_t> tokenised(chunkCount);
+    const size_t maxErrors = m_errorHandler.errorsBeforeLimit();
+    std::atomic<bool> stopping = false;
+    std::atomic<size_t> nextChunk = 0;
+    const auto worker = [&] {
+        for (size_t chunk = nextChunk++; chunk < chunkCount && !stopping.load(std::memory_order_relaxed); chunk = nextChunk++)
+        {
+            chunks[chunk] = tokeniseRange(boundaries[chunk], boundaries[chunk + 1], chunkSymbols[chunk], SIZE_MAX, maxErrors);
+            tokenised[chunk] = 1;
+            if (chunks[chunk].errors.size() >= maxErrors)
             {
-                m_lineNo++;
-                m_posInLine = 0;
-                consumeNewline();
-            } else {
-                consume();
+                stopping.store(true, std::memory_order_relaxed);
             }
+        }
+    };
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i = 1; i < std::min(threadCount, chunkCount); ++i)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+    }
+
+    // Each chunk was tokenised as if it started outside a comment. Where a multi-line comment is
+    // left open at the end of a chunk, the following chunks are really inside it up to the closing
+    // *#, so they are dropped or tokenised again from just after it. Errors found inside a comment
+    // don't count, so a chunk skipped above is tokenised here unless the limit really was reached
+    // before it; the chunks from there on are dropped.
+    std::optional<uint32_t> openComment;
+    size_t errorCount = 0;
+    size_t mergedChunks = chunkCount;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        if (errorCount >= maxErrors)
+        {
+            mergedChunks = chunk;
+            openComment.reset();
+            break;
+        }
+        if (openComment.has_value())
+        {
+            const char* chunkBegin = m_src.data() + boundaries[chunk];
+            const char* chunkEnd = m_src.data() + boundaries[chunk + 1];
+            // Chunks end in a newline, so a *# can't straddle the boundary
+            const char* commentEnd = Scanner::findCommentEnd(chunkBegin, chunkEnd);
+            if (commentEnd == chunkEnd)
+            {
+                // The whole chunk is inside the comment
+                chunks[chunk] = {};
+                chunkSymbols[chunk] = StringInterner();
+                continue;
+            }
+            chunkSymbols[chunk] = StringInterner();
+            chunks[chunk] = tokeniseRange(commentEnd + 2 - m_src.data(), boundaries[chunk + 1], chunkSymbols[chunk], SIZE_MAX,
+                                          maxErrors - errorCount);
+        }
+        else if (!tokenised[chunk])
+        {
+            chunks[chunk] = tokeniseRange(boundaries[chunk], boundaries[chunk + 1], chunkSymbols[chunk], SIZE_MAX, maxErrors - errorCount);
+        }
+        openComment = chunks[chunk].openComment;
+        errorCount += chunks[chunk].errors.size();
+    }
+
+    size_t tokenCount = 0;
+    for (size_t chunk = 0; chunk < mergedChunks; ++chunk)
+    {
+        tokenCount += chunks[chunk].tokens.size();
+    }
+    // Merging in chunk order hands out symbols in order of first use, as tokenise() does
+    TokenBuffer tokens(m_fileId);
+    tokens.reserve(tokenCount);
+    for (size_t chunk = 0; chunk < mergedChunks; ++chunk)
+    {
+        chunks[chunk].tokens.remapSymbols(StringInterner::global().merge(chunkSymbols[chunk]));
+        tokens.append(chunks[chunk].tokens);
+        for (auto& error : chunks[chunk].errors)
+        {
+            m_errorHandler << std::move(error);
+        }
+    }
+    if (openComment.has_value())
+    {
+        m_errorHandler << unterminatedCommentError(openComment.value());
+    }
+    return tokens;
+}
+
+void Tokeniser::tokeniseInto(TokenBlockQueue& blocks, size_t blockTokens) const
+{
+    if (auto error = sourceSizeError())
+    {
+        blocks.push({ .tokens = TokenBuffer(m_fileId), .errors = { std::move(error.value()) }, .symbols = {} });
+        blocks.close();
+        return;
+    }
+
+    size_t srcPos = 0;
+    do
+    {
+        // The parser cancels when it gives up, so the rest of the source isn't tokenised for nothing
+        if (blocks.cancelled())
+        {
+            break;
+        }
+        StringInterner symbols;
+        auto result = tokeniseRange(srcPos, m_src.size(), symbols, blockTokens);
+        srcPos = result.stoppedAt;
+        if (result.openComment.has_value())
+        {
+            result.errors.push_back(unterminatedCommentError(result.openComment.value()));
+        }
+        if (!blocks.push({ .tokens = std::move(result.tokens), .errors = std::move(result.errors), .symbols = std::move(symbols) }))
+        {
+            break;
+        }
+    } while (srcPos < m_src.size());
+    blocks.close();
+}
+
+std::optional<TokenBlock> Tokeniser::tokeniseSpan(size_t begin, size_t end) const
+{
+    if (m_src.size() > UINT32_MAX || begin > end || end > m_src.size())
+    {
+        return {};
+    }
+    StringInterner symbols;
+    auto result = tokeniseRange(begin, end, symbols);
+    if (result.openComment.has_value())
+    {
+        return {};
+    }
+    return TokenBlock{ .tokens = std::move(result.tokens), .errors = std::move(result.errors), .symbols = std::move(symbols) };
+}
+
+Tokeniser::RangeResult Tokeniser::tokeniseRange(size_t begin, size_t end, StringInterner& symbols, size_t maxTokens, size_t maxErrors) const
+{
+    RangeResult result{ .tokens = TokenBuffer(m_fileId), .errors = {}, .openComment = {}, .stoppedAt = end };
+    TokenBuffer& tokens = result.tokens;
+    const char* const srcEnd = m_src.data() + end;
+    // Typical Emerald source averages a token every few bytes, so this avoids most regrowth
+    tokens.reserve(std::min((end - begin) / 4, maxTokens));
+
+    size_t srcPos = begin;
+    while (srcPos < end && tokens.size() < maxTokens && result.errors.size() < maxErrors)
+    {
+        const char* const current = m_src.data() + srcPos;
+        const auto offset = static_cast<uint32_t>(srcPos);
+        const uint8_t charClass = CharClass::of(*current);
+
+        if (charClass & CharClass::Whitespace)
+        {
+            // Ignore whitespace
+            srcPos = Scanner::skipWhitespace(current, srcEnd) - m_src.data();
 
             // Go to the next character
             continue;
         }
 
-
-        if (std::isalpha(peek().value()))
+        if (charClass & CharClass::Alpha)
         {
-            const auto infoAtStart = getCurrentTokenInfo();
-            buf << consume();
-            while (peek().has_value() && std::isalnum(peek().value())) {
-                buf << consume();
-            }
+            const char* textEnd = Scanner::skipAlnum(current + 1, srcEnd);
+            const std::string_view text(current, textEnd - current);
+            srcPos += text.size();
 
             // Check if it's a key word
-            if(KeywordTokenMap.contains(buf.str()))
+            if (const auto keyword = Keywords::lookup(text))
             {
-                auto keywordToken = KeywordTokenMap.at(buf.str());
-                tokens.push_back(makeToken(keywordToken, infoAtStart));
-                buf.str("");
+                tokens.push(keyword.value(), offset);
             }
             else
             {
-                tokens.push_back(makeToken(Token::Kind::Identifier, infoAtStart, buf.str()));
-                buf.str("");
+                tokens.pushWithPayload(Token::Kind::Identifier, offset, symbols.intern(text));
             }
         }
-        else if (std::isdigit(peek().value()))
+        else if (charClass & CharClass::Digit)
         {
-            const Token::Info info = getCurrentTokenInfo();
-            buf << consume();
-            while (peek().has_value() && std::isdigit(peek().value())) {
-                buf << consume();
+            const char* textEnd = Scanner::skipDigits(current + 1, srcEnd);
+            const std::string_view text(current, textEnd - current);
+            srcPos += text.size();
+
+            // Decode the literal once here so later stages never have to re-parse the text
+            int64_t value = 0;
+            const auto [valueEnd, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (ec == std::errc::result_out_of_range)
+            {
+                result.errors.push_back(makeError({ .FileId = m_fileId, .Offset = offset }, "Integer literal " + std::string(text) + " is out of range."));
             }
-            tokens.push_back(makeToken(Token::Kind::IntLit, info, buf.str()));
-            buf.str("");
-        }
-        else if (peek().value() == '#') {
-            if (peek(1).value() == '*') {
-                // Parse any multi-line comments
-                const Token::Info info = getCurrentTokenInfo();
-                buf << consume() << consume();
-                // Parse until we hit another */
-                while (peek().has_value() && peek().value() != '*' && peek(1).has_value() && peek(1).value() != '#') {
-                    buf << consume();
+            tokens.pushWithPayload(Token::Kind::IntLit, offset, symbols.intern(text), value);
+        }
+        else if (*current == '#') {
+            if (current + 1 != srcEnd && current[1] == '*') {
+                // Parse any multi-line comments, which run until the next *#
+                const char* commentEnd = Scanner::findCommentEnd(current + 2, srcEnd);
+                if (commentEnd == srcEnd)
+                {
+                    result.openComment = offset;
+                    srcPos = end;
                 }
-                buf << consume() << consume();
-                auto comment = buf.str();
-                comment = comment.erase(0, 2);
-                comment = comment.erase(comment.size() - 2, 2);
-                //tokens.push_back(makeToken(Token::Kind::Comment, info, comment));
-                buf.str("");
-            } else {
-                // Parse any single line comments
-                const Token::Info info = getCurrentTokenInfo();
-                buf << consume() << consume();
-                while (peek().has_value() && !isNewline()) {
-                    buf << consume();
+                else
+                {
+                    srcPos = commentEnd + 2 - m_src.data();
                 }
-                auto comment = buf.str();
-                comment = comment.erase(0, 2);
-                //tokens.push_back(makeToken(Token::Kind::Comment, info, comment));
-                buf.str("");
+            } else {
+                // Parse any single line comments, leaving the line ending to the whitespace handling
+                srcPos = Scanner::findNewline(current + 1, srcEnd) - m_src.data();
             }
         }
-        else if (SymbolTokenMap.contains(peek().value()))
+        else if (charClass & CharClass::Symbol)
         {
-            // Single symbol
-            auto symToken = SymbolTokenMap.at(peek().value());
-            const Token::Info info = getCurrentTokenInfo();
-            consume();
-            tokens.push_back(makeToken(symToken, info));
+            // Two character operators are a symbol followed by =, otherwise it's a single symbol
+            const Token::Kind compound = CharClass::equalsSuffixKind(*current);
+            if (compound != Token::Kind::Unexpected && current + 1 != srcEnd && current[1] == '=')
+            {
+                tokens.push(compound, offset);
+                srcPos += 2;
+            }
+            else
+            {
+                tokens.push(CharClass::symbolKind(*current), offset);
+                ++srcPos;
+            }
         }
         else
         {
-            tokens.push_back(makeToken(Token::Kind::Unexpected, getCurrentTokenInfo()));
+            // Reported here so garbage input reaches the error limit without waiting on the parser,
+            // which doesn't report the token again
+            result.errors.push_back(makeError({ .FileId = m_fileId, .Offset = offset }, "Unexpected character."));
+            tokens.push(Token::Kind::Unexpected, offset);
+            ++srcPos;
         }
     }
-    // Reset the position into the source in case tokenise is called twice
-    m_srcPos = 0;
-    return tokens;
+    result.stoppedAt = srcPos;
+    return result;
 }
 
-std::optional<char> Tokeniser::peek(size_t offset) const
+std::optional<Message> Tokeniser::sourceSizeError() const
 {
-    if (m_srcPos + offset >= m_src.size())
+    if (m_src.size() > UINT32_MAX)
     {
-        return {};
-    }
-    return m_src.at(m_srcPos + offset);
-}
-
-char Tokeniser::consume()
-{
-    m_posInLine++;
-   return m_src.at(m_srcPos++);
-}
-
-void Tokeniser::consumeNewline()
-{
-    if (peek().value() == '\n') {
-        consume();
-    } else if (peek().value() == '\r' && peek(1).value() == '\n') {
-        consume();
-        consume();
+        return makeError({}, "Source file is larger than the 4 GiB supported.");
     }
+    return {};
 }
 
-Token::Info Tokeniser::getCurrentTokenInfo() const
+Message Tokeniser::unterminatedCommentError(uint32_t offset) const
 {
-    Token::Info info = { .File = m_filename, .Line = m_lineNo, .Pos = m_posInLine };
-    return info;
+    return makeError({ .FileId = m_fileId, .Offset = offset }, "Unterminated multi-line comment.");
 }
-
-bool Tokeniser::isNewline() const
-{
-    return  peek().value() == '\n' || (peek().value() == '\r' && peek(1).value() == '\n');
-}
\ No newline at end of file
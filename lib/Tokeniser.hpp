@@ -1,35 +1,83 @@
 #pragma once
 
 #include "Token.hpp"
+#include "TokenBuffer.hpp"
 #include "CompilerError.hpp"
+#include "SpscQueue.hpp"
 
 #include <string>
+#include <string_view>
 #include <optional>
 #include <vector>
-#include <map>
+
+// A fixed-size run of tokens handed from the tokeniser thread to the parser, with any errors
+// found while producing it. The tokens' symbols are local to the block's own interner, and have to
+// be merged into the global one before use.
+struct TokenBlock
+{
+    TokenBuffer tokens;
+    std::vector<Message> errors;
+    StringInterner symbols;
+};
+
+using TokenBlockQueue = SpscQueue<TokenBlock>;
 
 class Tokeniser
 {
 public:
-    explicit Tokeniser(std::string source, std::string filename, ErrorHandler& errorHandler);
+    // Sources smaller than this are not worth splitting across threads
+    static constexpr size_t DefaultChunkBytes = 4 * 1024 * 1024;
+    static constexpr size_t DefaultBlockTokens = 64 * 1024;
+
+    // The source is not copied; it must outlive both the tokeniser and the tokens it produces.
+    // The file is registered with the error handler's SourceManager so token locations can be
+    // resolved if a diagnostic is printed.
+    explicit Tokeniser(std::string_view source, std::string filename, ErrorHandler& errorHandler);
+    // For a file already registered with the error handler, such as when relexing after an edit
+    Tokeniser(std::string_view source, uint32_t fileId, ErrorHandler& errorHandler);
+
+    [[nodiscard]] TokenBuffer tokenise();
 
-    [[nodiscard]] TokenVector tokenise();
+    // Splits the source into chunks of roughly chunkBytes at line boundaries and tokenises them on
+    // threadCount threads (0 for one per hardware thread), then stitches them back together. The
+    // tokens and errors are identical to tokenise() up to the error limit, after which neither
+    // goes any further than is needed to report it.
+    [[nodiscard]] TokenBuffer tokeniseParallel(size_t threadCount = 0, size_t chunkBytes = DefaultChunkBytes);
+
+    // Tokenises into blocks of blockTokens tokens, pushing each one as soon as it is full and
+    // closing the queue at the end. Errors travel with the blocks rather than going to the error
+    // handler, so this can run on its own thread while the consumer reports errors.
+    void tokeniseInto(TokenBlockQueue& blocks, size_t blockTokens = DefaultBlockTokens) const;
+
+    // Tokenises only [begin, end), which must not start inside a comment. Errors are returned rather
+    // than reported, and symbols are local to the block. Returns nothing if a multi-line comment is still open at end, as the tokens
+    // would then depend on source beyond the span.
+    [[nodiscard]] std::optional<TokenBlock> tokeniseSpan(size_t begin, size_t end) const;
+
+    [[nodiscard]] uint32_t fileId() const { return m_fileId; }
 
 private:
-    [[nodiscard]] std::optional<char> peek(size_t offset = 0) const;
-    char consume();
-    void consumeNewline();
-    [[nodiscard]] Token::Info getCurrentTokenInfo() const;
-    bool isNewline() const;
+    struct RangeResult
+    {
+        TokenBuffer tokens;
+        std::vector<Message> errors;
+        // Offset of a multi-line comment that is still open at the end of the range
+        std::optional<uint32_t> openComment;
+        // Where tokenising stopped, which is before the end of the range if maxTokens or maxErrors
+        // was reached
+        size_t stoppedAt = 0;
+    };
+
+    // Tokenises [begin, end) of the source, stopping early once maxTokens tokens have been
+    // produced or maxErrors errors found. Only reads the source and symbols, so ranges can be
+    // tokenised concurrently as long as each has its own interner.
+    [[nodiscard]] RangeResult tokeniseRange(size_t begin, size_t end, StringInterner& symbols, size_t maxTokens = SIZE_MAX,
+                                            size_t maxErrors = SIZE_MAX) const;
+    [[nodiscard]] std::optional<Message> sourceSizeError() const;
+    [[nodiscard]] Message unterminatedCommentError(uint32_t offset) const;
 
 private:
-    const std::string m_src;
-    const std::string m_filename;
-    size_t m_srcPos = 0;
-    size_t m_posInLine = 1;
-    size_t m_lineNo = 1;
+    const std::string_view m_src;
+    uint32_t m_fileId;
     ErrorHandler& m_errorHandler;
-
-    static std::map<char, Token::Kind> SymbolTokenMap;
-    static std::map<std::string, Token::Kind> KeywordTokenMap;
 };
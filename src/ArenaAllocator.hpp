@@ -1,33 +1,199 @@
 #pragma once
 
-#include <cstdlib>
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-class ArenaAllocator
+// Bump allocator for AST nodes. Memory comes from a list of chunks that grows as needed, each
+// twice the size of the last up to MaxChunkBytes, so small programs only take a small first chunk.
+// Everything is released at once when the arena is rewound or destroyed.
+//
+// It is also a std::pmr::memory_resource, so containers in the tree can allocate from it too.
+// Deallocation does nothing; their memory goes back with everything else.
+class ArenaAllocator : public std::pmr::memory_resource
 {
 public:
-    explicit inline ArenaAllocator(size_t bytes) : m_size(bytes)
+    static constexpr size_t DefaultChunkBytes = 64 * 1024;
+    static constexpr size_t MaxChunkBytes = 4 * 1024 * 1024;
+
+    // Position in the arena that can be rewound to, releasing everything allocated after it
+    struct Checkpoint
+    {
+        size_t chunk;
+        std::byte* offset;
+        void* destructors;
+    };
+
+    explicit inline ArenaAllocator(size_t firstChunkBytes = DefaultChunkBytes) : m_nextChunkBytes(std::max<size_t>(firstChunkBytes, 64))
     {
-        m_buffer = static_cast<std::byte *>(malloc(m_size));
-        m_offset = m_buffer;
     }
     inline ArenaAllocator(const ArenaAllocator& other) = delete;
-    inline ~ArenaAllocator()
+    inline ~ArenaAllocator() override
+    {
+        rewind({ 0, nullptr, nullptr });
+    }
+
+    // Constructs a T in place from args, suitably aligned
+    template<typename T, typename... Args>
+    inline T* alloc(Args&&... args)
+    {
+        void* memory = bump(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            // Objects may hold resources from outside the arena, which have to be released when it
+            // is rewound. The record lives in the arena too, so it goes with the object.
+            auto destructor = new (bump(sizeof(Destructor), alignof(Destructor))) Destructor{
+                .destroy = [](void* o) { static_cast<T*>(o)->~T(); },
+                .object = object,
+                .next = m_destructors
+            };
+            m_destructors = destructor;
+        }
+        return object;
+    }
+
+    // As alloc, for a T whose resources all come from this arena, such as a pmr container on it.
+    // Nothing is left to release, so it's never destroyed and costs no destructor record.
+    template<typename T, typename... Args>
+    inline T* allocOwned(Args&&... args)
+    {
+        return new (bump(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    [[nodiscard]] inline Checkpoint checkpoint() const
+    {
+        return { m_chunk, m_offset, m_destructors };
+    }
+
+    // Destroys everything allocated since checkpoint, most recent first. Chunks are kept for reuse.
+    inline void rewind(Checkpoint checkpoint)
+    {
+        m_highWaterMark = highWaterMark();
+        while (m_destructors != checkpoint.destructors)
+        {
+            auto destructor = static_cast<Destructor*>(m_destructors);
+            m_destructors = destructor->next;
+            destructor->destroy(destructor->object);
+        }
+        if (checkpoint.offset == nullptr)
+        {
+            // Before the first allocation
+            m_chunk = 0;
+            m_offset = m_chunks.empty() ? nullptr : m_chunks.front().begin.get();
+            m_end = m_chunks.empty() ? nullptr : m_offset + m_chunks.front().bytes;
+            return;
+        }
+        m_chunk = checkpoint.chunk;
+        m_offset = checkpoint.offset;
+        m_end = m_chunks[m_chunk].begin.get() + m_chunks[m_chunk].bytes;
+    }
+
+    // Bytes handed out, including alignment padding
+    [[nodiscard]] inline size_t bytesUsed() const
+    {
+        if (m_chunks.empty())
+        {
+            return 0;
+        }
+        return m_chunks[m_chunk].usedBefore + (m_offset - m_chunks[m_chunk].begin.get());
+    }
+    // Most bytes that have been in use at once
+    [[nodiscard]] inline size_t highWaterMark() const { return std::max(m_highWaterMark, bytesUsed()); }
+    [[nodiscard]] inline size_t chunkCount() const { return m_chunks.size(); }
+    // Bytes held in chunks, whether in use or not
+    [[nodiscard]] inline size_t bytesReserved() const
+    {
+        size_t bytes = 0;
+        for (const auto& chunk : m_chunks)
+        {
+            bytes += chunk.bytes;
+        }
+        return bytes;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        return bump(bytes, alignment);
+    }
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<std::byte[]> begin;
+        size_t bytes;
+        // Bytes in use in the chunks before this one when it was started
+        size_t usedBefore;
+    };
+
+    struct Destructor
+    {
+        void (*destroy)(void*);
+        void* object;
+        void* next;
+    };
+
+    // Raw, uninitialised memory
+    inline void* bump(size_t bytes, size_t alignment)
+    {
+        auto aligned = alignUp(m_offset, alignment);
+        if (aligned == nullptr || aligned + bytes > m_end)
+        {
+            nextChunk(bytes + alignment);
+            aligned = alignUp(m_offset, alignment);
+        }
+        m_offset = aligned + bytes;
+        return aligned;
+    }
+
+    static inline std::byte* alignUp(std::byte* offset, size_t alignment)
     {
-        free(m_buffer);
+        const auto address = reinterpret_cast<uintptr_t>(offset);
+        return offset + ((alignment - address % alignment) % alignment);
     }
 
-    template<typename T>
-    inline T* alloc()
+    // Moves on to a chunk with room for bytes, reusing one left by a rewind if it's big enough
+    inline void nextChunk(size_t bytes)
     {
-        void* offset = m_offset;
-//        std::cout << "Allocating " << sizeof(T) << " bytes." << std::endl;
-        m_offset += sizeof(T);
-        return static_cast<T*>(offset);
+        const size_t usedBefore = bytesUsed();
+        const size_t next = m_chunks.empty() ? 0 : m_chunk + 1;
+        if (next == m_chunks.size() || m_chunks[next].bytes < bytes)
+        {
+            const size_t chunkBytes = std::max(bytes, m_nextChunkBytes);
+            m_nextChunkBytes = std::min(m_nextChunkBytes * 2, MaxChunkBytes);
+            m_chunks.insert(m_chunks.begin() + static_cast<ptrdiff_t>(next), Chunk{
+                .begin = std::make_unique_for_overwrite<std::byte[]>(chunkBytes),
+                .bytes = chunkBytes,
+                .usedBefore = 0
+            });
+        }
+        m_chunk = next;
+        m_chunks[next].usedBefore = usedBefore;
+        m_offset = m_chunks[next].begin.get();
+        m_end = m_offset + m_chunks[next].bytes;
     }
 
 private:
-    size_t m_size;
-    std::byte* m_buffer;
-    std::byte* m_offset;
-};
\ No newline at end of file
+    std::vector<Chunk> m_chunks;
+    size_t m_chunk = 0;
+    std::byte* m_offset = nullptr;
+    std::byte* m_end = nullptr;
+    size_t m_nextChunkBytes;
+    size_t m_highWaterMark = 0;
+    // Most recently constructed object needing destruction, each pointing on to the one before
+    void* m_destructors = nullptr;
+};
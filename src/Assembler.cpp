@@ -18,8 +18,13 @@ void Assembler::generate(const std::string& asmStr)
         outputFile << asmStr;
     }
 
+    assemble();
+}
+
+void Assembler::assemble()
+{
     std::stringstream assembleCmd;
-    assembleCmd << "nasm -felf64 " << outputFilename;
+    assembleCmd << "nasm -felf64 " << generateOutputFilename();
     std::cout << assembleCmd.str() << std::endl;
     std::system(assembleCmd.str().c_str());
 }
@@ -8,8 +8,9 @@ public:
     explicit Assembler(const std::string& outName);
 
     void generate(const std::string& asmStr);
+    // Assembles asm that has already been written to generateOutputFilename()
+    void assemble();
 
-private:
     std::string generateOutputFilename();
 
 private:
@@ -0,0 +1,374 @@
+#include "AstCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <type_traits>
+
+namespace
+{
+    constexpr std::array<char, 8> Magic = { 'E', 'M', 'D', 'A', 'S', 'T', '\0', '\0' };
+
+    enum Section : uint32_t
+    {
+        Tokens,
+        Exprs,
+        Statements,
+        Returns,
+        Lets,
+        Assigns,
+        Ifs,
+        Whiles,
+        Scopes,
+        // End offset of each symbol's name in SymbolText, in symbol order
+        SymbolEnds,
+        SymbolText,
+        SectionCount
+    };
+
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t count;
+        // Checked on load, so a node that has changed size is never read with the old layout
+        uint64_t elementSize;
+    };
+
+    struct Header
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        // Hash of every byte after the header, so an entry damaged in place is never used
+        uint64_t payloadHash;
+        Node::Range program;
+        std::array<SectionEntry, SectionCount> sections;
+    };
+
+    // Every section starts on a boundary this aligned, which covers every node
+    constexpr size_t SectionAlignment = 16;
+
+    template<typename T>
+    std::span<const T> section(std::string_view file, const SectionEntry& entry)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SectionAlignment);
+        return { reinterpret_cast<const T*>(file.data() + entry.offset), entry.count };
+    }
+
+    // Lays the sections out after the header, collecting them so the payload can be hashed before
+    // anything is written
+    class Writer
+    {
+    public:
+        template<typename T>
+        SectionEntry write(std::span<const T> items)
+        {
+            static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SectionAlignment);
+            // Sections are aligned within the file, which starts with the header
+            m_payload.resize(m_payload.size() + (SectionAlignment - offset() % SectionAlignment) % SectionAlignment);
+            const SectionEntry entry{ .offset = offset(), .count = items.size(), .elementSize = sizeof(T) };
+            m_payload.append(reinterpret_cast<const char*>(items.data()), items.size_bytes());
+            return entry;
+        }
+
+        [[nodiscard]] const std::string& payload() const { return m_payload; }
+
+    private:
+        [[nodiscard]] uint64_t offset() const { return sizeof(Header) + m_payload.size(); }
+
+        std::string m_payload;
+    };
+
+    [[nodiscard]] bool below(Node::Index index, size_t count)
+    {
+        return index < count;
+    }
+    [[nodiscard]] bool belowOrNone(Node::Index index, size_t count)
+    {
+        return index == Node::None || index < count;
+    }
+
+    // Whether every index in tree is in bounds, so nothing reading the tree goes outside it. The hash
+    // catches accidental damage; this is what stops an entry that was written wrongly, or on purpose,
+    // sending the generator out of the file.
+    bool indicesInBounds(const Node::TreeView& tree, size_t symbolCount)
+    {
+        for (const auto& token : tree.tokens)
+        {
+            if (token.symbol() != StringInterner::NoSymbol && token.symbol() >= symbolCount)
+            {
+                return false;
+            }
+        }
+        for (const auto& expr : tree.exprs)
+        {
+            bool valid = true;
+            switch (expr.kind)
+            {
+                case Node::ExprKind::IntLiteral:
+                    break;
+                case Node::ExprKind::Identifier:
+                    valid = below(expr.lhs, tree.tokens.size());
+                    break;
+                case Node::ExprKind::Add:
+                case Node::ExprKind::Multiply:
+                case Node::ExprKind::Minus:
+                case Node::ExprKind::Divide:
+                case Node::ExprKind::LessThan:
+                case Node::ExprKind::GreaterThan:
+                case Node::ExprKind::LessThanEqual:
+                case Node::ExprKind::GreaterThanEqual:
+                case Node::ExprKind::Equal:
+                case Node::ExprKind::NotEqual:
+                    valid = below(expr.lhs, tree.exprs.size()) && below(expr.rhs, tree.exprs.size())
+                         && belowOrNone(expr.token, tree.tokens.size());
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+            if (!valid)
+            {
+                return false;
+            }
+        }
+        for (const auto& statement : tree.statements)
+        {
+            size_t count = 0;
+            switch (statement.kind)
+            {
+                case Node::StmtKind::Return: count = tree.returns.size(); break;
+                case Node::StmtKind::Let: count = tree.lets.size(); break;
+                case Node::StmtKind::Scope: count = tree.scopes.size(); break;
+                case Node::StmtKind::If: count = tree.ifs.size(); break;
+                case Node::StmtKind::Assign: count = tree.assigns.size(); break;
+                case Node::StmtKind::While: count = tree.whiles.size(); break;
+                default: return false;
+            }
+            if (!below(statement.index, count))
+            {
+                return false;
+            }
+        }
+        const auto inStatements = [&](Node::Range range) {
+            return range.first <= tree.statements.size() && range.count <= tree.statements.size() - range.first;
+        };
+        // Only programs without errors are stored, so no child is missing other than the
+        // condition of an else and the branch after the last
+        return std::ranges::all_of(tree.returns, [&](const auto& node) { return below(node.returnExpr, tree.exprs.size()); })
+            && std::ranges::all_of(tree.lets, [&](const auto& node) {
+                   return below(node.identifier, tree.tokens.size()) && below(node.letExpr, tree.exprs.size());
+               })
+            && std::ranges::all_of(tree.assigns, [&](const auto& node) {
+                   return below(node.identifier, tree.tokens.size()) && below(node.assignExpr, tree.exprs.size());
+               })
+            && std::ranges::all_of(tree.ifs, [&](const auto& node) {
+                   return belowOrNone(node.expr, tree.exprs.size()) && below(node.scope, tree.scopes.size())
+                       && belowOrNone(node.next, tree.ifs.size());
+               })
+            && std::ranges::all_of(tree.whiles, [&](const auto& node) {
+                   return below(node.expr, tree.exprs.size()) && below(node.scope, tree.scopes.size());
+               })
+            && std::ranges::all_of(tree.scopes, [&](const auto& node) { return inStatements(node.statements); });
+    }
+}
+
+uint64_t AstCache::hashSource(std::string_view source)
+{
+    // Eight bytes at a time, mixed with the multipliers of splitmix64. Not cryptographic, but the
+    // size is checked as well, and an accidental collision across 64 bits is not a practical worry.
+    constexpr uint64_t M1 = 0x9E3779B97F4A7C15ull;
+    constexpr uint64_t M2 = 0xBF58476D1CE4E5B9ull;
+    uint64_t hash = source.size() * M1;
+    size_t at = 0;
+    for (; at + 8 <= source.size(); at += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, source.data() + at, sizeof(word));
+        hash = std::rotl(hash ^ (word * M1), 31) * M2;
+    }
+    if (at < source.size())
+    {
+        uint64_t tail = 0;
+        std::memcpy(&tail, source.data() + at, source.size() - at);
+        hash = std::rotl(hash ^ (tail * M1), 31) * M2;
+    }
+    hash ^= hash >> 30;
+    hash *= M2;
+    return hash ^ (hash >> 31);
+}
+
+std::filesystem::path AstCache::entryPath(const std::filesystem::path& directory, uint64_t sourceHash)
+{
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(sourceHash));
+    return directory / name;
+}
+
+std::optional<AstCache> AstCache::load(const std::filesystem::path& path, uint64_t sourceHash, size_t sourceSize)
+{
+    auto file = SourceFile::open(path.string());
+    if (!file)
+    {
+        return {};
+    }
+    const std::string_view bytes = file->contents();
+    if (bytes.size() < sizeof(Header))
+    {
+        return {};
+    }
+    Header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != Magic || header.version != FormatVersion || header.sectionCount != SectionCount
+        || header.sourceHash != sourceHash || header.sourceSize != sourceSize
+        || header.payloadHash != hashSource(bytes.substr(sizeof(Header))))
+    {
+        return {};
+    }
+
+    const auto fits = [&](const SectionEntry& entry, size_t elementSize) {
+        return entry.elementSize == elementSize
+            && entry.offset % SectionAlignment == 0
+            && entry.offset <= bytes.size()
+            && entry.count <= (bytes.size() - entry.offset) / elementSize;
+    };
+    const auto& sections = header.sections;
+    if (!fits(sections[Tokens], sizeof(Token)) || !fits(sections[Exprs], sizeof(Node::Expr))
+        || !fits(sections[Statements], sizeof(Node::Stmt)) || !fits(sections[Returns], sizeof(Node::Statement::Return))
+        || !fits(sections[Lets], sizeof(Node::Statement::Let)) || !fits(sections[Assigns], sizeof(Node::Statement::Assign))
+        || !fits(sections[Ifs], sizeof(Node::Statement::If)) || !fits(sections[Whiles], sizeof(Node::Statement::While))
+        || !fits(sections[Scopes], sizeof(Node::Scope)) || !fits(sections[SymbolEnds], sizeof(uint32_t))
+        || !fits(sections[SymbolText], sizeof(char))
+        || header.program.first > sections[Statements].count
+        || header.program.count > sections[Statements].count - header.program.first)
+    {
+        return {};
+    }
+
+    const auto symbolEnds = section<uint32_t>(bytes, sections[SymbolEnds]);
+    const auto symbolText = section<char>(bytes, sections[SymbolText]);
+    uint32_t begin = 0;
+    for (const uint32_t end : symbolEnds)
+    {
+        if (end < begin || end > symbolText.size())
+        {
+            return {};
+        }
+        begin = end;
+    }
+
+    AstCache cache(std::move(file.value()));
+    const std::string_view mapped = cache.m_file.contents();
+    cache.m_program = header.program;
+    cache.m_tree = {
+        .tokens = section<Token>(mapped, sections[Tokens]),
+        .exprs = section<Node::Expr>(mapped, sections[Exprs]),
+        .statements = section<Node::Stmt>(mapped, sections[Statements]),
+        .returns = section<Node::Statement::Return>(mapped, sections[Returns]),
+        .lets = section<Node::Statement::Let>(mapped, sections[Lets]),
+        .assigns = section<Node::Statement::Assign>(mapped, sections[Assigns]),
+        .ifs = section<Node::Statement::If>(mapped, sections[Ifs]),
+        .whiles = section<Node::Statement::While>(mapped, sections[Whiles]),
+        .scopes = section<Node::Scope>(mapped, sections[Scopes])
+    };
+    if (!indicesInBounds(cache.m_tree, symbolEnds.size()))
+    {
+        return {};
+    }
+
+    // Interned in symbol order, so in a fresh compile each symbol keeps the number it was saved
+    // with. Only done once the entry is known to be sound, so a bad one leaves no symbols behind.
+    std::vector<StringInterner::Symbol> symbols;
+    symbols.reserve(symbolEnds.size());
+    bool renumbered = false;
+    begin = 0;
+    for (const uint32_t end : symbolEnds)
+    {
+        symbols.push_back(StringInterner::global().intern({ symbolText.data() + begin, end - begin }));
+        renumbered = renumbered || symbols.back() != symbols.size() - 1;
+        begin = end;
+    }
+
+    if (renumbered)
+    {
+        // Symbols interned earlier in this compile took some of the numbers, so the tokens are
+        // copied with theirs translated
+        cache.m_tokens.reserve(cache.m_tree.tokens.size());
+        for (const auto& token : cache.m_tree.tokens)
+        {
+            const auto symbol = token.symbol() == StringInterner::NoSymbol ? token.symbol() : symbols[token.symbol()];
+            cache.m_tokens.emplace_back(token.kind(), token.info(), symbol, token.intValue());
+        }
+        cache.m_tree.tokens = cache.m_tokens;
+    }
+    return cache;
+}
+
+bool AstCache::store(const std::filesystem::path& path, uint64_t sourceHash, size_t sourceSize,
+                     Node::TreeView tree, Node::Range program, const StringInterner& symbols)
+{
+    std::vector<uint32_t> symbolEnds;
+    std::string symbolText;
+    symbolEnds.reserve(symbols.size());
+    for (StringInterner::Symbol symbol = 0; symbol < symbols.size(); ++symbol)
+    {
+        symbolText += symbols.name(symbol);
+        symbolEnds.push_back(static_cast<uint32_t>(symbolText.size()));
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    auto temporary = path;
+    temporary += ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        Header header{
+            .magic = Magic,
+            .version = FormatVersion,
+            .sectionCount = SectionCount,
+            .sourceHash = sourceHash,
+            .sourceSize = sourceSize,
+            .payloadHash = 0,
+            .program = program,
+            .sections = {}
+        };
+        Writer writer;
+        header.sections[Tokens] = writer.write(tree.tokens);
+        header.sections[Exprs] = writer.write(tree.exprs);
+        header.sections[Statements] = writer.write(tree.statements);
+        header.sections[Returns] = writer.write(tree.returns);
+        header.sections[Lets] = writer.write(tree.lets);
+        header.sections[Assigns] = writer.write(tree.assigns);
+        header.sections[Ifs] = writer.write(tree.ifs);
+        header.sections[Whiles] = writer.write(tree.whiles);
+        header.sections[Scopes] = writer.write(tree.scopes);
+        header.sections[SymbolEnds] = writer.write(std::span<const uint32_t>(symbolEnds));
+        header.sections[SymbolText] = writer.write(std::span<const char>(symbolText));
+        header.payloadHash = hashSource(writer.payload());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(writer.payload().data(), static_cast<std::streamsize>(writer.payload().size()));
+        if (!out.flush())
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <SourceFile.hpp>
+#include <StringInterner.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// A parsed program saved in the layout its tree has in memory. Nodes refer to each other by index,
+// so once the file is mapped the generator works straight from it, with no tokenising, parsing or
+// pointer fixing. Entries are keyed by a hash of the source they were parsed from.
+//
+// Only programs that compiled without errors are stored, so a hit can be generated without the
+// source being registered for diagnostics.
+class AstCache
+{
+public:
+    // Bumped whenever the file layout or any node changes
+    static constexpr uint32_t FormatVersion = 3;
+
+    [[nodiscard]] static uint64_t hashSource(std::string_view source);
+    // Where the entry for source with this hash lives in directory
+    [[nodiscard]] static std::filesystem::path entryPath(const std::filesystem::path& directory, uint64_t sourceHash);
+
+    // Maps the entry at path, interning its symbols. Returns nothing if it's missing, damaged, from
+    // another version of the compiler, or for another source. An entry is damaged if its contents
+    // don't match the hash stored with them or any node refers outside the tree.
+    [[nodiscard]] static std::optional<AstCache> load(const std::filesystem::path& path, uint64_t sourceHash, size_t sourceSize);
+    // Writes program, with every symbol of symbols, to path. The file is written alongside and
+    // renamed into place, so a compile running at the same time never sees half an entry.
+    static bool store(const std::filesystem::path& path, uint64_t sourceHash, size_t sourceSize,
+                      Node::TreeView tree, Node::Range program, const StringInterner& symbols);
+
+    [[nodiscard]] const Node::TreeView& tree() const { return m_tree; }
+    [[nodiscard]] Node::Range program() const { return m_program; }
+
+private:
+    explicit AstCache(SourceFile file) : m_file(std::move(file)) {}
+
+private:
+    // The tree views the file, and m_tokens if the symbols had to be renumbered. Both keep their
+    // storage when moved.
+    SourceFile m_file;
+    std::vector<Token> m_tokens;
+    Node::TreeView m_tree;
+    Node::Range m_program;
+};
@@ -0,0 +1,32 @@
+#include "Passes.hpp"
+#include "IrBuilder.hpp"
+
+namespace Passes {
+    bool foldTree(AstPassContext& context)
+    {
+        // The parser adds operands before the node using them, so a single pass in order folds each
+        // expression from its leaves up
+        auto& exprs = context.tree.exprs;
+        bool changed = false;
+        for (auto& node : exprs)
+        {
+            if (Node::isLeaf(node.kind))
+            {
+                continue;
+            }
+            const auto& lhs = exprs[node.lhs];
+            const auto& rhs = exprs[node.rhs];
+            if (lhs.kind != Node::ExprKind::IntLiteral || rhs.kind != Node::ExprKind::IntLiteral)
+            {
+                continue;
+            }
+            // A division that would trap is left to trap when it runs
+            if (const auto folded = Ir::evaluate(IrBuilder::binaryOp(node.kind), lhs.intValue(), rhs.intValue()))
+            {
+                node = Node::Expr::intLiteral(folded.value());
+                changed = true;
+            }
+        }
+        return changed;
+    }
+}
@@ -0,0 +1,277 @@
+#include "Passes.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // What is known about a register, or a variable at some point: nothing yet, as the code
+    // defining it hasn't been found to run; one constant on every path seen so far; or that it
+    // varies. Each only ever moves down that order.
+    struct Lattice
+    {
+        enum class State : uint8_t
+        {
+            Unknown,
+            Constant,
+            Varying
+        };
+        State state = State::Unknown;
+        int64_t constant = 0;
+
+        static Lattice of(int64_t value) { return { .state = State::Constant, .constant = value }; }
+        static Lattice varying() { return { .state = State::Varying }; }
+
+        // Merges other into this, returning whether this changed
+        bool meet(const Lattice& other)
+        {
+            if (other.state == State::Unknown || state == State::Varying)
+            {
+                return false;
+            }
+            if (state == State::Unknown)
+            {
+                *this = other;
+                return true;
+            }
+            if (other.state == State::Varying || other.constant != constant)
+            {
+                *this = varying();
+                return true;
+            }
+            return false;
+        }
+    };
+
+    // Propagates constants through registers and variables together, only along edges found to be
+    // taken, so a branch on a constant never lets the other side's values in
+    class Propagator
+    {
+    public:
+        explicit Propagator(const Ir::Function& function)
+            : m_function(function),
+              m_values(function.instructions.size()),
+              m_users(function.instructions.size()),
+              m_blockEntry(function.blocks.size()),
+              m_reached(function.blocks.size(), false),
+              m_takenFrom(function.blocks.size()),
+              m_queued(function.blocks.size(), false)
+        {
+            for (Ir::BlockId block = 0; block < function.blocks.size(); ++block)
+            {
+                for (const auto value : function.blocks[block].instructions)
+                {
+                    const auto& instruction = function.instructions[value];
+                    for (const auto operand : { instruction.lhs, instruction.rhs })
+                    {
+                        if (operand != Ir::None)
+                        {
+                            m_users[operand].push_back(block);
+                        }
+                    }
+                    for (const auto& incoming : instruction.incoming)
+                    {
+                        m_users[incoming.second].push_back(block);
+                    }
+                }
+            }
+        }
+
+        void run()
+        {
+            // Nothing is known of a variable before it's first stored to
+            reach(Ir::None, m_function.entry, std::vector(m_function.slots.size(), Lattice::varying()));
+            while (!m_worklist.empty())
+            {
+                const auto block = m_worklist.back();
+                m_worklist.pop_back();
+                m_queued[block] = false;
+                visit(block);
+            }
+        }
+
+        [[nodiscard]] const Lattice& value(Ir::Value value) const { return m_values[value]; }
+        [[nodiscard]] bool reached(Ir::BlockId block) const { return m_reached[block]; }
+
+    private:
+        void queue(Ir::BlockId block)
+        {
+            if (!m_queued[block])
+            {
+                m_queued[block] = true;
+                m_worklist.push_back(block);
+            }
+        }
+
+        // Takes the edge from from into block, with the variables as they are at the end of from
+        void reach(Ir::BlockId from, Ir::BlockId block, const std::vector<Lattice>& slots)
+        {
+            bool changed = false;
+            if (from != Ir::None && std::find(m_takenFrom[block].begin(), m_takenFrom[block].end(), from) == m_takenFrom[block].end())
+            {
+                m_takenFrom[block].push_back(from);
+                changed = true;
+            }
+            if (!m_reached[block])
+            {
+                m_reached[block] = true;
+                m_blockEntry[block] = slots;
+                changed = true;
+            }
+            else
+            {
+                for (size_t slot = 0; slot < slots.size(); ++slot)
+                {
+                    changed = m_blockEntry[block][slot].meet(slots[slot]) || changed;
+                }
+            }
+            if (changed)
+            {
+                queue(block);
+            }
+        }
+
+        void visit(Ir::BlockId block)
+        {
+            auto slots = m_blockEntry[block];
+            for (const auto value : m_function.blocks[block].instructions)
+            {
+                const auto& instruction = m_function.instructions[value];
+                Lattice result;
+                switch (instruction.op)
+                {
+                    case Ir::Op::Const:
+                        result = Lattice::of(instruction.constant);
+                        break;
+                    case Ir::Op::Load:
+                        result = slots[instruction.slot];
+                        break;
+                    case Ir::Op::Store:
+                        slots[instruction.slot] = m_values[instruction.lhs];
+                        continue;
+                    case Ir::Op::Phi:
+                        for (const auto& [from, incoming] : instruction.incoming)
+                        {
+                            if (std::find(m_takenFrom[block].begin(), m_takenFrom[block].end(), from) != m_takenFrom[block].end())
+                            {
+                                result.meet(m_values[incoming]);
+                            }
+                        }
+                        break;
+                    case Ir::Op::Jump:
+                        reach(block, instruction.targets[0], slots);
+                        continue;
+                    case Ir::Op::Branch:
+                    {
+                        const auto& condition = m_values[instruction.lhs];
+                        if (condition.state == Lattice::State::Constant)
+                        {
+                            reach(block, instruction.targets[condition.constant != 0 ? 0 : 1], slots);
+                        }
+                        else if (condition.state == Lattice::State::Varying)
+                        {
+                            reach(block, instruction.targets[0], slots);
+                            reach(block, instruction.targets[1], slots);
+                        }
+                        continue;
+                    }
+                    case Ir::Op::Return:
+                        continue;
+                    default:
+                    {
+                        const auto& lhs = m_values[instruction.lhs];
+                        const auto& rhs = m_values[instruction.rhs];
+                        if (lhs.state == Lattice::State::Constant && rhs.state == Lattice::State::Constant)
+                        {
+                            // A division that traps is left for when the program runs
+                            const auto folded = Ir::evaluate(instruction.op, lhs.constant, rhs.constant);
+                            result = folded ? Lattice::of(folded.value()) : Lattice::varying();
+                        }
+                        else if (lhs.state == Lattice::State::Varying || rhs.state == Lattice::State::Varying)
+                        {
+                            result = Lattice::varying();
+                        }
+                        break;
+                    }
+                }
+                if (m_values[value].meet(result))
+                {
+                    for (const auto user : m_users[value])
+                    {
+                        if (m_reached[user])
+                        {
+                            queue(user);
+                        }
+                    }
+                }
+            }
+        }
+
+        const Ir::Function& m_function;
+        std::vector<Lattice> m_values;
+        // The blocks using each register, which are visited again when it changes
+        std::vector<std::vector<Ir::BlockId>> m_users;
+        // The variables on the way into each block, over every edge taken into it
+        std::vector<std::vector<Lattice>> m_blockEntry;
+        std::vector<bool> m_reached;
+        // The predecessors of each block whose edge into it has been taken
+        std::vector<std::vector<Ir::BlockId>> m_takenFrom;
+        std::vector<Ir::BlockId> m_worklist;
+        std::vector<bool> m_queued;
+    };
+}
+
+namespace Passes {
+    bool propagateConstants(IrPassContext& context)
+    {
+        auto& function = context.function;
+        Propagator propagator(function);
+        propagator.run();
+
+        bool changed = false;
+        for (Ir::BlockId block = 0; block < function.blocks.size(); ++block)
+        {
+            if (function.blocks[block].removed || !propagator.reached(block))
+            {
+                continue;
+            }
+            bool phiReplaced = false;
+            for (const auto value : function.blocks[block].instructions)
+            {
+                auto& instruction = function.instructions[value];
+                const auto& known = propagator.value(value);
+                if (instruction.op == Ir::Op::Const || !Ir::hasResult(instruction.op) || known.state != Lattice::State::Constant)
+                {
+                    continue;
+                }
+                phiReplaced = phiReplaced || instruction.op == Ir::Op::Phi;
+                instruction = { .op = Ir::Op::Const, .block = block, .constant = known.constant };
+                changed = true;
+            }
+            if (phiReplaced)
+            {
+                // Phis stay at the start of the block
+                auto& instructions = function.blocks[block].instructions;
+                std::stable_partition(instructions.begin(), instructions.end(), [&](Ir::Value value) {
+                    return function.instructions[value].op == Ir::Op::Phi;
+                });
+            }
+
+            const auto& terminator = function.terminator(block);
+            if (terminator.op != Ir::Op::Branch)
+            {
+                continue;
+            }
+            const auto& condition = propagator.value(terminator.lhs);
+            if (condition.state == Lattice::State::Constant)
+            {
+                const auto taken = terminator.targets[condition.constant != 0 ? 0 : 1];
+                function.replaceTerminator(block, { .op = Ir::Op::Jump, .targets = { taken, Ir::None } });
+                changed = true;
+            }
+        }
+        // Whatever was only reachable through a pruned branch
+        changed = function.removeUnreachableBlocks() || changed;
+        changed = function.removeDeadInstructions() || changed;
+        return changed;
+    }
+}
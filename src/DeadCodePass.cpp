@@ -0,0 +1,68 @@
+#include "Passes.hpp"
+#include "IrAnalysis.hpp"
+
+namespace
+{
+    // Removes every store that no load can see. Returns whether there were any.
+    bool removeDeadStores(Ir::Function& function)
+    {
+        const Ir::SlotLiveness liveness(function);
+        // Whether each variable is live at the point reached walking back through the current
+        // block, for those it has touched so far
+        std::vector<Ir::BlockId> touchedIn(function.slots.size(), Ir::None);
+        std::vector<bool> live(function.slots.size(), false);
+        bool removed = false;
+        for (const auto block : Ir::reversePostOrder(function))
+        {
+            const auto liveAfter = [&](Ir::SlotId slot) {
+                return touchedIn[slot] == block ? live[slot] : liveness.liveOut(block, slot);
+            };
+            auto& instructions = function.blocks[block].instructions;
+            std::vector<Ir::Value> kept;
+            kept.reserve(instructions.size());
+            for (auto value = instructions.rbegin(); value != instructions.rend(); ++value)
+            {
+                auto& instruction = function.instructions[*value];
+                if (instruction.op == Ir::Op::Store)
+                {
+                    const bool needed = liveAfter(instruction.slot);
+                    touchedIn[instruction.slot] = block;
+                    live[instruction.slot] = false;
+                    if (!needed)
+                    {
+                        instruction.block = Ir::None;
+                        removed = true;
+                        continue;
+                    }
+                }
+                else if (instruction.op == Ir::Op::Load)
+                {
+                    touchedIn[instruction.slot] = block;
+                    live[instruction.slot] = true;
+                }
+                kept.push_back(*value);
+            }
+            instructions.assign(kept.rbegin(), kept.rend());
+        }
+        return removed;
+    }
+}
+
+namespace Passes {
+    bool eliminateDeadCode(IrPassContext& context)
+    {
+        auto& function = context.function;
+        // Anything after a return is lowered into a block nothing jumps to
+        bool changed = function.removeUnreachableBlocks();
+        // Dropping an unused load can leave the store before it dead, and dropping a store can
+        // leave the load of the value it stored unused, as in let b = a;
+        bool changedThisRound = true;
+        while (changedThisRound)
+        {
+            changedThisRound = function.removeDeadInstructions();
+            changedThisRound = removeDeadStores(function) || changedThisRound;
+            changed = changed || changedThisRound;
+        }
+        return changed;
+    }
+}
@@ -0,0 +1,129 @@
+#include "DivisionCheck.hpp"
+#include "IrBuilder.hpp"
+
+DivisionCheck::DivisionCheck(ErrorHandler& errorHandler) : m_errorHandler(errorHandler)
+{
+}
+
+void DivisionCheck::checkProgram(Node::TreeView tree, Node::Range statements)
+{
+    for (const auto statement : tree.list(statements))
+    {
+        checkStatement(tree, statement);
+    }
+}
+
+void DivisionCheck::checkStatement(Node::TreeView tree, Node::Stmt statement)
+{
+    m_statements.push_back({ .statement = statement, .alwaysReached = true });
+    while (!m_statements.empty())
+    {
+        const auto pending = m_statements.back();
+        m_statements.pop_back();
+        const bool alwaysReached = pending.alwaysReached && !m_returned;
+        const auto index = pending.statement.index;
+        switch (pending.statement.kind)
+        {
+            case Node::StmtKind::Return:
+                checkExpr(tree, tree.returns[index].returnExpr, alwaysReached);
+                m_returned = m_returned || alwaysReached;
+                break;
+            case Node::StmtKind::Let:
+                checkExpr(tree, tree.lets[index].letExpr, alwaysReached);
+                break;
+            case Node::StmtKind::Assign:
+                checkExpr(tree, tree.assigns[index].assignExpr, alwaysReached);
+                break;
+            case Node::StmtKind::Scope:
+            {
+                // Last first, so they're checked in order
+                const auto statements = tree.list(tree.scopes[index].statements);
+                for (auto it = statements.rbegin(); it != statements.rend(); ++it)
+                {
+                    m_statements.push_back({ .statement = *it, .alwaysReached = alwaysReached });
+                }
+                break;
+            }
+            case Node::StmtKind::If:
+            {
+                // Only the condition of the first branch is always evaluated
+                const auto& branch = tree.ifs[index];
+                if (branch.next != Node::None)
+                {
+                    m_statements.push_back({ .statement = { Node::StmtKind::If, branch.next }, .alwaysReached = false });
+                }
+                if (branch.scope != Node::None)
+                {
+                    m_statements.push_back({ .statement = { Node::StmtKind::Scope, branch.scope }, .alwaysReached = false });
+                }
+                checkExpr(tree, branch.expr, alwaysReached);
+                break;
+            }
+            case Node::StmtKind::While:
+            {
+                const auto& loop = tree.whiles[index];
+                if (loop.scope != Node::None)
+                {
+                    m_statements.push_back({ .statement = { Node::StmtKind::Scope, loop.scope }, .alwaysReached = false });
+                }
+                checkExpr(tree, loop.expr, alwaysReached);
+                break;
+            }
+        }
+    }
+}
+
+void DivisionCheck::checkExpr(Node::TreeView tree, Node::Index expr, bool alwaysReached)
+{
+    if (expr == Node::None)
+    {
+        return;
+    }
+    // Operands are checked before the operator using them, lhs first, leaving their values on
+    // m_values with the rhs on top
+    m_exprs.push_back({ .expr = expr, .operandsChecked = false });
+    while (!m_exprs.empty())
+    {
+        const auto pending = m_exprs.back();
+        m_exprs.pop_back();
+        const auto& node = tree.exprs[pending.expr];
+        if (node.kind == Node::ExprKind::IntLiteral)
+        {
+            m_values.emplace_back(node.intValue());
+            continue;
+        }
+        if (node.kind == Node::ExprKind::Identifier)
+        {
+            m_values.emplace_back();
+            continue;
+        }
+        if (!pending.operandsChecked)
+        {
+            m_exprs.push_back({ .expr = pending.expr, .operandsChecked = true });
+            m_exprs.push_back({ .expr = node.rhs, .operandsChecked = false });
+            m_exprs.push_back({ .expr = node.lhs, .operandsChecked = false });
+            continue;
+        }
+
+        const auto rhs = m_values.back();
+        m_values.pop_back();
+        const auto lhs = m_values.back();
+        m_values.pop_back();
+        const auto op = IrBuilder::binaryOp(node.kind);
+        const auto value = lhs && rhs ? Ir::evaluate(op, lhs.value(), rhs.value()) : std::nullopt;
+        m_values.push_back(value);
+        if (node.kind != Node::ExprKind::Divide || (rhs != 0 && (!lhs || !rhs || value)))
+        {
+            continue;
+        }
+        std::string description = rhs != 0 ? "Division overflows 64 bits in a constant expression."
+                                : lhs   ? "Division by zero in a constant expression."
+                                        : "Division by zero, as the divisor is always 0.";
+        m_errorHandler << Message{
+            .Kind = alwaysReached ? Message::Kind::Error : Message::Kind::Warning,
+            .Info = node.token != Node::None ? tree.tokens[node.token].info() : Token::Info{},
+            .Description = std::move(description)
+        };
+    }
+    m_values.clear();
+}
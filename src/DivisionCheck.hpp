@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <CompilerError.hpp>
+
+#include <optional>
+#include <vector>
+
+// Reports each division by a constant expression that is 0, or that overflows 64 bits, before
+// anything is generated, so every optimisation level and mode reports the same. A division that
+// every run of the program reaches is an error; one only reached on some paths is a warning, as
+// the program may never get there, and is left to trap when it runs.
+class DivisionCheck
+{
+public:
+    explicit DivisionCheck(ErrorHandler& errorHandler);
+
+    // Checks the top-level statements of a program in order. Once one of them returns, those after
+    // it are never reached.
+    void checkProgram(Node::TreeView tree, Node::Range statements);
+    void checkStatement(Node::TreeView tree, Node::Stmt statement);
+
+private:
+    // Walks expr, reporting its divisions
+    void checkExpr(Node::TreeView tree, Node::Index expr, bool alwaysReached);
+
+    // A statement still to check, and whether it is on every path through the program. An else if
+    // or else branch is an If statement too.
+    struct PendingStatement
+    {
+        Node::Stmt statement;
+        bool alwaysReached;
+    };
+    struct PendingExpr
+    {
+        Node::Index expr;
+        bool operandsChecked;
+    };
+
+    ErrorHandler& m_errorHandler;
+    // Whether a return on every path has been checked
+    bool m_returned = false;
+    // Explicit work stacks, so nesting depth is limited by memory rather than the native stack
+    std::vector<PendingStatement> m_statements;
+    std::vector<PendingExpr> m_exprs;
+    // Value of each operand checked so far, if it is a constant
+    std::vector<std::optional<int64_t>> m_values;
+};
@@ -0,0 +1,187 @@
+#include "Passes.hpp"
+#include "IrAnalysis.hpp"
+
+#include <optional>
+
+namespace
+{
+    void makeConstant(Ir::Instruction& instruction, int64_t value)
+    {
+        instruction.op = Ir::Op::Const;
+        instruction.constant = value;
+        instruction.lhs = Ir::None;
+        instruction.rhs = Ir::None;
+    }
+
+    // What a binary instruction with at most one constant operand simplifies to
+    struct Simplified
+    {
+        std::optional<Ir::Value> value = std::nullopt;
+        std::optional<int64_t> constant = std::nullopt;
+    };
+
+    Simplified simplify(const Ir::Instruction& instruction, std::optional<int64_t> lhs, std::optional<int64_t> rhs)
+    {
+        const bool same = instruction.lhs == instruction.rhs;
+        switch (instruction.op)
+        {
+            case Ir::Op::Add:
+                if (rhs == 0) return { .value = instruction.lhs };
+                if (lhs == 0) return { .value = instruction.rhs };
+                break;
+            case Ir::Op::Sub:
+                if (rhs == 0) return { .value = instruction.lhs };
+                if (same) return { .constant = 0 };
+                break;
+            case Ir::Op::Mul:
+                if (rhs == 0 || lhs == 0) return { .constant = 0 };
+                if (rhs == 1) return { .value = instruction.lhs };
+                if (lhs == 1) return { .value = instruction.rhs };
+                break;
+            case Ir::Op::Div:
+                if (rhs == 1) return { .value = instruction.lhs };
+                break;
+            // A register always compares equal to itself
+            case Ir::Op::Eq:
+            case Ir::Op::Le:
+            case Ir::Op::Ge:
+                if (same) return { .constant = 1 };
+                break;
+            case Ir::Op::Ne:
+            case Ir::Op::Lt:
+            case Ir::Op::Gt:
+                if (same) return { .constant = 0 };
+                break;
+            default:
+                break;
+        }
+        return {};
+    }
+}
+
+namespace Passes {
+    bool fold(IrPassContext& context)
+    {
+        auto& function = context.function;
+        std::vector<Ir::Value> replacements(function.instructions.size(), Ir::None);
+        const auto resolve = [&](Ir::Value value) {
+            while (value != Ir::None && replacements[value] != Ir::None)
+            {
+                value = replacements[value];
+            }
+            return value;
+        };
+        const auto constantOf = [&](Ir::Value value) -> std::optional<int64_t> {
+            const auto& instruction = function.instructions[value];
+            return instruction.op == Ir::Op::Const ? std::optional(instruction.constant) : std::nullopt;
+        };
+
+        // In reverse postorder every operand is folded before its users, other than through phis
+        bool changed = false;
+        std::vector<Ir::Value> slotValues;
+        for (const auto block : Ir::reversePostOrder(function))
+        {
+            // Within a block a variable holds what was last stored to or loaded from it, so that
+            // folding sees through variables
+            slotValues.assign(function.slots.size(), Ir::None);
+            for (const auto value : function.blocks[block].instructions)
+            {
+                auto& instruction = function.instructions[value];
+                instruction.lhs = resolve(instruction.lhs);
+                instruction.rhs = resolve(instruction.rhs);
+                if (instruction.op == Ir::Op::Store)
+                {
+                    slotValues[instruction.slot] = instruction.lhs;
+                    continue;
+                }
+                if (instruction.op == Ir::Op::Load)
+                {
+                    if (slotValues[instruction.slot] != Ir::None)
+                    {
+                        replacements[value] = slotValues[instruction.slot];
+                        changed = true;
+                    }
+                    else
+                    {
+                        slotValues[instruction.slot] = value;
+                    }
+                    continue;
+                }
+                if (instruction.op == Ir::Op::Phi)
+                {
+                    // A phi taking the same register along every edge, bar from itself, is that register
+                    Ir::Value only = Ir::None;
+                    bool unique = true;
+                    for (auto& incoming : instruction.incoming)
+                    {
+                        incoming.second = resolve(incoming.second);
+                        if (incoming.second != value && incoming.second != only)
+                        {
+                            unique = unique && only == Ir::None;
+                            only = incoming.second;
+                        }
+                    }
+                    if (unique && only != Ir::None)
+                    {
+                        replacements[value] = only;
+                        changed = true;
+                    }
+                    continue;
+                }
+                if (!Ir::isBinary(instruction.op))
+                {
+                    continue;
+                }
+
+                const auto lhs = constantOf(instruction.lhs);
+                const auto rhs = constantOf(instruction.rhs);
+                // A division that traps is left in to trap when it runs, as it does at -O0. Those by
+                // constant expressions have already been reported by DivisionCheck, at every level.
+                if (instruction.op == Ir::Op::Div && rhs == 0)
+                {
+                    continue;
+                }
+                if (lhs && rhs)
+                {
+                    if (const auto folded = Ir::evaluate(instruction.op, lhs.value(), rhs.value()))
+                    {
+                        makeConstant(instruction, folded.value());
+                        changed = true;
+                    }
+                    continue;
+                }
+                const auto simplified = simplify(instruction, lhs, rhs);
+                if (simplified.value)
+                {
+                    replacements[value] = simplified.value.value();
+                    changed = true;
+                }
+                else if (simplified.constant)
+                {
+                    makeConstant(instruction, simplified.constant.value());
+                    changed = true;
+                }
+            }
+        }
+        if (!changed)
+        {
+            return false;
+        }
+
+        // Phis may refer along back edges to registers replaced after them
+        function.replaceUses(replacements);
+        for (auto& block : function.blocks)
+        {
+            std::erase_if(block.instructions, [&](Ir::Value value) {
+                if (replacements[value] == Ir::None)
+                {
+                    return false;
+                }
+                function.instructions[value].block = Ir::None;
+                return true;
+            });
+        }
+        function.removeDeadInstructions();
+        return true;
+    }
+}
@@ -1,109 +1,249 @@
 #include "Generator.hpp"
 #include "NodeVisitor.hpp"
 
+#include <algorithm>
+#include <ranges>
 #include <sstream>
 
-Generator::Generator(Node::Program root, ErrorHandler& errorHandler) : m_root(std::move(root)), m_errorHandler(errorHandler)
+Generator::Generator(Node::Program root, ErrorHandler& errorHandler) : m_source(root.tree), m_statements(root.statements), m_errorHandler(errorHandler)
+{
+
+}
+
+Generator::Generator(const Node::Tree& tree, ErrorHandler& errorHandler) : m_source(&tree), m_errorHandler(errorHandler)
+{
+
+}
+
+Generator::Generator(Node::TreeView tree, Node::Range statements, ErrorHandler& errorHandler) : m_tree(tree), m_statements(statements), m_errorHandler(errorHandler)
 {
 
 }
 
 std::string Generator::generateProgram()
+{
+    if (m_source != nullptr)
+    {
+        m_tree = m_source->view();
+    }
+    beginProgram();
+    for (const auto statement: m_tree.list(m_statements)) {
+        generateStatement(statement);
+    }
+    endProgram();
+    return output().str();
+}
+
+void Generator::beginProgram()
 {
     output() <<"global _start\n\n_start:\n";
+}
 
-    if (!m_root.statements.empty()) {
-        for (const auto statement: m_root.statements) {
-            generateStatement(statement);
-        }
-    }
-    else {
+void Generator::endProgram()
+{
+    if (m_topLevelCount == 0) {
         // TODO: Consider whether this needs to be done all the time or not as a fallback?
         // Handle empty program
         output() << "\tmov rax, 60\n";
         output() << "\tmov rdi, 0\n";
         output() << "\tsyscall\n";
     }
-    return output().str();
 }
 
-void Generator::generateStatement(const Node::Stmt* statement)
+void Generator::flush(std::ostream& out)
+{
+    out << m_outputStream.view();
+    m_outputStream.str({});
+}
+
+void Generator::generateStatement(Node::Stmt statement)
 {
-    StatementVisitor statementVisitor(*this);
-    std::visit(statementVisitor, *statement);
+    if (m_source != nullptr)
+    {
+        m_tree = m_source->view();
+    }
+    if (m_scopes.empty()) {
+        ++m_topLevelCount;
+    }
+    const size_t base = m_steps.size();
+    schedule(statement);
+    runSteps(base);
 }
 
-void Generator::generateExpr(const Node::Expr* expr)
+void Generator::generateExpr(Node::Index expr)
 {
+    const size_t base = m_exprSteps.size();
+    schedule(ExprStep{ .expr = expr });
     ExprVisitor exprVisitor(*this);
-    std::visit(exprVisitor, expr->expr);
+    while (m_exprSteps.size() > base)
+    {
+        const auto step = m_exprSteps.back();
+        m_exprSteps.pop_back();
+        const auto& node = m_tree.exprs[step.expr];
+        if (Node::isLeaf(node.kind))
+        {
+            exprVisitor.term(node);
+        }
+        else if (step.operandsEvaluated)
+        {
+            exprVisitor.operate(node);
+        }
+        else
+        {
+            exprVisitor.scheduleOperands(step.expr, node);
+        }
+    }
 }
 
-void Generator::generateBinExp(const Node::BinExpr *binExpr)
+void Generator::generateScope(const Node::Scope *scope)
 {
-    BinExprVisitor binExprVisitor(*this);
-    std::visit(binExprVisitor, *binExpr);
+    const size_t base = m_steps.size();
+    schedule(scope);
+    runSteps(base);
 }
 
-void Generator::generateRelExp(const Node::RelExpr *relExpr) {
-    RelExprVisitor relExprVisitor(*this);
-    std::visit(relExprVisitor, *relExpr);
+void Generator::generateIfPredicate(const Node::Statement::If* branch, const std::string& endLabel) {
+    const size_t base = m_steps.size();
+    schedule(IfPredicateStep{ .branch = branch, .endLabel = endLabel });
+    runSteps(base);
 }
 
-void Generator::generateEqlExp(const Node::EqlExpr *eqlExpr) {
-    EqlExprVisitor eqlExprVisitor(*this);
-    std::visit(eqlExprVisitor, *eqlExpr);
+void Generator::schedule(Step step)
+{
+    m_steps.push_back(std::move(step));
 }
 
-void Generator::generateTerm(const Node::Term *term)
+void Generator::schedule(ExprStep step)
 {
-    TermVisitor termVisitor(*this);
-    std::visit(termVisitor, *term);
+    m_exprSteps.push_back(step);
 }
 
-void Generator::generateScope(const Node::Scope *scope)
+void Generator::runSteps(size_t base)
 {
-    if (scope) {
-        beginScope();
-        for (const auto *stmt: scope->statements) {
-            generateStatement(stmt);
+    while (m_steps.size() > base)
+    {
+        auto step = std::move(m_steps.back());
+        m_steps.pop_back();
+        if (const auto* statement = std::get_if<Node::Stmt>(&step))
+        {
+            StatementVisitor statementVisitor(*this);
+            m_tree.visit(*statement, statementVisitor);
+        }
+        else if (const auto* scope = std::get_if<const Node::Scope*>(&step))
+        {
+            beginScope();
+            schedule(EndScopeStep{});
+            // Scheduled last first so they're generated in order
+            for (const auto stmt : m_tree.list((*scope)->statements) | std::views::reverse) {
+                schedule(stmt);
+            }
+        }
+        else if (std::holds_alternative<EndScopeStep>(step))
+        {
+            endScope();
+        }
+        else if (const auto* predicate = std::get_if<IfPredicateStep>(&step))
+        {
+            IfPredicateVisitor ifPredicateVisitor(*this, predicate->endLabel);
+            ifPredicateVisitor(*predicate->branch);
+        }
+        else if (const auto* endBranch = std::get_if<EndBranchStep>(&step))
+        {
+            m_outputStream << "\tjmp " << endBranch->endLabel << "; " << endBranch->comment << "\n";
+            m_outputStream << endBranch->nextLabel << ":\n";
+        }
+        else if (const auto* test = std::get_if<WhileTestStep>(&step))
+        {
+            if (test->generated)
+            {
+                generateExpr(test->expr);
+                pop("rax");
+                m_outputStream << "\tcmp rax, 0\n";
+                m_outputStream << "\tjne " << test->bodyLabel << "; end while\n";
+            }
+            m_outputStream << test->endLabel << ":\n";
+        }
+        else
+        {
+            const auto& label = std::get<LabelStep>(step);
+            m_outputStream << label.label << ":" << label.comment << "\n";
         }
-        endScope();
     }
 }
 
-void Generator::generateIfPredicate(const Node::IfPredicate *ifPredicate, const std::string& endLabel) {
-    IfPredicateVisitor ifPredicateVisitor(*this, endLabel);
-    std::visit(ifPredicateVisitor, *ifPredicate);
-}
-
 std::stringstream &Generator::output()
 {
     return m_outputStream;
 }
 
-void Generator::push(const std::string& reg)
+const Node::TreeView& Generator::tree() const
+{
+    return m_tree;
+}
+
+void Generator::push(std::string_view reg)
 {
     output() << "\tpush " << reg << "\n";
     m_stackLocation++;
 }
 
-void Generator::pop(const std::string& reg)
+void Generator::pop(std::string_view reg)
 {
     output() << "\tpop " << reg << "\n";
     m_stackLocation--;
 }
 
-void Generator::move(const std::string& dest, const std::string& src) {
+void Generator::move(std::string_view dest, std::string_view src) {
     output() << "\tmov " << dest << ", " << src << "\n";
 }
 
-std::vector<Variable> &Generator::variables()
+void Generator::pushStackSlot(size_t offset)
+{
+    // We * 8 here because it's the size in bytes (64bit -> 8, 32bit -> 4)
+    output() << "\tpush QWORD [rsp + " << offset * 8 << "]\n";
+    m_stackLocation++;
+}
+
+void Generator::storeStackSlot(size_t offset, std::string_view reg)
+{
+    output() << "\tmov [rsp + " << offset * 8 << "], " << reg << "\n";
+}
+
+void Generator::compare(std::string_view setInstruction)
+{
+    pop("rax");
+    pop("rbx");
+    output() << "\tcmp rax, rbx\n";
+    output() << "\t" << setInstruction << " al\n";
+    output() << "\tmovzx rax, al\n";
+    push("rax");
+}
+
+std::pmr::vector<Variable> &Generator::variables()
 {
     return m_variables;
 }
 
-std::vector<size_t> &Generator::scopes()
+const Variable* Generator::findVariable(StringInterner::Symbol name) const
+{
+    if (name >= m_variableBySymbol.size() || m_variableBySymbol[name] == 0)
+    {
+        return nullptr;
+    }
+    return &m_variables[m_variableBySymbol[name] - 1];
+}
+
+void Generator::declareVariable(StringInterner::Symbol name, size_t stackPosition)
+{
+    if (name >= m_variableBySymbol.size())
+    {
+        m_variableBySymbol.resize(std::max<size_t>(name + 1, StringInterner::global().size()), 0);
+    }
+    m_variables.push_back({ .name = name, .stackPosition = stackPosition, .shadows = m_variableBySymbol[name] });
+    m_variableBySymbol[name] = static_cast<uint32_t>(m_variables.size());
+}
+
+std::pmr::vector<size_t> &Generator::scopes()
 {
     return m_scopes;
 }
@@ -130,8 +270,9 @@ void Generator::endScope()
     m_outputStream << "\tadd rsp, " << popCount * 8 << "\n";
     m_stackLocation -= popCount;
 //    m_variables = std::vector<Variable>(m_variables.begin(), m_variables.begin() + popCount);
-    for (auto i = 0; i < popCount; ++i)
+    for (size_t i = 0; i < popCount; ++i)
     {
+        m_variableBySymbol[m_variables.back().name] = m_variables.back().shadows;
         m_variables.pop_back();
     }
     m_scopes.pop_back();
@@ -139,8 +280,6 @@ void Generator::endScope()
 
 std::string Generator::createLabel()
 {
-    std::stringstream ss;
-    ss << "L" << m_labelIndex++;
-    return ss.str();
+    return "L" + std::to_string(m_labelIndex++);
 }
 
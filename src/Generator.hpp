@@ -1,47 +1,122 @@
 #pragma once
 
+#include "ArenaAllocator.hpp"
 #include "Parser.hpp"
 #include "Variable.hpp"
 #include "Nodes.hpp"
 
 #include <sstream>
 #include <map>
+#include <variant>
 
 class Generator
 {
 public:
     explicit Generator(Node::Program root, ErrorHandler& errorHandler);
+    // For generating a statement of tree at a time, without a whole program
+    explicit Generator(const Node::Tree& tree, ErrorHandler& errorHandler);
+    // For a program whose arrays are held elsewhere, such as a mapped cache file
+    explicit Generator(Node::TreeView tree, Node::Range statements, ErrorHandler& errorHandler);
 
     [[nodiscard]] std::string generateProgram();
+
+    // Incremental generation: beginProgram, then generateStatement for each top-level statement,
+    // then endProgram. flush moves the asm generated so far to out, so it need not be held in memory.
+    void beginProgram();
+    void endProgram();
+    void flush(std::ostream& out);
+
     std::stringstream& output();
-    std::vector<Variable>& variables();
-    std::vector<size_t>& scopes();
+    const Node::TreeView& tree() const;
+    std::pmr::vector<Variable>& variables();
+    // Innermost variable in scope with this name, or nullptr
+    [[nodiscard]] const Variable* findVariable(StringInterner::Symbol name) const;
+    // Declares a variable held in the stack slot at stackPosition
+    void declareVariable(StringInterner::Symbol name, size_t stackPosition);
+    std::pmr::vector<size_t>& scopes();
     ErrorHandler& errors();
     size_t stackLocation() const;
 
-    void generateStatement(const Node::Stmt* statement);
-    void generateExpr(const Node::Expr* expr);
-    void generateBinExp(const Node::BinExpr* binExpr);
-    void generateRelExp(const Node::RelExpr* relExpr);
-    void generateEqlExp(const Node::EqlExpr* eqlExpr);
-    void generateTerm(const Node::Term* term);
+    void generateStatement(Node::Stmt statement);
+    void generateExpr(Node::Index expr);
     void generateScope(const Node::Scope* scope);
-    void generateIfPredicate(const Node::IfPredicate* ifPredicate, const std::string& endLabel);
+    // Generates the else if or else branch that follows an if
+    void generateIfPredicate(const Node::Statement::If* branch, const std::string& endLabel);
 
-    void push(const std::string& reg);
-    void pop(const std::string& reg);
-    void move(const std::string& dest, const std::string& src);
+    // Work still to do, run last in first out. Nested scopes and expressions are scheduled here
+    // rather than generated recursively, so nesting depth is bounded by the heap.
+    struct EndScopeStep {};
+    struct IfPredicateStep
+    {
+        const Node::Statement::If* branch;
+        std::string endLabel;
+    };
+    // Jumps to endLabel past the rest of the chain, then starts nextLabel. Labels are short enough
+    // to be held inline by std::string.
+    struct EndBranchStep
+    {
+        std::string endLabel;
+        std::string nextLabel;
+        const char* comment;
+    };
+    struct LabelStep
+    {
+        std::string label;
+        const char* comment;
+    };
+    // Tests the condition of a while again after its body, jumping back to bodyLabel while it
+    // holds, then starts endLabel. The test is left out where generating it the first time failed,
+    // so its errors are reported once.
+    struct WhileTestStep
+    {
+        Node::Index expr;
+        std::string bodyLabel;
+        std::string endLabel;
+        bool generated;
+    };
+    using Step = std::variant<Node::Stmt, const Node::Scope*, EndScopeStep, IfPredicateStep, EndBranchStep, LabelStep, WhileTestStep>;
+    void schedule(Step step);
+    // Evaluates expr onto the stack, or once its operands have been, pops them and pushes the result
+    struct ExprStep
+    {
+        Node::Index expr;
+        bool operandsEvaluated = false;
+    };
+    void schedule(ExprStep step);
+
+    void push(std::string_view reg);
+    void pop(std::string_view reg);
+    void move(std::string_view dest, std::string_view src);
+    // Pushes a copy of the stack slot offset slots below the top, or stores reg into it
+    void pushStackSlot(size_t offset);
+    void storeStackSlot(size_t offset, std::string_view reg);
+    // Pops lhs then rhs, compares them and pushes 1 where the condition code of setInstruction holds, else 0
+    void compare(std::string_view setInstruction);
     std::string createLabel();
 
     void beginScope();
     void endScope();
 
 private:
-    const Node::Program m_root;
+    // Runs scheduled steps until only the first base remain
+    void runSteps(size_t base);
+
+    // Backs every working container below, so generating makes no calls to the global heap for them
+    ArenaAllocator m_arena;
+    // The parser's tree, if generating from one. It may grow between statements, so the view of
+    // it is taken afresh for each.
+    const Node::Tree* m_source = nullptr;
+    Node::TreeView m_tree;
+    const Node::Range m_statements;
     std::stringstream m_outputStream;
     size_t m_stackLocation = 0;
-    std::vector<Variable> m_variables;
-    std::vector<size_t> m_scopes;
+    std::pmr::vector<Variable> m_variables{ &m_arena };
+    // Index + 1 into m_variables of the innermost variable for each symbol, or 0
+    std::pmr::vector<uint32_t> m_variableBySymbol{ &m_arena };
+    std::pmr::vector<size_t> m_scopes{ &m_arena };
+    std::pmr::vector<Step> m_steps{ &m_arena };
+    std::pmr::vector<ExprStep> m_exprSteps{ &m_arena };
     size_t m_labelIndex = 0;
+    size_t m_topLevelCount = 0;
     ErrorHandler& m_errorHandler;
 };
@@ -0,0 +1,222 @@
+#include "Passes.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+    // An instruction by what it computes, with the operands of commutative ops in order, and a
+    // greater than written as the less than it is
+    struct Expression
+    {
+        Ir::Op op;
+        Ir::Value lhs;
+        Ir::Value rhs;
+
+        bool operator==(const Expression&) const = default;
+    };
+
+    struct ExpressionHash
+    {
+        size_t operator()(const Expression& expression) const
+        {
+            const auto operands = static_cast<uint64_t>(expression.lhs) << 32 | expression.rhs;
+            return std::hash<uint64_t>()(operands * 31 + static_cast<uint64_t>(expression.op));
+        }
+    };
+
+    Expression expressionOf(const Ir::Instruction& instruction)
+    {
+        if (instruction.op == Ir::Op::Const)
+        {
+            const auto bits = static_cast<uint64_t>(instruction.constant);
+            return { Ir::Op::Const, static_cast<Ir::Value>(bits), static_cast<Ir::Value>(bits >> 32) };
+        }
+        auto [op, lhs, rhs] = Expression{ instruction.op, instruction.lhs, instruction.rhs };
+        switch (op)
+        {
+            case Ir::Op::Add:
+            case Ir::Op::Mul:
+            case Ir::Op::Eq:
+            case Ir::Op::Ne:
+                if (lhs > rhs)
+                {
+                    std::swap(lhs, rhs);
+                }
+                break;
+            case Ir::Op::Gt:
+                op = Ir::Op::Lt;
+                std::swap(lhs, rhs);
+                break;
+            case Ir::Op::Ge:
+                op = Ir::Op::Le;
+                std::swap(lhs, rhs);
+                break;
+            default:
+                break;
+        }
+        return { op, lhs, rhs };
+    }
+
+    // The variables any path from the immediate dominator of block into block might store to.
+    // What the dominator knew of any other variable still holds on the way in.
+    std::vector<Ir::SlotId> clobbered(const Ir::Function& function, const Ir::DominatorTree& dominators, Ir::BlockId block,
+                                      std::vector<Ir::BlockId>& visited)
+    {
+        std::vector<Ir::SlotId> slots;
+        const auto idom = dominators.idom(block);
+        std::vector<Ir::BlockId> worklist = function.blocks[block].predecessors;
+        while (!worklist.empty())
+        {
+            const auto from = worklist.back();
+            worklist.pop_back();
+            if (from == idom || visited[from] == block || !dominators.reachable(from))
+            {
+                continue;
+            }
+            visited[from] = block;
+            for (const auto value : function.blocks[from].instructions)
+            {
+                const auto& instruction = function.instructions[value];
+                if (instruction.op == Ir::Op::Store)
+                {
+                    slots.push_back(instruction.slot);
+                }
+            }
+            worklist.insert(worklist.end(), function.blocks[from].predecessors.begin(), function.blocks[from].predecessors.end());
+        }
+        return slots;
+    }
+}
+
+namespace Passes {
+    bool numberValues(IrPassContext& context)
+    {
+        auto& function = context.function;
+        const auto& dominators = context.analyses.dominators();
+        std::vector<Ir::Value> replacements(function.instructions.size(), Ir::None);
+        const auto resolve = [&](Ir::Value value) {
+            while (value != Ir::None && replacements[value] != Ir::None)
+            {
+                value = replacements[value];
+            }
+            return value;
+        };
+
+        // Both are scoped to the dominator tree: what a block computes is available in every block it
+        // dominates, and undone on the way back up. Each undo entry is what was there before.
+        std::unordered_map<Expression, Ir::Value, ExpressionHash> available;
+        std::vector<Expression> availableUndo;
+        // The register holding each variable's value, where that's known
+        std::vector<Ir::Value> slotValues(function.slots.size(), Ir::None);
+        std::vector<std::pair<Ir::SlotId, Ir::Value>> slotUndo;
+        std::vector<Ir::BlockId> visited(function.blocks.size(), Ir::None);
+
+        struct Frame
+        {
+            Ir::BlockId block;
+            size_t availableMark;
+            size_t slotMark;
+            size_t nextChild = 0;
+        };
+        std::vector<Frame> stack;
+        bool changed = false;
+        const auto enter = [&](Ir::BlockId block) {
+            stack.push_back({ block, availableUndo.size(), slotUndo.size() });
+            if (block != function.entry)
+            {
+                for (const auto slot : clobbered(function, dominators, block, visited))
+                {
+                    slotUndo.emplace_back(slot, slotValues[slot]);
+                    slotValues[slot] = Ir::None;
+                }
+            }
+            const auto setSlot = [&](Ir::SlotId slot, Ir::Value value) {
+                slotUndo.emplace_back(slot, slotValues[slot]);
+                slotValues[slot] = value;
+            };
+            for (const auto value : function.blocks[block].instructions)
+            {
+                auto& instruction = function.instructions[value];
+                instruction.lhs = resolve(instruction.lhs);
+                instruction.rhs = resolve(instruction.rhs);
+                switch (instruction.op)
+                {
+                    case Ir::Op::Store:
+                        setSlot(instruction.slot, instruction.lhs);
+                        continue;
+                    case Ir::Op::Load:
+                        if (slotValues[instruction.slot] != Ir::None)
+                        {
+                            replacements[value] = slotValues[instruction.slot];
+                            changed = true;
+                        }
+                        else
+                        {
+                            setSlot(instruction.slot, value);
+                        }
+                        continue;
+                    case Ir::Op::Const:
+                        break;
+                    default:
+                        if (!Ir::isBinary(instruction.op))
+                        {
+                            continue;
+                        }
+                        break;
+                }
+                const auto expression = expressionOf(instruction);
+                if (const auto found = available.find(expression); found != available.end())
+                {
+                    replacements[value] = found->second;
+                    changed = true;
+                    continue;
+                }
+                available.emplace(expression, value);
+                availableUndo.push_back(expression);
+            }
+        };
+
+        enter(function.entry);
+        while (!stack.empty())
+        {
+            auto& frame = stack.back();
+            const auto& children = dominators.children(frame.block);
+            if (frame.nextChild < children.size())
+            {
+                enter(children[frame.nextChild++]);
+                continue;
+            }
+            while (availableUndo.size() > frame.availableMark)
+            {
+                available.erase(availableUndo.back());
+                availableUndo.pop_back();
+            }
+            while (slotUndo.size() > frame.slotMark)
+            {
+                slotValues[slotUndo.back().first] = slotUndo.back().second;
+                slotUndo.pop_back();
+            }
+            stack.pop_back();
+        }
+        if (!changed)
+        {
+            return false;
+        }
+
+        // Phis along back edges may still refer to replaced registers
+        function.replaceUses(replacements);
+        for (auto& block : function.blocks)
+        {
+            std::erase_if(block.instructions, [&](Ir::Value value) {
+                if (replacements[value] == Ir::None)
+                {
+                    return false;
+                }
+                function.instructions[value].block = Ir::None;
+                return true;
+            });
+        }
+        return true;
+    }
+}
@@ -0,0 +1,653 @@
+#include "Ir.hpp"
+#include "IrAnalysis.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+namespace Ir {
+    const char* name(Op op)
+    {
+        switch (op)
+        {
+            case Op::Const: return "const";
+            case Op::Load: return "load";
+            case Op::Add: return "add";
+            case Op::Sub: return "sub";
+            case Op::Mul: return "mul";
+            case Op::Div: return "div";
+            case Op::Lt: return "lt";
+            case Op::Gt: return "gt";
+            case Op::Le: return "le";
+            case Op::Ge: return "ge";
+            case Op::Eq: return "eq";
+            case Op::Ne: return "ne";
+            case Op::Phi: return "phi";
+            case Op::Store: return "store";
+            case Op::Jump: return "jmp";
+            case Op::Branch: return "br";
+            case Op::Return: return "ret";
+        }
+        return "?";
+    }
+
+    std::optional<int64_t> evaluate(Op op, int64_t lhs, int64_t rhs)
+    {
+        // Through unsigned, where overflow is defined to wrap as the machine does
+        const auto a = static_cast<uint64_t>(lhs);
+        const auto b = static_cast<uint64_t>(rhs);
+        switch (op)
+        {
+            case Op::Add: return static_cast<int64_t>(a + b);
+            case Op::Sub: return static_cast<int64_t>(a - b);
+            case Op::Mul: return static_cast<int64_t>(a * b);
+            case Op::Div:
+                if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1))
+                {
+                    return {};
+                }
+                return lhs / rhs;
+            case Op::Lt: return lhs < rhs;
+            case Op::Gt: return lhs > rhs;
+            case Op::Le: return lhs <= rhs;
+            case Op::Ge: return lhs >= rhs;
+            case Op::Eq: return lhs == rhs;
+            case Op::Ne: return lhs != rhs;
+            default: return {};
+        }
+    }
+
+    BlockId Function::addBlock()
+    {
+        blocks.emplace_back();
+        return static_cast<BlockId>(blocks.size() - 1);
+    }
+
+    Value Function::append(BlockId block, Instruction instruction)
+    {
+        instruction.block = block;
+        const auto value = static_cast<Value>(instructions.size());
+        instructions.push_back(std::move(instruction));
+        blocks[block].instructions.push_back(value);
+        for (const BlockId successor : successors(block))
+        {
+            blocks[successor].predecessors.push_back(block);
+        }
+        return value;
+    }
+
+    void Function::remove(Value value)
+    {
+        auto& instruction = instructions[value];
+        auto& list = blocks[instruction.block].instructions;
+        list.erase(std::find(list.begin(), list.end(), value));
+        instruction.block = None;
+    }
+
+    void Function::replaceAllUses(Value from, Value to)
+    {
+        for (auto& instruction : instructions)
+        {
+            if (instruction.block == None)
+            {
+                continue;
+            }
+            if (instruction.lhs == from)
+            {
+                instruction.lhs = to;
+            }
+            if (instruction.rhs == from)
+            {
+                instruction.rhs = to;
+            }
+            for (auto& incoming : instruction.incoming)
+            {
+                if (incoming.second == from)
+                {
+                    incoming.second = to;
+                }
+            }
+        }
+    }
+
+    void Function::replaceTerminator(BlockId block, Instruction terminator)
+    {
+        const auto oldSuccessors = successors(block);
+        const std::vector<BlockId> unlinked(oldSuccessors.begin(), oldSuccessors.end());
+        for (const BlockId successor : unlinked)
+        {
+            // Gone already if the successor has been removed
+            auto& predecessors = blocks[successor].predecessors;
+            if (const auto it = std::find(predecessors.begin(), predecessors.end(), block); it != predecessors.end())
+            {
+                predecessors.erase(it);
+            }
+        }
+        remove(blocks[block].instructions.back());
+        append(block, std::move(terminator));
+        for (const BlockId successor : unlinked)
+        {
+            auto& target = blocks[successor];
+            if (std::find(target.predecessors.begin(), target.predecessors.end(), block) != target.predecessors.end())
+            {
+                continue;
+            }
+            for (const Value value : target.instructions)
+            {
+                auto& phi = instructions[value];
+                if (phi.op != Op::Phi)
+                {
+                    break;
+                }
+                std::erase_if(phi.incoming, [&](const auto& incoming) { return incoming.first == block; });
+            }
+        }
+    }
+
+    void Function::removeBlock(BlockId block)
+    {
+        if (terminated(block))
+        {
+            replaceTerminator(block, { .op = Op::Return });
+        }
+        for (const Value value : blocks[block].instructions)
+        {
+            instructions[value].block = None;
+        }
+        blocks[block].instructions.clear();
+        blocks[block].predecessors.clear();
+        blocks[block].removed = true;
+    }
+
+    bool Function::removeUnreachableBlocks()
+    {
+        std::vector<bool> reachable(blocks.size(), false);
+        for (const BlockId block : reversePostOrder(*this))
+        {
+            reachable[block] = true;
+        }
+        bool removed = false;
+        for (BlockId block = 0; block < blocks.size(); ++block)
+        {
+            if (!reachable[block] && !blocks[block].removed)
+            {
+                removeBlock(block);
+                removed = true;
+            }
+        }
+        return removed;
+    }
+
+    void Function::replaceUses(const std::vector<Value>& replacements)
+    {
+        const auto resolve = [&](Value& operand) {
+            while (operand != None && operand < replacements.size() && replacements[operand] != None)
+            {
+                operand = replacements[operand];
+            }
+        };
+        for (auto& instruction : instructions)
+        {
+            if (instruction.block == None)
+            {
+                continue;
+            }
+            resolve(instruction.lhs);
+            resolve(instruction.rhs);
+            for (auto& incoming : instruction.incoming)
+            {
+                resolve(incoming.second);
+            }
+        }
+    }
+
+    std::vector<uint32_t> Function::useCounts() const
+    {
+        std::vector<uint32_t> uses(instructions.size(), 0);
+        for (const auto& block : blocks)
+        {
+            for (const Value value : block.instructions)
+            {
+                const auto& instruction = instructions[value];
+                if (instruction.lhs != None)
+                {
+                    ++uses[instruction.lhs];
+                }
+                if (instruction.rhs != None)
+                {
+                    ++uses[instruction.rhs];
+                }
+                for (const auto& incoming : instruction.incoming)
+                {
+                    ++uses[incoming.second];
+                }
+            }
+        }
+        return uses;
+    }
+
+    bool Function::hasSideEffects(const Instruction& instruction) const
+    {
+        if (!hasResult(instruction.op))
+        {
+            return true;
+        }
+        if (instruction.op != Op::Div)
+        {
+            return false;
+        }
+        const auto& divisor = instructions[instruction.rhs];
+        return divisor.op != Op::Const || divisor.constant == 0 || divisor.constant == -1;
+    }
+
+    bool Function::removeDeadInstructions()
+    {
+        auto uses = useCounts();
+        std::vector<Value> dead;
+        for (const auto& block : blocks)
+        {
+            for (const Value value : block.instructions)
+            {
+                if (uses[value] == 0 && !hasSideEffects(instructions[value]))
+                {
+                    dead.push_back(value);
+                }
+            }
+        }
+        if (dead.empty())
+        {
+            return false;
+        }
+        // Removing one may leave its operands unused in turn
+        std::vector<bool> removed(instructions.size(), false);
+        while (!dead.empty())
+        {
+            const Value value = dead.back();
+            dead.pop_back();
+            removed[value] = true;
+            auto& instruction = instructions[value];
+            const auto release = [&](Value operand) {
+                if (operand != None && --uses[operand] == 0 && !removed[operand] && !hasSideEffects(instructions[operand]))
+                {
+                    dead.push_back(operand);
+                }
+            };
+            release(instruction.lhs);
+            release(instruction.rhs);
+            for (const auto& incoming : instruction.incoming)
+            {
+                release(incoming.second);
+            }
+        }
+        for (auto& block : blocks)
+        {
+            std::erase_if(block.instructions, [&](Value value) {
+                if (!removed[value])
+                {
+                    return false;
+                }
+                instructions[value].block = None;
+                return true;
+            });
+        }
+        return true;
+    }
+
+    size_t Function::liveInstructionCount() const
+    {
+        size_t count = 0;
+        for (const auto& block : blocks)
+        {
+            count += block.instructions.size();
+        }
+        return count;
+    }
+
+    bool Function::terminated(BlockId block) const
+    {
+        const auto& list = blocks[block].instructions;
+        return !list.empty() && isTerminator(instructions[list.back()].op);
+    }
+
+    const Instruction& Function::terminator(BlockId block) const
+    {
+        return instructions[blocks[block].instructions.back()];
+    }
+
+    std::span<const BlockId> Function::successors(BlockId block) const
+    {
+        if (!terminated(block))
+        {
+            return {};
+        }
+        const auto& last = terminator(block);
+        switch (last.op)
+        {
+            case Op::Jump: return { last.targets.data(), 1 };
+            case Op::Branch: return { last.targets.data(), 2 };
+            default: return {};
+        }
+    }
+
+    namespace {
+        // Slot names, with a suffix on each that shadows an earlier one of the same name
+        std::vector<std::string> slotNames(const Function& function)
+        {
+            std::vector<std::string> names;
+            std::unordered_map<StringInterner::Symbol, uint32_t> seen;
+            for (const auto& slot : function.slots)
+            {
+                const uint32_t count = seen[slot.name]++;
+                std::string name(StringInterner::global().name(slot.name));
+                names.push_back(count == 0 ? name : name + "." + std::to_string(count));
+            }
+            return names;
+        }
+    }
+
+    void print(std::ostream& out, const Function& function)
+    {
+        const auto names = slotNames(function);
+        const auto slot = [&](SlotId id) { return id < names.size() ? "$" + names[id] : std::string("$?"); };
+        const auto reg = [](Value value) { return "%" + std::to_string(value); };
+        const auto block = [](BlockId id) { return "bb" + std::to_string(id); };
+
+        for (BlockId id = 0; id < function.blocks.size(); ++id)
+        {
+            const auto& current = function.blocks[id];
+            if (current.removed)
+            {
+                continue;
+            }
+            out << block(id) << ":";
+            if (!current.predecessors.empty())
+            {
+                out << "  ; preds";
+                for (const BlockId predecessor : current.predecessors)
+                {
+                    out << " " << block(predecessor);
+                }
+            }
+            out << "\n";
+            for (const Value value : current.instructions)
+            {
+                const auto& instruction = function.instructions[value];
+                out << "    ";
+                if (hasResult(instruction.op))
+                {
+                    out << reg(value) << " = ";
+                }
+                out << name(instruction.op);
+                switch (instruction.op)
+                {
+                    case Op::Const: out << " " << instruction.constant; break;
+                    case Op::Load: out << " " << slot(instruction.slot); break;
+                    case Op::Store: out << " " << slot(instruction.slot) << ", " << reg(instruction.lhs); break;
+                    case Op::Phi:
+                        for (size_t i = 0; i < instruction.incoming.size(); ++i)
+                        {
+                            const auto& [predecessor, incoming] = instruction.incoming[i];
+                            out << (i == 0 ? " [" : ", [") << reg(incoming) << ", " << block(predecessor) << "]";
+                        }
+                        break;
+                    case Op::Jump: out << " " << block(instruction.targets[0]); break;
+                    case Op::Branch: out << " " << reg(instruction.lhs) << ", " << block(instruction.targets[0]) << ", " << block(instruction.targets[1]); break;
+                    case Op::Return: out << " " << reg(instruction.lhs); break;
+                    default: out << " " << reg(instruction.lhs) << ", " << reg(instruction.rhs); break;
+                }
+                out << "\n";
+            }
+        }
+    }
+
+    std::string toString(const Function& function)
+    {
+        std::stringstream out;
+        print(out, function);
+        return out.str();
+    }
+
+    std::vector<std::string> verify(const Function& function)
+    {
+        std::vector<std::string> problems;
+        const auto report = [&](const std::string& where, const std::string& what) { problems.push_back(where + ": " + what); };
+        const auto blockName = [](BlockId id) { return "bb" + std::to_string(id); };
+        const auto valueName = [](Value value) { return "%" + std::to_string(value); };
+        const auto liveBlock = [&](BlockId id) { return id < function.blocks.size() && !function.blocks[id].removed; };
+
+        if (!liveBlock(function.entry))
+        {
+            report("function", "has no entry block");
+            return problems;
+        }
+        if (!function.blocks[function.entry].predecessors.empty())
+        {
+            report(blockName(function.entry), "is the entry but has predecessors");
+        }
+
+        // Structure of each block, and where each instruction sits in it
+        std::vector<uint32_t> position(function.instructions.size(), None);
+        std::vector<std::vector<BlockId>> expectedPredecessors(function.blocks.size());
+        bool structured = true;
+        for (BlockId id = 0; id < function.blocks.size(); ++id)
+        {
+            const auto& block = function.blocks[id];
+            if (block.removed)
+            {
+                continue;
+            }
+            if (block.instructions.empty() || !isTerminator(function.instructions[block.instructions.back()].op))
+            {
+                report(blockName(id), "does not end in a terminator");
+                structured = false;
+                continue;
+            }
+            bool pastPhis = false;
+            for (uint32_t i = 0; i < block.instructions.size(); ++i)
+            {
+                const Value value = block.instructions[i];
+                const auto where = blockName(id) + " " + valueName(value);
+                if (value >= function.instructions.size() || function.instructions[value].block != id || position[value] != None)
+                {
+                    report(where, "is not held by this block alone");
+                    structured = false;
+                    continue;
+                }
+                position[value] = i;
+                const auto& instruction = function.instructions[value];
+                if (isTerminator(instruction.op) && i + 1 != block.instructions.size())
+                {
+                    report(where, "is a terminator in the middle of the block");
+                }
+                if (instruction.op == Op::Phi && pastPhis)
+                {
+                    report(where, "is a phi after other instructions");
+                }
+                pastPhis = pastPhis || instruction.op != Op::Phi;
+            }
+            for (const BlockId successor : function.successors(id))
+            {
+                if (!liveBlock(successor))
+                {
+                    report(blockName(id), "branches to a missing block");
+                    structured = false;
+                    continue;
+                }
+                expectedPredecessors[successor].push_back(id);
+            }
+        }
+        if (!structured)
+        {
+            return problems;
+        }
+
+        for (BlockId id = 0; id < function.blocks.size(); ++id)
+        {
+            if (function.blocks[id].removed)
+            {
+                continue;
+            }
+            auto predecessors = function.blocks[id].predecessors;
+            std::sort(predecessors.begin(), predecessors.end());
+            std::sort(expectedPredecessors[id].begin(), expectedPredecessors[id].end());
+            if (predecessors != expectedPredecessors[id])
+            {
+                report(blockName(id), "has predecessors that don't match the edges into it");
+            }
+        }
+
+        // Operands, and that each definition dominates its uses
+        const DominatorTree dominators(function);
+        const auto defined = [&](Value value) {
+            return value < function.instructions.size() && function.instructions[value].block != None
+                && hasResult(function.instructions[value].op);
+        };
+        const auto dominatesUse = [&](Value def, BlockId block, uint32_t at) {
+            const BlockId defBlock = function.instructions[def].block;
+            return defBlock == block ? position[def] < at : dominators.dominates(defBlock, block);
+        };
+        for (BlockId id = 0; id < function.blocks.size(); ++id)
+        {
+            const auto& block = function.blocks[id];
+            if (block.removed)
+            {
+                continue;
+            }
+            for (uint32_t i = 0; i < block.instructions.size(); ++i)
+            {
+                const Value value = block.instructions[i];
+                const auto& instruction = function.instructions[value];
+                const auto where = blockName(id) + " " + valueName(value);
+                const auto checkOperand = [&](Value operand) {
+                    if (!defined(operand))
+                    {
+                        report(where, "uses " + valueName(operand) + ", which is not defined");
+                    }
+                    else if (dominators.reachable(id) && !dominatesUse(operand, id, i))
+                    {
+                        report(where, "uses " + valueName(operand) + " where its definition doesn't dominate");
+                    }
+                };
+                switch (instruction.op)
+                {
+                    case Op::Const:
+                    case Op::Jump:
+                        break;
+                    case Op::Load:
+                        if (instruction.slot >= function.slots.size())
+                        {
+                            report(where, "loads a missing slot");
+                        }
+                        break;
+                    case Op::Store:
+                        if (instruction.slot >= function.slots.size())
+                        {
+                            report(where, "stores to a missing slot");
+                        }
+                        checkOperand(instruction.lhs);
+                        break;
+                    case Op::Branch:
+                    case Op::Return:
+                        checkOperand(instruction.lhs);
+                        break;
+                    case Op::Phi:
+                    {
+                        std::vector<BlockId> incoming;
+                        for (const auto& [predecessor, operand] : instruction.incoming)
+                        {
+                            incoming.push_back(predecessor);
+                            if (!defined(operand))
+                            {
+                                report(where, "takes " + valueName(operand) + ", which is not defined");
+                            }
+                            else if (dominators.reachable(predecessor)
+                                && !dominatesUse(operand, predecessor, static_cast<uint32_t>(function.blocks[predecessor].instructions.size())))
+                            {
+                                report(where, "takes " + valueName(operand) + " from " + blockName(predecessor) + ", which it doesn't dominate");
+                            }
+                        }
+                        // One register per predecessor, however many edges it has here
+                        auto expected = expectedPredecessors[id];
+                        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+                        std::sort(incoming.begin(), incoming.end());
+                        if (incoming != expected)
+                        {
+                            report(where, "doesn't have one register for each predecessor");
+                        }
+                        break;
+                    }
+                    default:
+                        checkOperand(instruction.lhs);
+                        checkOperand(instruction.rhs);
+                        break;
+                }
+            }
+        }
+        return problems;
+    }
+
+    std::optional<int64_t> run(const Function& function, uint64_t maxSteps)
+    {
+        std::vector<int64_t> registers(function.instructions.size(), 0);
+        std::vector<int64_t> slots(function.slots.size(), 0);
+        std::vector<int64_t> incoming;
+        BlockId previous = None;
+        BlockId block = function.entry;
+        for (uint64_t steps = 0; steps < maxSteps;)
+        {
+            const auto& list = function.blocks[block].instructions;
+            // The phis all read their registers as they were on the way in, then take them
+            size_t i = 0;
+            incoming.clear();
+            for (; i < list.size() && function.instructions[list[i]].op == Op::Phi; ++i)
+            {
+                for (const auto& [predecessor, value] : function.instructions[list[i]].incoming)
+                {
+                    if (predecessor == previous)
+                    {
+                        incoming.push_back(registers[value]);
+                        break;
+                    }
+                }
+            }
+            for (size_t phi = 0; phi < incoming.size(); ++phi)
+            {
+                registers[list[phi]] = incoming[phi];
+            }
+            for (; i < list.size(); ++i, ++steps)
+            {
+                const auto& instruction = function.instructions[list[i]];
+                int64_t& result = registers[list[i]];
+                switch (instruction.op)
+                {
+                    case Op::Const: result = instruction.constant; break;
+                    case Op::Load: result = slots[instruction.slot]; break;
+                    case Op::Store: slots[instruction.slot] = registers[instruction.lhs]; break;
+                    case Op::Phi: break;
+                    case Op::Jump:
+                        previous = block;
+                        block = instruction.targets[0];
+                        break;
+                    case Op::Branch:
+                        previous = block;
+                        block = instruction.targets[registers[instruction.lhs] != 0 ? 0 : 1];
+                        break;
+                    case Op::Return:
+                        return registers[instruction.lhs];
+                    default:
+                    {
+                        const auto value = evaluate(instruction.op, registers[instruction.lhs], registers[instruction.rhs]);
+                        if (!value)
+                        {
+                            return {};
+                        }
+                        result = value.value();
+                        break;
+                    }
+                }
+            }
+        }
+        return {};
+    }
+}
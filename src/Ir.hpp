@@ -0,0 +1,159 @@
+#pragma once
+
+#include <StringInterner.hpp>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The mid-level IR, between the syntax tree and the asm. A function is a graph of basic blocks,
+// each a list of instructions ending in exactly one terminator, whose targets are the edges of the
+// graph. Every instruction that produces a result defines a virtual register assigned nowhere
+// else, so registers are in SSA form, and where control flow merges a phi picks a register by the
+// edge that was taken.
+//
+// Variables are lowered to slots, read by load and written by store, so lowering needs no SSA
+// construction of its own.
+namespace Ir {
+    // A virtual register is the index of the instruction that defines it in Function::instructions
+    using Value = uint32_t;
+    using BlockId = uint32_t;
+    using SlotId = uint32_t;
+    inline constexpr uint32_t None = UINT32_MAX;
+
+    enum class Op : uint8_t
+    {
+        // constant
+        Const,
+        // Reads slot
+        Load,
+        // lhs op rhs on 64-bit integers. Arithmetic wraps, and division is signed.
+        Add,
+        Sub,
+        Mul,
+        Div,
+        // 1 if the signed comparison of lhs with rhs holds, else 0
+        Lt,
+        Gt,
+        Le,
+        Ge,
+        Eq,
+        Ne,
+        // The register of incoming for the edge control arrived by
+        Phi,
+        // Writes lhs to slot, with no result
+        Store,
+        // Terminators. Jump goes to targets[0]; Branch to targets[0] if lhs is non-zero, else
+        // targets[1]; Return exits the program with lhs.
+        Jump,
+        Branch,
+        Return
+    };
+
+    [[nodiscard]] constexpr bool isTerminator(Op op)
+    {
+        return op == Op::Jump || op == Op::Branch || op == Op::Return;
+    }
+    [[nodiscard]] constexpr bool isBinary(Op op)
+    {
+        return op >= Op::Add && op <= Op::Ne;
+    }
+    [[nodiscard]] constexpr bool hasResult(Op op)
+    {
+        return op <= Op::Phi;
+    }
+    [[nodiscard]] const char* name(Op op);
+
+    // lhs op rhs for a binary op, or nothing where the machine would trap: division by zero and
+    // the one division that overflows
+    [[nodiscard]] std::optional<int64_t> evaluate(Op op, int64_t lhs, int64_t rhs);
+
+    struct Instruction
+    {
+        Op op;
+        // The block holding it, or None once it has been removed
+        BlockId block = None;
+        Value lhs = None;
+        Value rhs = None;
+        SlotId slot = None;
+        std::array<BlockId, 2> targets = { None, None };
+        int64_t constant = 0;
+        // For a phi, the predecessor and register of each incoming edge
+        std::vector<std::pair<BlockId, Value>> incoming = {};
+    };
+
+    struct Block
+    {
+        // In order, any phis first and the terminator last
+        std::vector<Value> instructions;
+        // Every block whose terminator targets this one, once per edge
+        std::vector<BlockId> predecessors;
+        // Removed blocks keep their number but are out of the graph
+        bool removed = false;
+    };
+
+    // A variable. Its name is only for printing.
+    struct Slot
+    {
+        StringInterner::Symbol name;
+    };
+
+    struct Function
+    {
+        std::vector<Instruction> instructions;
+        std::vector<Block> blocks;
+        std::vector<Slot> slots;
+        BlockId entry = 0;
+
+        BlockId addBlock();
+        // Appends instruction to block, linking the edges of a terminator. Returns its register.
+        Value append(BlockId block, Instruction instruction);
+        // Takes value out of its block. Its register is not reused.
+        void remove(Value value);
+        // Points every use of from, in any live instruction, at to instead
+        void replaceAllUses(Value from, Value to);
+        // Replaces the terminator of block, relinking its edges. Phis keep their incoming register
+        // from block wherever it's still a predecessor, and drop it everywhere else.
+        void replaceTerminator(BlockId block, Instruction terminator);
+        // Takes block and everything in it out of the graph
+        void removeBlock(BlockId block);
+        // Removes every block not reachable from the entry. Returns whether there were any.
+        bool removeUnreachableBlocks();
+        // Points every operand of every live instruction at its replacement, following chains of
+        // them, where replacements[operand] isn't None
+        void replaceUses(const std::vector<Value>& replacements);
+        // Number of instructions still held by a block
+        [[nodiscard]] size_t liveInstructionCount() const;
+        // How many operands of live instructions refer to each register
+        [[nodiscard]] std::vector<uint32_t> useCounts() const;
+        // Whether instruction does anything beyond producing its result. A division does if its
+        // divisor could make it trap.
+        [[nodiscard]] bool hasSideEffects(const Instruction& instruction) const;
+        // Removes every instruction whose result is unused and that has no side effects, along
+        // with any operands that leaves unused. Returns whether there were any.
+        bool removeDeadInstructions();
+
+        [[nodiscard]] bool terminated(BlockId block) const;
+        // The terminator of a terminated block
+        [[nodiscard]] const Instruction& terminator(BlockId block) const;
+        [[nodiscard]] std::span<const BlockId> successors(BlockId block) const;
+    };
+
+    // Writes the function out as text, one instruction a line
+    void print(std::ostream& out, const Function& function);
+    [[nodiscard]] std::string toString(const Function& function);
+
+    // Checks the function is well formed: every block ends in one terminator, edges and
+    // predecessors agree, phis have one register per predecessor, and every register is defined
+    // before each use on every path to it. Returns a description of each problem found.
+    [[nodiscard]] std::vector<std::string> verify(const Function& function);
+
+    // Runs the function, returning the value it exits with, or nothing if it traps or hasn't
+    // finished within maxSteps instructions
+    [[nodiscard]] std::optional<int64_t> run(const Function& function, uint64_t maxSteps);
+}
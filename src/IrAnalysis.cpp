@@ -0,0 +1,220 @@
+#include "IrAnalysis.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace Ir {
+    std::vector<BlockId> reversePostOrder(const Function& function)
+    {
+        std::vector<BlockId> order;
+        std::vector<bool> visited(function.blocks.size(), false);
+        // Each entry is a block and how many of its successors have been pushed
+        std::vector<std::pair<BlockId, uint32_t>> stack;
+        stack.emplace_back(function.entry, 0);
+        visited[function.entry] = true;
+        while (!stack.empty())
+        {
+            auto& [block, next] = stack.back();
+            const auto successors = function.successors(block);
+            if (next < successors.size())
+            {
+                // Last first, so the first successor comes straight after its block in the order
+                const BlockId successor = successors[successors.size() - 1 - next++];
+                if (!visited[successor])
+                {
+                    visited[successor] = true;
+                    stack.emplace_back(successor, 0);
+                }
+                continue;
+            }
+            order.push_back(block);
+            stack.pop_back();
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    DominatorTree::DominatorTree(const Function& function) :
+        m_order(reversePostOrder(function)),
+        m_idom(function.blocks.size(), None),
+        m_children(function.blocks.size()),
+        m_enter(function.blocks.size(), 0),
+        m_exit(function.blocks.size(), 0)
+    {
+        std::vector<uint32_t> position(function.blocks.size(), None);
+        for (uint32_t i = 0; i < m_order.size(); ++i)
+        {
+            position[m_order[i]] = i;
+        }
+        const auto intersect = [&](BlockId a, BlockId b) {
+            while (a != b)
+            {
+                while (position[a] > position[b])
+                {
+                    a = m_idom[a];
+                }
+                while (position[b] > position[a])
+                {
+                    b = m_idom[b];
+                }
+            }
+            return a;
+        };
+
+        m_idom[function.entry] = function.entry;
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const BlockId block : m_order)
+            {
+                if (block == function.entry)
+                {
+                    continue;
+                }
+                BlockId idom = None;
+                for (const BlockId predecessor : function.blocks[block].predecessors)
+                {
+                    if (m_idom[predecessor] == None)
+                    {
+                        continue;
+                    }
+                    idom = idom == None ? predecessor : intersect(predecessor, idom);
+                }
+                if (idom != m_idom[block])
+                {
+                    m_idom[block] = idom;
+                    changed = true;
+                }
+            }
+        }
+
+        for (const BlockId block : m_order)
+        {
+            if (block != function.entry)
+            {
+                m_children[m_idom[block]].push_back(block);
+            }
+        }
+        uint32_t clock = 0;
+        std::vector<std::pair<BlockId, uint32_t>> stack;
+        stack.emplace_back(function.entry, 0);
+        m_enter[function.entry] = clock++;
+        while (!stack.empty())
+        {
+            auto& [block, next] = stack.back();
+            if (next < m_children[block].size())
+            {
+                const BlockId child = m_children[block][next++];
+                m_enter[child] = clock++;
+                stack.emplace_back(child, 0);
+                continue;
+            }
+            m_exit[block] = clock++;
+            stack.pop_back();
+        }
+    }
+
+    bool DominatorTree::dominates(BlockId a, BlockId b) const
+    {
+        return reachable(a) && reachable(b) && m_enter[a] <= m_enter[b] && m_exit[b] <= m_exit[a];
+    }
+
+    std::vector<std::vector<BlockId>> dominanceFrontiers(const Function& function, const DominatorTree& dominators)
+    {
+        // Walks up from each predecessor of a join to the join's immediate dominator, as in Cooper,
+        // Harvey and Kennedy
+        std::vector<std::vector<BlockId>> frontiers(function.blocks.size());
+        for (const BlockId block : dominators.order())
+        {
+            const auto& predecessors = function.blocks[block].predecessors;
+            if (predecessors.size() < 2)
+            {
+                continue;
+            }
+            for (const BlockId predecessor : predecessors)
+            {
+                if (!dominators.reachable(predecessor))
+                {
+                    continue;
+                }
+                for (BlockId runner = predecessor; runner != dominators.idom(block); runner = dominators.idom(runner))
+                {
+                    auto& frontier = frontiers[runner];
+                    if (frontier.empty() || frontier.back() != block)
+                    {
+                        frontier.push_back(block);
+                    }
+                }
+            }
+        }
+        return frontiers;
+    }
+
+    SlotLiveness::SlotLiveness(const Function& function) :
+        m_function(function),
+        m_liveIn(function.blocks.size())
+    {
+        // Per variable, the blocks that store to it and those that load it before any store
+        std::vector<std::vector<BlockId>> storedIn(function.slots.size());
+        std::vector<std::vector<BlockId>> loadedIn(function.slots.size());
+        std::vector<BlockId> seenIn(function.slots.size(), None);
+        for (BlockId block = 0; block < function.blocks.size(); ++block)
+        {
+            for (const auto value : function.blocks[block].instructions)
+            {
+                const auto& instruction = function.instructions[value];
+                if ((instruction.op != Op::Load && instruction.op != Op::Store) || seenIn[instruction.slot] == block)
+                {
+                    continue;
+                }
+                // Only the first access to each variable in a block matters here
+                seenIn[instruction.slot] = block;
+                (instruction.op == Op::Load ? loadedIn : storedIn)[instruction.slot].push_back(block);
+            }
+        }
+
+        // Walk back from each load to the stores that reach it. Variables are taken in order, so
+        // each block's list comes out sorted.
+        std::vector<SlotId> stores(function.blocks.size(), None);
+        std::vector<SlotId> live(function.blocks.size(), None);
+        std::vector<BlockId> worklist;
+        for (SlotId slot = 0; slot < function.slots.size(); ++slot)
+        {
+            for (const auto block : storedIn[slot])
+            {
+                stores[block] = slot;
+            }
+            worklist = loadedIn[slot];
+            while (!worklist.empty())
+            {
+                const auto block = worklist.back();
+                worklist.pop_back();
+                if (live[block] == slot)
+                {
+                    continue;
+                }
+                live[block] = slot;
+                m_liveIn[block].push_back(slot);
+                for (const auto predecessor : function.blocks[block].predecessors)
+                {
+                    if (live[predecessor] != slot && stores[predecessor] != slot)
+                    {
+                        worklist.push_back(predecessor);
+                    }
+                }
+            }
+        }
+    }
+
+    bool SlotLiveness::liveIn(BlockId block, SlotId slot) const
+    {
+        return std::binary_search(m_liveIn[block].begin(), m_liveIn[block].end(), slot);
+    }
+
+    bool SlotLiveness::liveOut(BlockId block, SlotId slot) const
+    {
+        const auto successors = m_function.successors(block);
+        return std::any_of(successors.begin(), successors.end(), [&](BlockId successor) { return liveIn(successor, slot); });
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Ir.hpp"
+
+#include <vector>
+
+namespace Ir {
+    // Every block reachable from the entry, each before its successors except along back edges
+    [[nodiscard]] std::vector<BlockId> reversePostOrder(const Function& function);
+
+    // Immediate dominators of the reachable blocks, found by the iterative algorithm of Cooper,
+    // Harvey and Kennedy. Blocks not reachable from the entry are dominated by nothing.
+    class DominatorTree
+    {
+    public:
+        explicit DominatorTree(const Function& function);
+
+        [[nodiscard]] bool reachable(BlockId block) const { return block < m_idom.size() && m_idom[block] != None; }
+        // The entry is its own immediate dominator
+        [[nodiscard]] BlockId idom(BlockId block) const { return m_idom[block]; }
+        // Whether every path from the entry to b goes through a. A block dominates itself.
+        [[nodiscard]] bool dominates(BlockId a, BlockId b) const;
+        [[nodiscard]] const std::vector<BlockId>& children(BlockId block) const { return m_children[block]; }
+        // Reachable blocks in reverse postorder
+        [[nodiscard]] const std::vector<BlockId>& order() const { return m_order; }
+
+    private:
+        std::vector<BlockId> m_order;
+        std::vector<BlockId> m_idom;
+        std::vector<std::vector<BlockId>> m_children;
+        // Interval of each block in a preorder walk of the tree, so dominance is two comparisons
+        std::vector<uint32_t> m_enter;
+        std::vector<uint32_t> m_exit;
+    };
+
+    // The dominance frontier of each block: the blocks where its dominance ends, as they have a
+    // predecessor it dominates but aren't strictly dominated by it themselves
+    [[nodiscard]] std::vector<std::vector<BlockId>> dominanceFrontiers(const Function& function, const DominatorTree& dominators);
+
+    // Which variables are live on the way into and out of each block: those some path from there
+    // loads before storing to them again. Each variable is followed back from its loads alone, so
+    // this costs what's live rather than every variable in every block.
+    class SlotLiveness
+    {
+    public:
+        explicit SlotLiveness(const Function& function);
+
+        [[nodiscard]] bool liveIn(BlockId block, SlotId slot) const;
+        [[nodiscard]] bool liveOut(BlockId block, SlotId slot) const;
+
+    private:
+        const Function& m_function;
+        // The variables live into each block, in order
+        std::vector<std::vector<SlotId>> m_liveIn;
+    };
+}
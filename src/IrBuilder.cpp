@@ -0,0 +1,297 @@
+#include "IrBuilder.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ranges>
+#include <sstream>
+
+IrBuilder::IrBuilder(Node::TreeView tree, ErrorHandler& errorHandler) : m_tree(tree), m_errorHandler(errorHandler)
+{
+}
+
+Ir::Op IrBuilder::binaryOp(Node::ExprKind kind)
+{
+    switch (kind)
+    {
+        case Node::ExprKind::Add: return Ir::Op::Add;
+        case Node::ExprKind::Multiply: return Ir::Op::Mul;
+        case Node::ExprKind::Minus: return Ir::Op::Sub;
+        case Node::ExprKind::Divide: return Ir::Op::Div;
+        case Node::ExprKind::LessThan: return Ir::Op::Lt;
+        case Node::ExprKind::GreaterThan: return Ir::Op::Gt;
+        case Node::ExprKind::LessThanEqual: return Ir::Op::Le;
+        case Node::ExprKind::GreaterThanEqual: return Ir::Op::Ge;
+        case Node::ExprKind::Equal: return Ir::Op::Eq;
+        case Node::ExprKind::NotEqual: return Ir::Op::Ne;
+        case Node::ExprKind::IntLiteral:
+        case Node::ExprKind::Identifier:
+            break;
+    }
+    assert(false && "Leaves are not operators");
+    return Ir::Op::Add;
+}
+
+Ir::Function IrBuilder::build(Node::Range statements)
+{
+    m_function = {};
+    m_block = m_function.addBlock();
+    m_function.entry = m_block;
+    for (const auto statement : m_tree.list(statements))
+    {
+        m_steps.push_back(statement);
+        while (!m_steps.empty())
+        {
+            auto step = m_steps.back();
+            m_steps.pop_back();
+            if (const auto* stmt = std::get_if<Node::Stmt>(&step))
+            {
+                lowerStatement(*stmt);
+            }
+            else if (const auto* scope = std::get_if<const Node::Scope*>(&step))
+            {
+                m_scopes.push_back(m_variables.size());
+                m_steps.emplace_back(EndScopeStep{});
+                // Scheduled last first so they're lowered in order
+                for (const auto stmt : m_tree.list((*scope)->statements) | std::views::reverse)
+                {
+                    m_steps.emplace_back(stmt);
+                }
+            }
+            else if (std::holds_alternative<EndScopeStep>(step))
+            {
+                endScope();
+            }
+            else if (const auto* jump = std::get_if<JumpStep>(&step))
+            {
+                emit({ .op = Ir::Op::Jump, .targets = { jump->target, Ir::None } });
+                m_block = jump->next;
+            }
+            else if (const auto* test = std::get_if<LoopTestStep>(&step))
+            {
+                if (test->lowered)
+                {
+                    emit({ .op = Ir::Op::Branch, .lhs = lowerExpr(test->expr), .targets = { test->body, test->exit } });
+                }
+                else
+                {
+                    emit({ .op = Ir::Op::Jump, .targets = { test->exit, Ir::None } });
+                }
+                m_block = test->exit;
+            }
+            else
+            {
+                const auto& elseStep = std::get<ElseStep>(step);
+                const auto& branch = m_tree.ifs[elseStep.branch];
+                if (branch.expr == Node::None)
+                {
+                    m_steps.emplace_back(JumpStep{ elseStep.end, elseStep.end });
+                    scheduleScope(branch.scope);
+                }
+                else
+                {
+                    lowerBranch(branch, elseStep.end);
+                }
+            }
+        }
+    }
+
+    // Code after a return is left in a block nothing jumps to, which is dropped if it's empty
+    auto& last = m_function.blocks[m_block];
+    if (m_block != m_function.entry && last.instructions.empty() && last.predecessors.empty())
+    {
+        last.removed = true;
+    }
+    else if (!m_function.terminated(m_block))
+    {
+        emit({ .op = Ir::Op::Return, .lhs = emit({ .op = Ir::Op::Const, .constant = 0 }) });
+    }
+    m_variables.clear();
+    m_variableBySymbol.clear();
+    m_scopes.clear();
+    return std::move(m_function);
+}
+
+void IrBuilder::lowerStatement(Node::Stmt statement)
+{
+    switch (statement.kind)
+    {
+        case Node::StmtKind::Return:
+        {
+            emit({ .op = Ir::Op::Return, .lhs = lowerExpr(m_tree.returns[statement.index].returnExpr) });
+            // Anything after the return is unreachable, but still lowered so its errors are found
+            m_block = m_function.addBlock();
+            break;
+        }
+        case Node::StmtKind::Let:
+        {
+            const auto& let = m_tree.lets[statement.index];
+            const Token& identifier = m_tree.tokens[let.identifier];
+            // Only a variable declared in this scope clashes; outer ones are shadowed
+            const Variable* existing = findVariable(identifier.symbol());
+            const size_t scopeBegin = m_scopes.empty() ? 0 : m_scopes.back();
+            if (existing != nullptr && static_cast<size_t>(existing - m_variables.data()) >= scopeBegin)
+            {
+                std::stringstream errorSs;
+                errorSs << "Identifier " << identifier.value().value() << " already used.";
+                m_errorHandler << makeError(identifier.info(), errorSs.str());
+                break;
+            }
+            const auto value = lowerExpr(let.letExpr);
+            // Declared afterwards so the expression still sees any outer variable of the same name
+            declareVariable(identifier.symbol());
+            emit({ .op = Ir::Op::Store, .lhs = value, .slot = m_variables.back().slot });
+            break;
+        }
+        case Node::StmtKind::Assign:
+        {
+            const auto& assign = m_tree.assigns[statement.index];
+            const Token& identifier = m_tree.tokens[assign.identifier];
+            const Variable* variable = findVariable(identifier.symbol());
+            if (variable == nullptr)
+            {
+                std::stringstream errorSs;
+                errorSs << "Undeclared identifier " << identifier.value().value() << ".";
+                m_errorHandler << makeError(identifier.info(), errorSs.str());
+                break;
+            }
+            const auto slot = variable->slot;
+            emit({ .op = Ir::Op::Store, .lhs = lowerExpr(assign.assignExpr), .slot = slot });
+            break;
+        }
+        case Node::StmtKind::Scope:
+            m_steps.emplace_back(&m_tree.scopes[statement.index]);
+            break;
+        case Node::StmtKind::If:
+            lowerBranch(m_tree.ifs[statement.index], m_function.addBlock());
+            break;
+        case Node::StmtKind::While:
+        {
+            // Rotated, so each time round takes one branch at the bottom. The first test is made
+            // before the loop, and a true one goes through a preheader, which is somewhere to put
+            // what the loop computes the same each time round.
+            const auto& loop = m_tree.whiles[statement.index];
+            const auto preheader = m_function.addBlock();
+            const auto body = m_function.addBlock();
+            const auto exit = m_function.addBlock();
+            const auto errorCount = m_errorHandler.errorCount();
+            emit({ .op = Ir::Op::Branch, .lhs = lowerExpr(loop.expr), .targets = { preheader, exit } });
+            m_block = preheader;
+            emit({ .op = Ir::Op::Jump, .targets = { body, Ir::None } });
+            m_block = body;
+            m_steps.emplace_back(LoopTestStep{ loop.expr, body, exit, m_errorHandler.errorCount() == errorCount });
+            scheduleScope(loop.scope);
+            break;
+        }
+    }
+}
+
+void IrBuilder::lowerBranch(const Node::Statement::If& branch, Ir::BlockId end)
+{
+    const auto condition = lowerExpr(branch.expr);
+    const auto then = m_function.addBlock();
+    // Without a further branch a false condition goes straight to the end
+    const auto next = branch.next != Node::None ? m_function.addBlock() : end;
+    emit({ .op = Ir::Op::Branch, .lhs = condition, .targets = { then, next } });
+    m_block = then;
+    if (branch.next != Node::None)
+    {
+        m_steps.emplace_back(ElseStep{ branch.next, end });
+    }
+    m_steps.emplace_back(JumpStep{ end, next });
+    scheduleScope(branch.scope);
+}
+
+Ir::Value IrBuilder::lowerExpr(Node::Index expr)
+{
+    const size_t stepBase = m_exprSteps.size();
+    const size_t valueBase = m_exprValues.size();
+    m_exprSteps.push_back({ .expr = expr });
+    while (m_exprSteps.size() > stepBase)
+    {
+        const auto step = m_exprSteps.back();
+        m_exprSteps.pop_back();
+        const auto& node = m_tree.exprs[step.expr];
+        if (node.kind == Node::ExprKind::IntLiteral)
+        {
+            m_exprValues.push_back(emit({ .op = Ir::Op::Const, .constant = node.intValue() }));
+        }
+        else if (node.kind == Node::ExprKind::Identifier)
+        {
+            const Token& token = m_tree.tokens[node.lhs];
+            const Variable* variable = findVariable(token.symbol());
+            if (variable == nullptr)
+            {
+                std::stringstream errorSs;
+                errorSs << "Undeclared variable " << token.value().value();
+                m_errorHandler << makeError(token.info(), errorSs.str());
+                // Lowering carries on as if it were 0, to find any further errors
+                m_exprValues.push_back(emit({ .op = Ir::Op::Const, .constant = 0 }));
+            }
+            else
+            {
+                m_exprValues.push_back(emit({ .op = Ir::Op::Load, .slot = variable->slot }));
+            }
+        }
+        else if (step.operandsLowered)
+        {
+            const auto rhs = m_exprValues.back();
+            m_exprValues.pop_back();
+            const auto lhs = m_exprValues.back();
+            m_exprValues.back() = emit({ .op = binaryOp(node.kind), .lhs = lhs, .rhs = rhs });
+        }
+        else
+        {
+            // The lhs is scheduled last so it's lowered first
+            m_exprSteps.push_back({ .expr = step.expr, .operandsLowered = true });
+            m_exprSteps.push_back({ .expr = node.rhs });
+            m_exprSteps.push_back({ .expr = node.lhs });
+        }
+    }
+    const auto value = m_exprValues.back();
+    m_exprValues.resize(valueBase);
+    return value;
+}
+
+void IrBuilder::scheduleScope(Node::Index scope)
+{
+    if (scope != Node::None)
+    {
+        m_steps.emplace_back(&m_tree.scopes[scope]);
+    }
+}
+
+Ir::Value IrBuilder::emit(Ir::Instruction instruction)
+{
+    return m_function.append(m_block, std::move(instruction));
+}
+
+const IrBuilder::Variable* IrBuilder::findVariable(StringInterner::Symbol name) const
+{
+    if (name >= m_variableBySymbol.size() || m_variableBySymbol[name] == 0)
+    {
+        return nullptr;
+    }
+    return &m_variables[m_variableBySymbol[name] - 1];
+}
+
+void IrBuilder::declareVariable(StringInterner::Symbol name)
+{
+    if (name >= m_variableBySymbol.size())
+    {
+        m_variableBySymbol.resize(std::max<size_t>(name + 1, StringInterner::global().size()), 0);
+    }
+    const auto slot = static_cast<Ir::SlotId>(m_function.slots.size());
+    m_function.slots.push_back({ .name = name });
+    m_variables.push_back({ .name = name, .slot = slot, .shadows = m_variableBySymbol[name] });
+    m_variableBySymbol[name] = static_cast<uint32_t>(m_variables.size());
+}
+
+void IrBuilder::endScope()
+{
+    while (m_variables.size() > m_scopes.back())
+    {
+        m_variableBySymbol[m_variables.back().name] = m_variables.back().shadows;
+        m_variables.pop_back();
+    }
+    m_scopes.pop_back();
+}
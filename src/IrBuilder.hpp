@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Ir.hpp"
+#include "Nodes.hpp"
+
+#include <CompilerError.hpp>
+
+#include <variant>
+#include <vector>
+
+// Lowers a program from the syntax tree to the IR, one block per straight run of code. Nested
+// scopes and expressions are scheduled on explicit stacks like the generator does, so nesting
+// depth is bounded by the heap. Variables that are undeclared or declared twice in a scope are
+// reported as the generator reports them.
+class IrBuilder
+{
+public:
+    IrBuilder(Node::TreeView tree, ErrorHandler& errorHandler);
+
+    // A program that runs off its end exits with 0
+    [[nodiscard]] Ir::Function build(Node::Range statements);
+    // The op a binary node lowers to
+    [[nodiscard]] static Ir::Op binaryOp(Node::ExprKind kind);
+
+private:
+    struct EndScopeStep {};
+    // Ends the current block with a jump to target, then carries on in next
+    struct JumpStep
+    {
+        Ir::BlockId target;
+        Ir::BlockId next;
+    };
+    // Lowers the else if or else branch into the current block, for a chain that ends in end
+    struct ElseStep
+    {
+        Node::Index branch;
+        Ir::BlockId end;
+    };
+    // Ends the body of a loop with its test, branching back to the top of the body while it holds,
+    // then carries on in exit. The test is left out where lowering it the first time failed, so
+    // its errors are reported once.
+    struct LoopTestStep
+    {
+        Node::Index expr;
+        Ir::BlockId body;
+        Ir::BlockId exit;
+        bool lowered;
+    };
+    using Step = std::variant<Node::Stmt, const Node::Scope*, EndScopeStep, JumpStep, ElseStep, LoopTestStep>;
+
+    struct ExprStep
+    {
+        Node::Index expr;
+        bool operandsLowered = false;
+    };
+
+    struct Variable
+    {
+        StringInterner::Symbol name;
+        Ir::SlotId slot;
+        // Index + 1 of the outer variable with the same name that this one hides, or 0
+        uint32_t shadows = 0;
+    };
+
+    void lowerStatement(Node::Stmt statement);
+    // Branches on the condition of an if or else if, scheduling its scope and whatever follows
+    void lowerBranch(const Node::Statement::If& branch, Ir::BlockId end);
+    Ir::Value lowerExpr(Node::Index expr);
+    void scheduleScope(Node::Index scope);
+    Ir::Value emit(Ir::Instruction instruction);
+
+    [[nodiscard]] const Variable* findVariable(StringInterner::Symbol name) const;
+    void declareVariable(StringInterner::Symbol name);
+    void endScope();
+
+    Node::TreeView m_tree;
+    Ir::Function m_function;
+    // Where instructions are appended
+    Ir::BlockId m_block = 0;
+    std::vector<Step> m_steps;
+    std::vector<ExprStep> m_exprSteps;
+    std::vector<Ir::Value> m_exprValues;
+    std::vector<Variable> m_variables;
+    // Index + 1 into m_variables of the innermost variable for each symbol, or 0
+    std::vector<uint32_t> m_variableBySymbol;
+    // Size of m_variables when each open scope began
+    std::vector<size_t> m_scopes;
+    ErrorHandler& m_errorHandler;
+};
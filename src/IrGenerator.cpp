@@ -0,0 +1,423 @@
+#include "IrGenerator.hpp"
+#include "IrAnalysis.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+IrGenerator::IrGenerator(const Ir::Function& function) : m_function(function)
+{
+}
+
+std::string IrGenerator::generateProgram()
+{
+    const auto order = Ir::reversePostOrder(m_function);
+    // Only variables still loaded or stored get a stack slot
+    m_slotIndex.assign(m_function.slots.size(), Ir::None);
+    uint32_t frameSize = 0;
+    for (const auto block : order)
+    {
+        for (const auto value : m_function.blocks[block].instructions)
+        {
+            const auto& instruction = m_function.instructions[value];
+            if (instruction.slot != Ir::None && m_slotIndex[instruction.slot] == Ir::None)
+            {
+                m_slotIndex[instruction.slot] = frameSize++;
+            }
+        }
+    }
+    allocateRegisters(order, frameSize);
+
+    m_outputStream << "global _start\n\n_start:\n";
+    if (frameSize > 0)
+    {
+        m_outputStream << "\tmov rbp, rsp\n";
+        m_outputStream << "\tsub rsp, " << frameSize * 8 << "\n";
+    }
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const auto next = i + 1 < order.size() ? order[i + 1] : Ir::None;
+        m_outputStream << label(order[i]) << ":\n";
+        for (const auto value : m_function.blocks[order[i]].instructions)
+        {
+            generateInstruction(value, next);
+        }
+    }
+    return m_outputStream.str();
+}
+
+void IrGenerator::allocateRegisters(const std::vector<Ir::BlockId>& order, uint32_t& frameSize)
+{
+    // Number every instruction in the order it's laid out
+    std::vector<uint32_t> position(m_function.instructions.size(), 0);
+    std::vector<uint32_t> blockStart(m_function.blocks.size(), 0);
+    std::vector<uint32_t> blockEnd(m_function.blocks.size(), 0);
+    uint32_t next = 0;
+    for (const auto block : order)
+    {
+        blockStart[block] = next;
+        for (const auto value : m_function.blocks[block].instructions)
+        {
+            position[value] = next++;
+        }
+        blockEnd[block] = next - 1;
+    }
+
+    // Each register's interval runs from its definition to the last point it's live. Where it's
+    // live is found by walking back from each use to the definition. A phi is written by the copies
+    // at the end of each predecessor, and its incoming registers are read there.
+    struct Interval
+    {
+        Ir::Value value;
+        uint32_t start;
+        uint32_t end;
+    };
+    std::vector<Interval> intervals(m_function.instructions.size(), { Ir::None, 0, 0 });
+    std::vector<std::vector<std::pair<Ir::BlockId, uint32_t>>> uses(m_function.instructions.size());
+    for (const auto block : order)
+    {
+        for (const auto value : m_function.blocks[block].instructions)
+        {
+            const auto& instruction = m_function.instructions[value];
+            if (Ir::hasResult(instruction.op))
+            {
+                intervals[value] = { value, position[value], position[value] };
+            }
+            for (const auto operand : { instruction.lhs, instruction.rhs })
+            {
+                if (operand != Ir::None)
+                {
+                    uses[operand].emplace_back(block, position[value]);
+                }
+            }
+            for (const auto& [from, incoming] : instruction.incoming)
+            {
+                uses[incoming].emplace_back(from, blockEnd[from]);
+                intervals[value].start = std::min(intervals[value].start, blockEnd[from]);
+                intervals[value].end = std::max(intervals[value].end, blockEnd[from]);
+            }
+        }
+    }
+    std::vector<Ir::Value> liveInMark(m_function.blocks.size(), Ir::None);
+    m_phisLiveIn.assign(m_function.blocks.size(), {});
+    std::vector<Ir::BlockId> worklist;
+    for (const auto block : order)
+    {
+        for (const auto value : m_function.blocks[block].instructions)
+        {
+            auto& interval = intervals[value];
+            for (const auto& [useBlock, usePosition] : uses[value])
+            {
+                interval.end = std::max(interval.end, usePosition);
+                if (useBlock != block)
+                {
+                    worklist.push_back(useBlock);
+                }
+            }
+            // Live into each block on a path from the definition to a use in another block
+            while (!worklist.empty())
+            {
+                const auto live = worklist.back();
+                worklist.pop_back();
+                if (liveInMark[live] == value)
+                {
+                    continue;
+                }
+                liveInMark[live] = value;
+                if (m_function.instructions[value].op == Ir::Op::Phi)
+                {
+                    m_phisLiveIn[live].push_back(value);
+                }
+                interval.start = std::min(interval.start, blockStart[live]);
+                for (const auto predecessor : m_function.blocks[live].predecessors)
+                {
+                    interval.end = std::max(interval.end, blockEnd[predecessor]);
+                    if (predecessor != block)
+                    {
+                        worklist.push_back(predecessor);
+                    }
+                }
+            }
+        }
+    }
+
+    // Linear scan: registers go to intervals in order of their start, and when there are none free
+    // the interval ending last is spilled to the stack
+    std::erase_if(intervals, [](const Interval& interval) { return interval.value == Ir::None; });
+    std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) { return a.start < b.start; });
+    std::vector<uint32_t> registerOf(m_function.instructions.size(), Ir::None);
+    std::vector<uint32_t> free;
+    for (uint32_t i = std::size(Registers); i > 0; --i)
+    {
+        free.push_back(i - 1);
+    }
+    std::vector<Interval> active;
+    for (const auto& interval : intervals)
+    {
+        std::erase_if(active, [&](const Interval& other) {
+            if (other.end >= interval.start)
+            {
+                return false;
+            }
+            free.push_back(registerOf[other.value]);
+            return true;
+        });
+        if (!free.empty())
+        {
+            registerOf[interval.value] = free.back();
+            free.pop_back();
+            active.push_back(interval);
+            continue;
+        }
+        const auto last = std::max_element(active.begin(), active.end(), [](const Interval& a, const Interval& b) { return a.end < b.end; });
+        if (last->end > interval.end)
+        {
+            registerOf[interval.value] = registerOf[last->value];
+            registerOf[last->value] = Ir::None;
+            *last = interval;
+        }
+    }
+
+    m_locations.assign(m_function.instructions.size(), {});
+    for (const auto& interval : intervals)
+    {
+        const auto value = interval.value;
+        m_locations[value] = registerOf[value] != Ir::None ? Registers[registerOf[value]]
+                                                          : "[rbp - " + std::to_string(++frameSize * 8) + "]";
+    }
+}
+
+void IrGenerator::generateInstruction(Ir::Value value, Ir::BlockId next)
+{
+    const auto& instruction = m_function.instructions[value];
+    switch (instruction.op)
+    {
+        case Ir::Op::Const:
+            if (inRegister(value))
+            {
+                m_outputStream << "\tmov " << reg(value) << ", " << instruction.constant << "\n";
+                break;
+            }
+            m_outputStream << "\tmov rax, " << instruction.constant << "\n";
+            m_outputStream << "\tmov " << reg(value) << ", rax\n";
+            break;
+        case Ir::Op::Load:
+            m_outputStream << "\tmov rax, " << slot(instruction.slot) << "\n";
+            m_outputStream << "\tmov " << reg(value) << ", rax\n";
+            break;
+        case Ir::Op::Store:
+            m_outputStream << "\tmov rax, " << reg(instruction.lhs) << "\n";
+            m_outputStream << "\tmov " << slot(instruction.slot) << ", rax\n";
+            break;
+        case Ir::Op::Add: arithmetic(value, "add rax, rcx"); break;
+        case Ir::Op::Sub: arithmetic(value, "sub rax, rcx"); break;
+        case Ir::Op::Mul: arithmetic(value, "imul rax, rcx"); break;
+        // Sign extended into rdx, which idiv divides along with rax
+        case Ir::Op::Div: arithmetic(value, "cqo\n\tidiv rcx"); break;
+        case Ir::Op::Lt: compare(value, "setl"); break;
+        case Ir::Op::Gt: compare(value, "setg"); break;
+        case Ir::Op::Le: compare(value, "setle"); break;
+        case Ir::Op::Ge: compare(value, "setge"); break;
+        case Ir::Op::Eq: compare(value, "sete"); break;
+        case Ir::Op::Ne: compare(value, "setne"); break;
+        case Ir::Op::Phi:
+            // Copied into by each edge into the block
+            break;
+        case Ir::Op::Jump:
+            generateEdge(instruction.block, instruction.targets[0], next);
+            break;
+        case Ir::Op::Branch:
+        {
+            const auto block = instruction.block;
+            m_outputStream << "\tmov rax, " << reg(instruction.lhs) << "\n";
+            m_outputStream << "\tcmp rax, 0\n";
+            const auto hasPhis = [&](Ir::BlockId target) {
+                const auto& instructions = m_function.blocks[target].instructions;
+                return m_function.instructions[instructions.front()].op == Ir::Op::Phi;
+            };
+            const auto [onTrue, onFalse] = instruction.targets;
+            if (onTrue == onFalse)
+            {
+                generateEdge(block, onTrue, next);
+            }
+            else if (!hasPhis(onTrue) && !hasPhis(onFalse))
+            {
+                if (onTrue == next)
+                {
+                    m_outputStream << "\tje " << label(onFalse) << "\n";
+                }
+                else
+                {
+                    m_outputStream << "\tjne " << label(onTrue) << "\n";
+                    generateEdge(block, onFalse, next);
+                }
+            }
+            // Copies are only movs, which leave the flags alone, so one edge's copies can go before
+            // the jump along it. That keeps a loop tested at the bottom to one branch each time round.
+            else if (copiesBeforeBranch(block, onTrue, onFalse))
+            {
+                generateCopies(block, onTrue);
+                m_outputStream << "\tjne " << label(onTrue) << "\n";
+                generateEdge(block, onFalse, next);
+            }
+            else if (copiesBeforeBranch(block, onFalse, onTrue))
+            {
+                generateCopies(block, onFalse);
+                m_outputStream << "\tje " << label(onFalse) << "\n";
+                generateEdge(block, onTrue, next);
+            }
+            else
+            {
+                // The copies for each edge go on their own path
+                const auto falseEdge = label(block) + "_false";
+                m_outputStream << "\tje " << falseEdge << "\n";
+                generateEdge(block, onTrue, Ir::None);
+                m_outputStream << falseEdge << ":\n";
+                generateEdge(block, onFalse, next);
+            }
+            break;
+        }
+        case Ir::Op::Return:
+            m_outputStream << "\tmov rax, 60\n";
+            m_outputStream << "\tmov rdi, " << reg(instruction.lhs) << "\n";
+            m_outputStream << "\tsyscall\n";
+            break;
+    }
+}
+
+void IrGenerator::generateEdge(Ir::BlockId from, Ir::BlockId to, Ir::BlockId next)
+{
+    generateCopies(from, to);
+    if (to != next)
+    {
+        m_outputStream << "\tjmp " << label(to) << "\n";
+    }
+}
+
+void IrGenerator::generateCopies(Ir::BlockId from, Ir::BlockId to)
+{
+    // Every phi reads its register before any is written, as one may read another. The copies are
+    // made between locations, as registers whose intervals don't overlap can share one.
+    struct Copy
+    {
+        std::string_view to;
+        std::string_view from;
+    };
+    std::vector<Copy> copies;
+    for (const auto value : m_function.blocks[to].instructions)
+    {
+        const auto& phi = m_function.instructions[value];
+        if (phi.op != Ir::Op::Phi)
+        {
+            break;
+        }
+        const auto incoming = std::find_if(phi.incoming.begin(), phi.incoming.end(), [&](const auto& edge) { return edge.first == from; });
+        if (reg(incoming->second) != reg(value))
+        {
+            copies.push_back({ reg(value), reg(incoming->second) });
+        }
+    }
+
+    // A copy can be made once nothing left to copy reads where it writes. When every copy left is
+    // waiting on another they form cycles, and one is broken by moving a location that's about to
+    // be written into rax, which is then read in its place.
+    const auto move = [&](std::string_view target, std::string_view source) {
+        if (target.front() == '[' && source.front() == '[')
+        {
+            m_outputStream << "\tmov rcx, " << source << "\n";
+            source = "rcx";
+        }
+        m_outputStream << "\tmov " << target << ", " << source << "\n";
+    };
+    while (!copies.empty())
+    {
+        const auto ready = std::find_if(copies.begin(), copies.end(), [&](const Copy& copy) {
+            return std::none_of(copies.begin(), copies.end(), [&](const Copy& other) { return other.from == copy.to; });
+        });
+        if (ready != copies.end())
+        {
+            move(ready->to, ready->from);
+            copies.erase(ready);
+            continue;
+        }
+        const auto saved = copies.front().to;
+        move("rax", saved);
+        for (auto& copy : copies)
+        {
+            if (copy.from == saved)
+            {
+                copy.from = "rax";
+            }
+        }
+    }
+}
+
+bool IrGenerator::copiesBeforeBranch(Ir::BlockId from, Ir::BlockId to, Ir::BlockId other) const
+{
+    // Anything else other reads is live over the branch along with the phis of to, so it can't share
+    // a register with one of them
+    const auto& live = m_phisLiveIn[other];
+    for (const auto value : m_function.blocks[to].instructions)
+    {
+        if (m_function.instructions[value].op != Ir::Op::Phi)
+        {
+            break;
+        }
+        if (std::find(live.begin(), live.end(), value) != live.end())
+        {
+            return false;
+        }
+        for (const auto read : m_function.blocks[other].instructions)
+        {
+            const auto& phi = m_function.instructions[read];
+            if (phi.op != Ir::Op::Phi)
+            {
+                break;
+            }
+            const auto incoming = std::find_if(phi.incoming.begin(), phi.incoming.end(), [&](const auto& edge) { return edge.first == from; });
+            if (incoming->second == value)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void IrGenerator::arithmetic(Ir::Value value, std::string_view instruction)
+{
+    const auto& operation = m_function.instructions[value];
+    m_outputStream << "\tmov rax, " << reg(operation.lhs) << "\n";
+    m_outputStream << "\tmov rcx, " << reg(operation.rhs) << "\n";
+    m_outputStream << "\t" << instruction << "\n";
+    m_outputStream << "\tmov " << reg(value) << ", rax\n";
+}
+
+void IrGenerator::compare(Ir::Value value, std::string_view setInstruction)
+{
+    const auto& operation = m_function.instructions[value];
+    m_outputStream << "\tmov rax, " << reg(operation.lhs) << "\n";
+    m_outputStream << "\tcmp rax, " << reg(operation.rhs) << "\n";
+    m_outputStream << "\t" << setInstruction << " al\n";
+    m_outputStream << "\tmovzx rax, al\n";
+    m_outputStream << "\tmov " << reg(value) << ", rax\n";
+}
+
+std::string IrGenerator::slot(Ir::SlotId slot) const
+{
+    return "[rbp - " + std::to_string((m_slotIndex[slot] + 1) * 8) + "]";
+}
+
+const std::string& IrGenerator::reg(Ir::Value value) const
+{
+    return m_locations[value];
+}
+
+bool IrGenerator::inRegister(Ir::Value value) const
+{
+    return m_locations[value].front() != '[';
+}
+
+std::string IrGenerator::label(Ir::BlockId block)
+{
+    return "bb" + std::to_string(block);
+}
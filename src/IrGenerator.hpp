@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Ir.hpp"
+
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Generates asm from a function in the IR. Each variable still in use has a stack slot of its own
+// below rbp, and registers are allocated by linear scan, spilling to more stack slots when there
+// aren't enough. Instructions work through rax and rcx. Blocks are laid out in reverse postorder,
+// so a jump to the block that comes next is left out. Phis are resolved by copies on each edge
+// into their block.
+class IrGenerator
+{
+public:
+    explicit IrGenerator(const Ir::Function& function);
+
+    [[nodiscard]] std::string generateProgram();
+
+private:
+    void generateInstruction(Ir::Value value, Ir::BlockId next);
+    // The copies for the phis of to when arriving from from, then a jump to to unless it's next
+    void generateEdge(Ir::BlockId from, Ir::BlockId to, Ir::BlockId next);
+    void generateCopies(Ir::BlockId from, Ir::BlockId to);
+    // Whether the copies for the edge from from to to can be made before branching, leaving what
+    // the other way out of from reads alone
+    [[nodiscard]] bool copiesBeforeBranch(Ir::BlockId from, Ir::BlockId to, Ir::BlockId other) const;
+    void arithmetic(Ir::Value value, std::string_view instruction);
+    void compare(Ir::Value value, std::string_view setInstruction);
+
+    // Gives each IR register a machine register, or a stack slot after the frameSize slots already
+    // taken where it has to spill
+    void allocateRegisters(const std::vector<Ir::BlockId>& order, uint32_t& frameSize);
+
+    // Where a variable or register lives, as an operand
+    [[nodiscard]] std::string slot(Ir::SlotId slot) const;
+    [[nodiscard]] const std::string& reg(Ir::Value value) const;
+    [[nodiscard]] bool inRegister(Ir::Value value) const;
+    [[nodiscard]] static std::string label(Ir::BlockId block);
+
+    const Ir::Function& m_function;
+    // Everything but rax, rcx and rdx, which instructions work through, and rbp and rsp
+    static constexpr const char* Registers[] = { "rbx", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+
+    // Index of each variable's stack slot, and where each register lives
+    std::vector<uint32_t> m_slotIndex;
+    std::vector<std::string> m_locations;
+    // The phis live into each block
+    std::vector<std::vector<Ir::Value>> m_phisLiveIn;
+    std::stringstream m_outputStream;
+};
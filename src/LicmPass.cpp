@@ -0,0 +1,204 @@
+#include "Passes.hpp"
+#include "IrAnalysis.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+    // A natural loop: its header and every block that gets back to the header without passing
+    // through it first
+    struct Loop
+    {
+        Ir::BlockId header;
+        std::vector<bool> contains;
+        size_t size = 0;
+    };
+
+    std::vector<Loop> findLoops(const Ir::Function& function, const Ir::DominatorTree& dominators)
+    {
+        std::vector<Loop> loops;
+        std::vector<uint32_t> loopOf(function.blocks.size(), Ir::None);
+        for (const auto block : dominators.order())
+        {
+            for (const auto header : function.successors(block))
+            {
+                // An edge back to a block dominating this one closes a loop
+                if (!dominators.dominates(header, block))
+                {
+                    continue;
+                }
+                if (loopOf[header] == Ir::None)
+                {
+                    loopOf[header] = static_cast<uint32_t>(loops.size());
+                    loops.push_back({ header, std::vector<bool>(function.blocks.size(), false) });
+                    loops.back().contains[header] = true;
+                    loops.back().size = 1;
+                }
+                auto& loop = loops[loopOf[header]];
+                std::vector<Ir::BlockId> worklist{ block };
+                while (!worklist.empty())
+                {
+                    const auto member = worklist.back();
+                    worklist.pop_back();
+                    if (loop.contains[member] || !dominators.reachable(member))
+                    {
+                        continue;
+                    }
+                    loop.contains[member] = true;
+                    ++loop.size;
+                    const auto& predecessors = function.blocks[member].predecessors;
+                    worklist.insert(worklist.end(), predecessors.begin(), predecessors.end());
+                }
+            }
+        }
+        // Inner loops first, so what they hoist can be hoisted again out of the loops around them
+        std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.size < b.size; });
+        return loops;
+    }
+
+    // The one block outside the loop that jumps to its header, which is made if there isn't one. Each
+    // phi of the header takes what it took from outside from there instead, through a phi of the
+    // preheader where that was more than one register.
+    Ir::BlockId preheaderOf(Ir::Function& function, const Loop& loop)
+    {
+        std::vector<Ir::BlockId> outside;
+        for (const auto predecessor : function.blocks[loop.header].predecessors)
+        {
+            if (!loop.contains[predecessor] && std::find(outside.begin(), outside.end(), predecessor) == outside.end())
+            {
+                outside.push_back(predecessor);
+            }
+        }
+        if (outside.size() == 1 && function.terminator(outside.front()).op == Ir::Op::Jump)
+        {
+            return outside.front();
+        }
+
+        std::vector<std::pair<Ir::Value, std::vector<std::pair<Ir::BlockId, Ir::Value>>>> phis;
+        for (const auto value : function.blocks[loop.header].instructions)
+        {
+            const auto& phi = function.instructions[value];
+            if (phi.op != Ir::Op::Phi)
+            {
+                break;
+            }
+            auto& incoming = phis.emplace_back(value, std::vector<std::pair<Ir::BlockId, Ir::Value>>()).second;
+            std::copy_if(phi.incoming.begin(), phi.incoming.end(), std::back_inserter(incoming), [&](const auto& edge) {
+                return !loop.contains[edge.first];
+            });
+        }
+        const auto preheader = function.addBlock();
+        for (const auto predecessor : outside)
+        {
+            auto terminator = function.terminator(predecessor);
+            std::replace(terminator.targets.begin(), terminator.targets.end(), loop.header, preheader);
+            function.replaceTerminator(predecessor, terminator);
+        }
+        function.append(preheader, { .op = Ir::Op::Jump, .targets = { loop.header, Ir::None } });
+        for (const auto& [value, incoming] : phis)
+        {
+            auto merged = incoming.front().second;
+            const bool same = std::all_of(incoming.begin(), incoming.end(), [&](const auto& edge) { return edge.second == merged; });
+            if (!same)
+            {
+                merged = static_cast<Ir::Value>(function.instructions.size());
+                function.instructions.push_back({ .op = Ir::Op::Phi, .block = preheader, .incoming = incoming });
+                auto& instructions = function.blocks[preheader].instructions;
+                instructions.insert(instructions.begin(), merged);
+            }
+            function.instructions[value].incoming.emplace_back(preheader, merged);
+        }
+        return preheader;
+    }
+}
+
+namespace Passes {
+    bool hoistInvariants(IrPassContext& context)
+    {
+        auto& function = context.function;
+        const auto& dominators = context.analyses.dominators();
+        auto loops = findLoops(function, dominators);
+        const auto order = dominators.order();
+        bool changed = false;
+        for (auto& loop : loops)
+        {
+            // Variables the loop stores to change in it
+            std::vector<bool> stored(function.slots.size(), false);
+            for (Ir::BlockId block = 0; block < loop.contains.size(); ++block)
+            {
+                if (!loop.contains[block])
+                {
+                    continue;
+                }
+                for (const auto value : function.blocks[block].instructions)
+                {
+                    const auto& instruction = function.instructions[value];
+                    if (instruction.op == Ir::Op::Store)
+                    {
+                        stored[instruction.slot] = true;
+                    }
+                }
+            }
+            const auto invariant = [&](Ir::Value operand) {
+                return operand == Ir::None || !loop.contains[function.instructions[operand].block];
+            };
+            const auto hoistable = [&](const Ir::Instruction& instruction) {
+                switch (instruction.op)
+                {
+                    case Ir::Op::Const:
+                        return true;
+                    case Ir::Op::Load:
+                        return !stored[instruction.slot];
+                    default:
+                        // Safe to run even if the loop wouldn't have, as long as it can't trap
+                        return Ir::isBinary(instruction.op) && !function.hasSideEffects(instruction) &&
+                               invariant(instruction.lhs) && invariant(instruction.rhs);
+                }
+            };
+
+            Ir::BlockId preheader = Ir::None;
+            // In reverse postorder the operands of each instruction are seen before it
+            for (const auto block : order)
+            {
+                if (!loop.contains[block])
+                {
+                    continue;
+                }
+                std::vector<Ir::Value> hoisted;
+                for (const auto value : function.blocks[block].instructions)
+                {
+                    if (hoistable(function.instructions[value]))
+                    {
+                        hoisted.push_back(value);
+                        // Seen as outside the loop from here on
+                        if (preheader == Ir::None)
+                        {
+                            preheader = preheaderOf(function, loop);
+                            // Every loop around this one contains its preheader too
+                            for (auto& outer : loops)
+                            {
+                                outer.contains.resize(function.blocks.size(), false);
+                                if (&outer != &loop && outer.contains[loop.header])
+                                {
+                                    outer.contains[preheader] = true;
+                                }
+                            }
+                        }
+                        function.instructions[value].block = preheader;
+                    }
+                }
+                if (hoisted.empty())
+                {
+                    continue;
+                }
+                auto& instructions = function.blocks[block].instructions;
+                std::erase_if(instructions, [&](Ir::Value value) { return function.instructions[value].block == preheader; });
+                auto& into = function.blocks[preheader].instructions;
+                into.insert(into.end() - 1, hoisted.begin(), hoisted.end());
+                changed = true;
+            }
+        }
+        return changed;
+    }
+}
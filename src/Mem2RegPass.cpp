@@ -0,0 +1,223 @@
+#include "Passes.hpp"
+#include "IrAnalysis.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // Places a phi for each variable at the start of every block in the iterated dominance frontier
+    // of its stores where it's live, as in Cytron et al. Returns the variable of each phi placed.
+    std::vector<std::pair<Ir::Value, Ir::SlotId>> placePhis(Ir::Function& function, const Ir::DominatorTree& dominators)
+    {
+        const auto frontiers = Ir::dominanceFrontiers(function, dominators);
+        const Ir::SlotLiveness liveness(function);
+        std::vector<std::vector<Ir::BlockId>> storedIn(function.slots.size());
+        for (const auto block : dominators.order())
+        {
+            for (const auto value : function.blocks[block].instructions)
+            {
+                const auto& instruction = function.instructions[value];
+                if (instruction.op == Ir::Op::Store && (storedIn[instruction.slot].empty() || storedIn[instruction.slot].back() != block))
+                {
+                    storedIn[instruction.slot].push_back(block);
+                }
+            }
+        }
+
+        std::vector<std::pair<Ir::Value, Ir::SlotId>> phis;
+        std::vector<Ir::SlotId> placedFor(function.blocks.size(), Ir::None);
+        for (Ir::SlotId slot = 0; slot < function.slots.size(); ++slot)
+        {
+            auto worklist = storedIn[slot];
+            while (!worklist.empty())
+            {
+                const auto block = worklist.back();
+                worklist.pop_back();
+                for (const auto join : frontiers[block])
+                {
+                    if (placedFor[join] == slot || !liveness.liveIn(join, slot))
+                    {
+                        continue;
+                    }
+                    placedFor[join] = slot;
+                    const auto phi = static_cast<Ir::Value>(function.instructions.size());
+                    function.instructions.push_back({ .op = Ir::Op::Phi, .block = join });
+                    auto& instructions = function.blocks[join].instructions;
+                    instructions.insert(instructions.begin(), phi);
+                    phis.emplace_back(phi, slot);
+                    // A phi is a store of its own
+                    worklist.push_back(join);
+                }
+            }
+        }
+        return phis;
+    }
+
+    // Takes out phis that merge one register, and perhaps themselves, until there are none left
+    void removeTrivialPhis(Ir::Function& function)
+    {
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (auto& block : function.blocks)
+            {
+                for (const auto value : block.instructions)
+                {
+                    const auto& phi = function.instructions[value];
+                    if (phi.op != Ir::Op::Phi)
+                    {
+                        break;
+                    }
+                    Ir::Value only = Ir::None;
+                    const bool trivial = std::all_of(phi.incoming.begin(), phi.incoming.end(), [&](const auto& incoming) {
+                        if (incoming.second == value || incoming.second == only)
+                        {
+                            return true;
+                        }
+                        const bool first = only == Ir::None;
+                        only = incoming.second;
+                        return first;
+                    });
+                    if (trivial && only != Ir::None)
+                    {
+                        function.remove(value);
+                        function.replaceAllUses(value, only);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace Passes {
+    bool promoteVariables(IrPassContext& context)
+    {
+        auto& function = context.function;
+        if (function.slots.empty())
+        {
+            return false;
+        }
+        // Renaming only reaches what the entry dominates
+        if (function.removeUnreachableBlocks())
+        {
+            context.analyses.invalidate(AnalysisCache::Dominators);
+        }
+        const auto& dominators = context.analyses.dominators();
+        const auto phis = placePhis(function, dominators);
+        std::vector<Ir::SlotId> phiSlot(function.instructions.size(), Ir::None);
+        for (const auto& [phi, slot] : phis)
+        {
+            phiSlot[phi] = slot;
+        }
+
+        // Renaming walks the dominator tree, keeping the register holding each variable's value
+        // and undoing what each block set on the way back up
+        std::vector<Ir::Value> replacements(function.instructions.size(), Ir::None);
+        const auto resolve = [&](Ir::Value value) {
+            while (value != Ir::None && replacements[value] != Ir::None)
+            {
+                value = replacements[value];
+            }
+            return value;
+        };
+        std::vector<Ir::Value> current(function.slots.size(), Ir::None);
+        std::vector<std::pair<Ir::SlotId, Ir::Value>> undo;
+        // Read on a path with no store, which lowering never produces, but it's given a value anyway.
+        // Dropped at the end if nothing uses it.
+        const auto undefined = static_cast<Ir::Value>(function.instructions.size());
+        function.instructions.push_back({ .op = Ir::Op::Const, .block = function.entry });
+        auto& entryInstructions = function.blocks[function.entry].instructions;
+        entryInstructions.insert(entryInstructions.begin(), undefined);
+        replacements.push_back(Ir::None);
+        const auto valueOf = [&](Ir::SlotId slot) {
+            return current[slot] != Ir::None ? current[slot] : undefined;
+        };
+
+        struct Frame
+        {
+            Ir::BlockId block;
+            size_t undoMark;
+            size_t nextChild = 0;
+        };
+        std::vector<Frame> stack;
+        const auto enter = [&](Ir::BlockId block) {
+            stack.push_back({ block, undo.size() });
+            for (const auto value : function.blocks[block].instructions)
+            {
+                auto& instruction = function.instructions[value];
+                if (instruction.op == Ir::Op::Phi && value < phiSlot.size() && phiSlot[value] != Ir::None)
+                {
+                    undo.emplace_back(phiSlot[value], current[phiSlot[value]]);
+                    current[phiSlot[value]] = value;
+                }
+                else if (instruction.op == Ir::Op::Load)
+                {
+                    replacements[value] = valueOf(instruction.slot);
+                }
+                else if (instruction.op == Ir::Op::Store)
+                {
+                    undo.emplace_back(instruction.slot, current[instruction.slot]);
+                    current[instruction.slot] = resolve(instruction.lhs);
+                }
+            }
+            for (const auto successor : function.successors(block))
+            {
+                for (const auto value : function.blocks[successor].instructions)
+                {
+                    auto& phi = function.instructions[value];
+                    if (phi.op != Ir::Op::Phi)
+                    {
+                        break;
+                    }
+                    const bool placed = value < phiSlot.size() && phiSlot[value] != Ir::None;
+                    const bool seen = std::any_of(phi.incoming.begin(), phi.incoming.end(), [&](const auto& incoming) { return incoming.first == block; });
+                    if (placed && !seen)
+                    {
+                        phi.incoming.emplace_back(block, valueOf(phiSlot[value]));
+                    }
+                }
+            }
+        };
+
+        enter(function.entry);
+        while (!stack.empty())
+        {
+            auto& frame = stack.back();
+            const auto& children = dominators.children(frame.block);
+            if (frame.nextChild < children.size())
+            {
+                enter(children[frame.nextChild++]);
+                continue;
+            }
+            while (undo.size() > frame.undoMark)
+            {
+                current[undo.back().first] = undo.back().second;
+                undo.pop_back();
+            }
+            stack.pop_back();
+        }
+
+        // Every variable is a register now, so no load or store is left
+        function.replaceUses(replacements);
+        bool promoted = false;
+        for (auto& block : function.blocks)
+        {
+            std::erase_if(block.instructions, [&](Ir::Value value) {
+                auto& instruction = function.instructions[value];
+                if (instruction.op != Ir::Op::Load && instruction.op != Ir::Op::Store)
+                {
+                    return false;
+                }
+                instruction.block = Ir::None;
+                promoted = true;
+                return true;
+            });
+        }
+        removeTrivialPhis(function);
+        function.removeDeadInstructions();
+        return promoted;
+    }
+}
@@ -16,31 +16,35 @@ public:
 protected:
     Generator& generator() { return m_generator; }
     std::stringstream& output() { return m_generator.output(); }
-    std::vector<Variable>& variables() { return m_generator.variables(); }
+    std::pmr::vector<Variable>& variables() { return m_generator.variables(); }
     ErrorHandler& errors() { return m_generator.errors(); }
-    std::vector<size_t>& scopes() { return m_generator.scopes(); }
+    std::pmr::vector<size_t>& scopes() { return m_generator.scopes(); }
     size_t stackLocation() { return m_generator.stackLocation(); }
 
 private:
     Generator& m_generator;
 };
 
-class TermVisitor : public NodeVisitor
+class ExprVisitor : public NodeVisitor
 {
 public:
-    explicit TermVisitor(Generator& generator): NodeVisitor((generator)) {}
+    explicit ExprVisitor(Generator& generator): NodeVisitor(generator) {}
 
-    void operator()(const Node::Identifier* indentExpr)
+    void term(const Node::Expr& term)
     {
-        std::string identifier = indentExpr->identifier.value().value();
-        auto it = std::find_if(
-                variables().begin(),
-                variables().end(),
-                [&identifier](const Variable& var) { return var.name == identifier; });
-        if (it == variables().end())
+        if (term.kind == Node::ExprKind::IntLiteral)
+        {
+            output() << "\tmov rax, " << term.intValue() << "\n";
+            generator().push("rax");
+            return;
+        }
+
+        const Token& token = generator().tree().tokens[term.lhs];
+        const Variable* it = generator().findVariable(token.symbol());
+        if (it == nullptr)
         {
             std::stringstream errorSs;
-            errorSs << "Undeclared variable " << identifier;
+            errorSs << "Undeclared variable " << token.value().value();
             const auto error = makeError({}, errorSs.str());
             errors() << error;
             return;
@@ -49,87 +53,48 @@ public:
         const auto identLocation = it->stackPosition;
         const auto offset = generator().stackLocation() - identLocation - 1;
         // This pushes a copy of the item in rsp + offset to the top of the stack.
-        // We * 8 here because it's the size in bytes (64bit -> 8, 32bit -> 4)
-        generator().push("QWORD [rsp + " + std::to_string(offset * 8) + "]");
-
+        generator().pushStackSlot(offset);
     }
-    void operator()(const Node::IntLiteral* intLitExpr)
-    {
-        output() << "\tmov rax, " << intLitExpr->intLit.value().value() << "\n";
-        generator().push("rax");
-    }
-    void operator()(const Node::TermParen* parenTerm)
-    {
-        generator().generateExpr(parenTerm->expr);
-    }
-};
 
-class ExprVisitor : public NodeVisitor
-{
-public:
-    explicit ExprVisitor(Generator& generator): NodeVisitor(generator) {}
-    void operator()(const Node::Term* term)
-    {
-        generator().generateTerm(term);
-    }
-    void operator()(const Node::BinExpr* binExpr)
+    void scheduleOperands(Node::Index index, const Node::Expr& operation)
     {
-        generator().generateBinExp(binExpr);
+        // The operator runs once both operands are on the stack. The rhs is scheduled last so it's
+        // evaluated first, leaving the lhs on top.
+        generator().schedule(Generator::ExprStep{ .expr = index, .operandsEvaluated = true });
+        generator().schedule(Generator::ExprStep{ .expr = operation.lhs });
+        generator().schedule(Generator::ExprStep{ .expr = operation.rhs });
     }
-    void operator()(const Node::RelExpr* relExpr) {
-        generator().generateRelExp(relExpr);
-    }
-    void operator()(const Node::EqlExpr* eqlExpr) {
-        generator().generateEqlExp(eqlExpr);
-    }
-};
 
-class BinExprVisitor : public NodeVisitor
-{
-public:
-    explicit BinExprVisitor(Generator& generator): NodeVisitor(generator) {}
-    void operator()(const Node::BinaryExpr::Add* add)
+    // Both operands are already on the top of the stack, lhs above rhs, otherwise we are minus-ing
+    // in the wrong order (associativity and all that). The comparisons are signed.
+    void operate(const Node::Expr& operation)
     {
-        // This pushes both onto the stop of the stack
-        generator().generateExpr(add->rhs);
-        generator().generateExpr(add->lhs);
-
-        generator().pop("rax");
-        generator().pop("rbx");
-        output() << "\tadd rax, rbx\n";
-        generator().push("rax");
+        switch (operation.kind)
+        {
+            case Node::ExprKind::Add: arithmetic("add rax, rbx"); break;
+            case Node::ExprKind::Multiply: arithmetic("mul rbx"); break;
+            case Node::ExprKind::Minus: arithmetic("sub rax, rbx"); break;
+            // Signed, with rax sign extended into rdx, which the division takes as its top half
+            case Node::ExprKind::Divide: arithmetic("cqo\n\tidiv rbx"); break;
+            case Node::ExprKind::LessThan: generator().compare("setl"); break;
+            case Node::ExprKind::GreaterThan: generator().compare("setg"); break;
+            case Node::ExprKind::LessThanEqual: generator().compare("setle"); break;
+            case Node::ExprKind::GreaterThanEqual: generator().compare("setge"); break;
+            case Node::ExprKind::Equal: generator().compare("sete"); break;
+            case Node::ExprKind::NotEqual: generator().compare("setne"); break;
+            case Node::ExprKind::IntLiteral:
+            case Node::ExprKind::Identifier:
+                assert(false && "Leaves have no operands");
+                break;
+        }
     }
-    void operator()(const Node::BinaryExpr::Multiply* mult)
-    {
-        // This pushes both onto the stop of the stack
-        generator().generateExpr(mult->rhs);
-        generator().generateExpr(mult->lhs);
 
-        generator().pop("rax");
-        generator().pop("rbx");
-        output() << "\tmul rbx\n";
-        generator().push("rax");
-    }
-    void operator()(const Node::BinaryExpr::Minus* minus)
-    {
-        // This pushes both onto the stop of the stack
-        // Need to do RHS first otherwise we are minus-ing in the wrong order (associativity and all that)
-        generator().generateExpr(minus->rhs);
-        generator().generateExpr(minus->lhs);
-        generator().pop("rax");
-        generator().pop("rbx");
-        output() << "\tsub rax, rbx\n";
-        generator().push("rax");
-    }
-    void operator()(const Node::BinaryExpr::Divide* div)
+private:
+    void arithmetic(std::string_view instruction)
     {
-        // This pushes both onto the stop of the stack
-        generator().generateExpr(div->rhs);
-        generator().generateExpr(div->lhs);
-
         generator().pop("rax");
         generator().pop("rbx");
-        output() << "\tdiv rbx\n";
+        output() << "\t" << instruction << "\n";
         generator().push("rax");
     }
 };
@@ -138,85 +103,94 @@ class StatementVisitor : public NodeVisitor
 {
 public:
     explicit StatementVisitor(Generator& generator): NodeVisitor(generator) {}
-    void operator()(const Node::Statement::Let* letStatement)
+    void operator()(const Node::Statement::Let& letStatement)
     {
+        const Token& identifier = generator().tree().tokens[letStatement.identifier];
         size_t offset = 0;
-        const auto ss = scopes();
         if (!scopes().empty())
         {
             offset = scopes().back();
-            if (offset < 0 || offset > variables().size())
+            if (offset > variables().size())
             {
                 offset = 0;
             }
         }
-        auto it = std::find_if(
-                variables().begin() + offset,
-                variables().end(),
-                [&letStatement](const Variable& var) { return var.name == letStatement->identifier.value().value(); });
-//        if (variables().contains(letStatement->identifier.Value.value()))
-        if (it != variables().end())
+        // Only a variable declared in this scope clashes; outer ones are shadowed
+        const Variable* it = generator().findVariable(identifier.symbol());
+//        if (variables().contains(identifier.Value.value()))
+        if (it != nullptr && static_cast<size_t>(it - variables().data()) >= offset)
         {
             std::stringstream errorSs;
-            errorSs << "Identifier " << letStatement->identifier.value().value() << " already used.";
-            const auto error = makeError(letStatement->identifier.info().value(), errorSs.str());
+            errorSs << "Identifier " << identifier.value().value() << " already used.";
+            const auto error = makeError(identifier.info(), errorSs.str());
             errors() << error;
         } else {
-            variables().push_back({ .name = letStatement->identifier.value().value(), .stackPosition = generator().stackLocation() });
-            generator().generateExpr(letStatement->letExpr); // This inserts the variable onto the stack
+            const auto stackPosition = generator().stackLocation();
+            generator().generateExpr(letStatement.letExpr); // This inserts the variable onto the stack
+            // Declared afterwards so the expression still sees any outer variable of the same name
+            generator().declareVariable(identifier.symbol(), stackPosition);
         }
     }
-    void operator()(const Node::Statement::Assign* assignStatement) {
-        const auto it = std::ranges::find_if(
-                variables(),
-                [&assignStatement](const Variable& var) {
-                    return var.name == assignStatement->identifier.value().value();
-                });
-        if (it == variables().end()) {
+    void operator()(const Node::Statement::Assign& assignStatement) {
+        const Token& identifier = generator().tree().tokens[assignStatement.identifier];
+        const Variable* it = generator().findVariable(identifier.symbol());
+        if (it == nullptr) {
             std::stringstream errorSs;
-            errorSs << "Undeclared identifier " << assignStatement->identifier.value().value() << ".";
-            const auto error = makeError(assignStatement->identifier.info().value(), errorSs.str());
+            errorSs << "Undeclared identifier " << identifier.value().value() << ".";
+            const auto error = makeError(identifier.info(), errorSs.str());
             errors() << error;
         } else {
-            generator().generateExpr(assignStatement->assignExpr); // This evaluates the expression and inserts the variable onto the stack
+            generator().generateExpr(assignStatement.assignExpr); // This evaluates the expression and inserts the variable onto the stack
             generator().pop("rax");
 
             const auto identLocation = it->stackPosition;
             const auto offset = generator().stackLocation() - identLocation - 1;
-            generator().move("[rsp + " + std::to_string(offset * 8) + "]", "rax");
+            generator().storeStackSlot(offset, "rax");
         }
     }
-    void operator()(const Node::Statement::Return* returnStatement)
+    void operator()(const Node::Statement::Return& returnStatement)
     {
-        generator().generateExpr(returnStatement->returnExpr);
+        generator().generateExpr(returnStatement.returnExpr);
         output() << "\tmov rax, 60\n";
         generator().pop("rdi");
         output() << "\tsyscall\n";
     }
-    void operator()(const Node::Scope* statementScope)
+    void operator()(const Node::Scope& statementScope)
     {
-        generator().generateScope(statementScope);
+        generator().schedule(Generator::Step(&statementScope));
     }
-    void operator()(const Node::Statement::If* ifStatement)
+    void operator()(const Node::Statement::If& ifStatement)
     {
         // Puts the result of the expr on the top of the stack
-        generator().generateExpr(ifStatement->expr);
+        generator().generateExpr(ifStatement.expr);
         // Pop the top of the stack (the result of the expr above) into rax
         generator().pop("rax");
         const auto nextLabel = generator().createLabel();
         const auto endLabel = generator().createLabel();
         output() << "\tcmp rax, 0" << "; begin if" << "\n";
         output() << "\tje " << nextLabel << "\n";
-        generator().generateScope(ifStatement->scope);
-        output() << "\tjmp " << endLabel << "; end if" << "\n";
-        output() << nextLabel << ":\n";
-        if (ifStatement->pred.has_value()) {
-            generator().generateIfPredicate(ifStatement->pred.value(), endLabel);
+        // The rest is scheduled, last first, so nested scopes don't recurse
+        generator().schedule(Generator::LabelStep{ endLabel, "  ; end of if block" });
+        if (ifStatement.next != Node::None) {
+            generator().schedule(Generator::IfPredicateStep{ &generator().tree().ifs[ifStatement.next], endLabel });
         }
-        output() << endLabel << ": " << " ; end of if block" << "\n";
+        generator().schedule(Generator::EndBranchStep{ endLabel, nextLabel, "end if" });
+        generator().schedule(Generator::Step(&generator().tree().scopes[ifStatement.scope]));
     }
-    void operator()(const Node::Statement::While* whileStatement) {
-        // TODO: Generate asm for while statement
+    // Rotated: the condition is tested once before the loop and again at the bottom of the body,
+    // so each time round takes a single branch
+    void operator()(const Node::Statement::While& whileStatement) {
+        const auto bodyLabel = generator().createLabel();
+        const auto endLabel = generator().createLabel();
+        const auto errorCount = errors().errorCount();
+        generator().generateExpr(whileStatement.expr);
+        generator().pop("rax");
+        output() << "\tcmp rax, 0" << "; begin while" << "\n";
+        output() << "\tje " << endLabel << "\n";
+        output() << bodyLabel << ":\n";
+        const bool generated = errors().errorCount() == errorCount;
+        generator().schedule(Generator::WhileTestStep{ whileStatement.expr, bodyLabel, endLabel, generated });
+        generator().schedule(Generator::Step(&generator().tree().scopes[whileStatement.scope]));
     }
 };
 
@@ -228,54 +202,27 @@ public:
     , m_endLabel(endLabel)
     {}
 
-    void operator()(const Node::Statement::ElseIf* elseIfStatement) {
+    // An else if or else, which has no expr
+    void operator()(const Node::Statement::If& branch) {
+        if (branch.expr == Node::None) {
+            output() << "\t; begin else\n";
+            generator().schedule(Generator::Step(&generator().tree().scopes[branch.scope]));
+            return;
+        }
         // Puts the result of the expr on the top of the stack
-        generator().generateExpr(elseIfStatement->expr);
+        generator().generateExpr(branch.expr);
         // Pop the top of the stack (the result of the expr above) into rax
         generator().pop("rax");
         const auto nextLabel = generator().createLabel();
         output() << "\tcmp rax, 0 " << "; begin else if" << "\n";
         output() << "\tje " << nextLabel << "\n";
-        generator().generateScope(elseIfStatement->scope);
-        output() << "\tjmp " << m_endLabel << "; end else if" << "\n";
-        output() << nextLabel << ":\n";
-        if (elseIfStatement->pred.has_value()) {
-            generator().generateIfPredicate(elseIfStatement->pred.value(), m_endLabel);
+        if (branch.next != Node::None) {
+            generator().schedule(Generator::IfPredicateStep{ &generator().tree().ifs[branch.next], m_endLabel });
         }
-    }
-    void operator()(const Node::Statement::Else* elseStatement) {
-        output() << "\t; begin else\n";
-        generator().generateScope(elseStatement->scope);
+        generator().schedule(Generator::EndBranchStep{ m_endLabel, nextLabel, "end else if" });
+        generator().schedule(Generator::Step(&generator().tree().scopes[branch.scope]));
     }
 
 private:
     const std::string& m_endLabel;
 };
-
-class RelExprVisitor : public NodeVisitor {
-public:
-    explicit RelExprVisitor(Generator& generator): NodeVisitor(generator) {}
-    void operator()(const Node::RelationalExpr::LessThan* lessThanExpr) {
-        // TODO: Generate asm
-    }
-    void operator()(const Node::RelationalExpr::GreaterThan* greaterThanExpr) {
-        // TODO: Generate asm
-    }
-    void operator()(const Node::RelationalExpr::LessThanEqual* lessThanEqlExpr) {
-        // TODO: Generate asm
-    }
-    void operator()(const Node::RelationalExpr::GreaterThanEqual* greaterThanEqlExpr) {
-        // TODO: Generate asm
-    }
-};
-
-class EqlExprVisitor : public NodeVisitor {
-public:
-    explicit EqlExprVisitor(Generator& generator): NodeVisitor(generator) {}
-    void operator()(const Node::EqualityExpr::Equal* eqlExpr) {
-        // TODO: Generate asm
-    }
-    void operator()(const Node::EqualityExpr::NotEqual* notEqlExpr) {
-        // TODO: Generate asm
-    }
-};
\ No newline at end of file
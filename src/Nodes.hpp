@@ -2,150 +2,315 @@
 
 #include <Token.hpp>
 
-#include <variant>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
 #include <vector>
 
+// The syntax tree is flat: nodes of each kind live in their own contiguous array in a Tree and
+// refer to one another by 32-bit index into those arrays, so walking it touches a few dense arrays
+// rather than chasing a pointer per node.
 namespace Node {
-    struct IntLiteral
+    using Index = uint32_t;
+    // A child that is missing, such as the expression of a statement that failed to parse
+    inline constexpr Index None = UINT32_MAX;
+
+    // A run of statements in Tree::statements
+    struct Range
     {
-        Token intLit;
+        Index first = 0;
+        uint32_t count = 0;
     };
 
-    struct Identifier
+    enum class ExprKind : uint8_t
     {
-        Token identifier;
+        // Leaves. A literal holds its value in lhs and rhs, and an identifier the index of its token
+        // in lhs. Binary operators also hold the index of the operator's token.
+        IntLiteral,
+        Identifier,
+        // Binary operators
+        Add,
+        Multiply,
+        Minus,
+        Divide,
+        LessThan,
+        GreaterThan,
+        LessThanEqual,
+        GreaterThanEqual,
+        Equal,
+        NotEqual
     };
 
-    struct Expr;
-
-    namespace BinaryExpr {
-        struct Add
-        {
-            Expr *lhs, *rhs;
-        };
-
-        struct Multiply
-        {
-            Expr *lhs, *rhs;
-        };
+    // Parentheses only group, so they leave no node of their own
+    struct Expr
+    {
+        ExprKind kind;
+        Index lhs;
+        Index rhs = None;
+        Index token = None;
 
-        struct Minus
+        static constexpr Expr intLiteral(int64_t value)
         {
-            Expr *lhs, *rhs;
-        };
-
-        struct Divide
+            const auto bits = static_cast<uint64_t>(value);
+            return { .kind = ExprKind::IntLiteral, .lhs = static_cast<Index>(bits), .rhs = static_cast<Index>(bits >> 32) };
+        }
+        [[nodiscard]] constexpr int64_t intValue() const
         {
-            Expr *lhs, *rhs;
-        };
-    }
-
-    using BinExpr = std::variant<BinaryExpr::Add*, BinaryExpr::Multiply*, BinaryExpr::Minus*, BinaryExpr::Divide*>;
-
-    namespace RelationalExpr {
-        struct LessThan {
-            Expr *lhs, *rhs;
-        };
-        struct GreaterThan {
-            Expr *lhs, *rhs;
-        };
-        struct LessThanEqual {
-            Expr *lhs, *rhs;
-        };
-        struct GreaterThanEqual {
-            Expr *lhs, *rhs;
-        };
-    }
-
-    using RelExpr = std::variant<RelationalExpr::LessThan*, RelationalExpr::GreaterThan*, RelationalExpr::LessThanEqual*, RelationalExpr::GreaterThanEqual*>;
+            return static_cast<int64_t>(static_cast<uint64_t>(rhs) << 32 | lhs);
+        }
+    };
 
-    namespace EqualityExpr {
-        struct Equal {
-            Expr *lhs, *rhs;
-        };
-        struct NotEqual {
-            Expr *lhs, *rhs;
-        };
+    [[nodiscard]] constexpr bool isLeaf(ExprKind kind)
+    {
+        return kind == ExprKind::IntLiteral || kind == ExprKind::Identifier;
     }
 
-    using EqlExpr = std::variant<EqualityExpr::Equal*, EqualityExpr::NotEqual*>;
-
-    struct TermParen
+    enum class StmtKind : uint8_t
     {
-        Expr* expr;
+        Return,
+        Let,
+        Scope,
+        If,
+        Assign,
+        While
     };
 
-    using Term = std::variant<IntLiteral*, Identifier*, TermParen*>;
+    // A statement is its kind and the index of its node in the array for that kind
+    struct Stmt
+    {
+        StmtKind kind;
+        Index index;
+    };
 
-    struct Expr
+    struct Scope
     {
-        std::variant<Term*, BinExpr*, EqlExpr*, RelExpr*> expr;
+        // Stable identity, kept when the scope is reparsed after an edit
+        uint32_t id = 0;
+        Range statements = {};
     };
 
-    struct Scope;
     namespace Statement {
-        struct If;
-        struct While;
-
         struct Return
         {
-            Expr* returnExpr;
+            Index returnExpr;
         };
 
+        // identifier is the index of the token naming the variable
         struct Let
         {
-            Token identifier;
-            Expr* letExpr;
+            Index identifier;
+            Index letExpr;
         };
 
         struct Assign
         {
-            Token identifier;
-            Expr* assignExpr;
+            Index identifier;
+            Index assignExpr;
+        };
+
+        // An if and each else if or else after it. An else has no expr, and next is the branch
+        // that follows, if there is one.
+        struct If
+        {
+            Index expr = None;
+            Index scope = None;
+            Index next = None;
+        };
+
+        struct While
+        {
+            Index expr;
+            Index scope;
         };
     }
-    using Stmt = std::variant<Statement::Return*, Statement::Let*, Scope*, Statement::If*, Statement::Assign*, Statement::While*>;
 
-    struct Scope
+    // Read-only view of the arrays of a tree, which may live in a Tree or in a mapped cache file
+    struct TreeView
     {
-        std::vector<Stmt*> statements;
-    };
+        std::span<const Token> tokens;
+        std::span<const Expr> exprs;
+        std::span<const Stmt> statements;
+        std::span<const Statement::Return> returns;
+        std::span<const Statement::Let> lets;
+        std::span<const Statement::Assign> assigns;
+        std::span<const Statement::If> ifs;
+        std::span<const Statement::While> whiles;
+        std::span<const Scope> scopes;
 
-    namespace Statement {
-        struct ElseIf;
-        struct Else;
-    }
-    using IfPredicate = std::variant<Statement::ElseIf*, Statement::Else*>;
+        [[nodiscard]] std::span<const Stmt> list(Range range) const
+        {
+            return statements.subspan(range.first, range.count);
+        }
 
-    namespace Statement {
-        struct ElseIf
+        // Calls visitor with the node stmt refers to
+        template<typename Visitor>
+        void visit(Stmt stmt, Visitor&& visitor) const
         {
-            Expr* expr;
-            Scope* scope;
-            std::optional<IfPredicate*> pred;
-        };
+            switch (stmt.kind)
+            {
+                case StmtKind::Return: visitor(returns[stmt.index]); break;
+                case StmtKind::Let: visitor(lets[stmt.index]); break;
+                case StmtKind::Scope: visitor(scopes[stmt.index]); break;
+                case StmtKind::If: visitor(ifs[stmt.index]); break;
+                case StmtKind::Assign: visitor(assigns[stmt.index]); break;
+                case StmtKind::While: visitor(whiles[stmt.index]); break;
+            }
+        }
+    };
 
-        struct If
+    // The arrays allocate from resource, which the parser points at its arena
+    struct Tree
+    {
+        explicit Tree(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+            tokens(resource), exprs(resource), statements(resource), returns(resource), lets(resource), assigns(resource),
+            ifs(resource), whiles(resource), scopes(resource)
         {
-            Expr* expr;
-            Scope* scope;
-            std::optional<IfPredicate*> pred;
-        };
+        }
 
-        struct Else
+        // Every token stored in a node
+        std::pmr::vector<Token> tokens;
+        std::pmr::vector<Expr> exprs;
+        // The statement list of each scope, and of the program, is a contiguous Range in here
+        std::pmr::vector<Stmt> statements;
+        std::pmr::vector<Statement::Return> returns;
+        std::pmr::vector<Statement::Let> lets;
+        std::pmr::vector<Statement::Assign> assigns;
+        std::pmr::vector<Statement::If> ifs;
+        std::pmr::vector<Statement::While> whiles;
+        std::pmr::vector<Scope> scopes;
+
+        // Sizes of every array, to be truncated back to
+        struct Checkpoint
         {
-            Scope* scope;
+            size_t tokens, exprs, statements, returns, lets, assigns, ifs, whiles, scopes;
         };
 
-        struct While {
-            Expr* expr;
-            Scope* scope;
+        // Nodes of each kind per 100 tokens, a little over what typical programs have, so arrays
+        // reserved from the token count seldom grow. Growing copies an array, and the arena the
+        // parser allocates from never gets the old copy back.
+        static constexpr Checkpoint NodesPer100Tokens{
+            .tokens = 40, .exprs = 45, .statements = 20, .returns = 2, .lets = 7, .assigns = 6, .ifs = 5, .whiles = 2, .scopes = 8
         };
-    }
 
+        // Nodes expected for tokenCount tokens, at one of the ratios above
+        [[nodiscard]] static size_t expected(size_t tokenCount, size_t nodesPer100Tokens)
+        {
+            return (tokenCount * nodesPer100Tokens + 99) / 100;
+        }
+
+        // A tree holding its own copy of the arrays view refers to
+        static Tree copyOf(const TreeView& view)
+        {
+            Tree tree;
+            tree.tokens.assign(view.tokens.begin(), view.tokens.end());
+            tree.exprs.assign(view.exprs.begin(), view.exprs.end());
+            tree.statements.assign(view.statements.begin(), view.statements.end());
+            tree.returns.assign(view.returns.begin(), view.returns.end());
+            tree.lets.assign(view.lets.begin(), view.lets.end());
+            tree.assigns.assign(view.assigns.begin(), view.assigns.end());
+            tree.ifs.assign(view.ifs.begin(), view.ifs.end());
+            tree.whiles.assign(view.whiles.begin(), view.whiles.end());
+            tree.scopes.assign(view.scopes.begin(), view.scopes.end());
+            return tree;
+        }
+
+        template<typename T>
+        static Index add(std::pmr::vector<T>& nodes, T node)
+        {
+            nodes.push_back(node);
+            return static_cast<Index>(nodes.size() - 1);
+        }
+
+        [[nodiscard]] std::span<const Stmt> list(Range range) const
+        {
+            return { statements.data() + range.first, range.count };
+        }
+
+        // Valid until the next node is added
+        [[nodiscard]] TreeView view() const
+        {
+            return { tokens, exprs, statements, returns, lets, assigns, ifs, whiles, scopes };
+        }
+
+        Range addList(std::span<const Stmt> list)
+        {
+            const Range range{ .first = static_cast<Index>(statements.size()), .count = static_cast<uint32_t>(list.size()) };
+            statements.insert(statements.end(), list.begin(), list.end());
+            return range;
+        }
+
+        [[nodiscard]] Checkpoint checkpoint() const
+        {
+            return { tokens.size(), exprs.size(), statements.size(), returns.size(), lets.size(), assigns.size(), ifs.size(), whiles.size(), scopes.size() };
+        }
+
+        [[nodiscard]] size_t nodeCount() const
+        {
+            return tokens.size() + exprs.size() + statements.size() + returns.size() + lets.size() + assigns.size() + ifs.size() +
+                   whiles.size() + scopes.size();
+        }
+
+        // Makes room for the nodes of tokenCount more tokens
+        void reserveFor(size_t tokenCount)
+        {
+            const auto reserve = [&](auto& nodes, size_t per100) { nodes.reserve(nodes.size() + expected(tokenCount, per100)); };
+            reserve(tokens, NodesPer100Tokens.tokens);
+            reserve(exprs, NodesPer100Tokens.exprs);
+            reserve(statements, NodesPer100Tokens.statements);
+            reserve(returns, NodesPer100Tokens.returns);
+            reserve(lets, NodesPer100Tokens.lets);
+            reserve(assigns, NodesPer100Tokens.assigns);
+            reserve(ifs, NodesPer100Tokens.ifs);
+            reserve(whiles, NodesPer100Tokens.whiles);
+            reserve(scopes, NodesPer100Tokens.scopes);
+        }
+
+        // Whether the nodes of tokenCount more tokens fit without any array growing
+        [[nodiscard]] bool hasRoomFor(size_t tokenCount) const
+        {
+            const auto fits = [&](const auto& nodes, size_t per100) { return nodes.capacity() - nodes.size() >= expected(tokenCount, per100); };
+            return fits(tokens, NodesPer100Tokens.tokens) && fits(exprs, NodesPer100Tokens.exprs) &&
+                   fits(statements, NodesPer100Tokens.statements) && fits(returns, NodesPer100Tokens.returns) &&
+                   fits(lets, NodesPer100Tokens.lets) && fits(assigns, NodesPer100Tokens.assigns) && fits(ifs, NodesPer100Tokens.ifs) &&
+                   fits(whiles, NodesPer100Tokens.whiles) && fits(scopes, NodesPer100Tokens.scopes);
+        }
+
+        // Drops every node added since checkpoint. The arrays keep their capacity for reuse.
+        void rewind(const Checkpoint& checkpoint)
+        {
+            tokens.resize(checkpoint.tokens);
+            exprs.resize(checkpoint.exprs);
+            statements.resize(checkpoint.statements);
+            returns.resize(checkpoint.returns);
+            lets.resize(checkpoint.lets);
+            assigns.resize(checkpoint.assigns);
+            ifs.resize(checkpoint.ifs);
+            whiles.resize(checkpoint.whiles);
+            scopes.resize(checkpoint.scopes);
+        }
+
+        // Bytes held by nodes, and bytes held by the arrays including their spare capacity
+        [[nodiscard]] size_t bytesUsed() const
+        {
+            return bytes([](const auto& nodes) { return nodes.size(); });
+        }
+        [[nodiscard]] size_t bytesReserved() const
+        {
+            return bytes([](const auto& nodes) { return nodes.capacity(); });
+        }
+
+    private:
+        template<typename Count>
+        size_t bytes(Count count) const
+        {
+            const auto of = [&](const auto& nodes) { return count(nodes) * sizeof(nodes[0]); };
+            return of(tokens) + of(exprs) + of(statements) + of(returns) + of(lets) + of(assigns) + of(ifs) + of(whiles) + of(scopes);
+        }
+    };
 
     struct Program
     {
-        std::vector<Stmt*> statements;
+        const Tree* tree = nullptr;
+        Range statements;
     };
-}
\ No newline at end of file
+}
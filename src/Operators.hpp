@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Binary operators the parser knows about, indexed by token kind, so parsing an operator is a
+// single table lookup.
+namespace Operators
+{
+    struct BinaryOperator
+    {
+        // Zero, so an entry of the table left as {} is not an operator
+        static constexpr uint8_t NotAnOperator = 0;
+
+        // Higher binds more tightly
+        uint8_t precedence = NotAnOperator;
+        // Kind of the node built for lhs op rhs
+        Node::ExprKind node = Node::ExprKind::Add;
+
+        [[nodiscard]] constexpr bool isOperator() const { return precedence != NotAnOperator; }
+        // Whether an operator of this kind already on the stack is complete when other follows it.
+        // Every operator is left associative, so one of the same precedence is.
+        [[nodiscard]] constexpr bool reducesBefore(const BinaryOperator& other) const
+        {
+            return precedence >= other.precedence;
+        }
+    };
+
+    inline constexpr size_t KindCount = static_cast<size_t>(Token::Kind::Unexpected) + 1;
+
+    constexpr BinaryOperator left(uint8_t precedence, Node::ExprKind node)
+    {
+        return { .precedence = precedence, .node = node };
+    }
+
+    inline constexpr std::array<BinaryOperator, KindCount> Table = [] {
+        std::array<BinaryOperator, KindCount> table{};
+        table[static_cast<size_t>(Token::Kind::EqualsEquals)] = left(1, Node::ExprKind::Equal);
+        table[static_cast<size_t>(Token::Kind::BangEquals)] = left(1, Node::ExprKind::NotEqual);
+        table[static_cast<size_t>(Token::Kind::LessThan)] = left(2, Node::ExprKind::LessThan);
+        table[static_cast<size_t>(Token::Kind::GreaterThan)] = left(2, Node::ExprKind::GreaterThan);
+        table[static_cast<size_t>(Token::Kind::LessThanEquals)] = left(2, Node::ExprKind::LessThanEqual);
+        table[static_cast<size_t>(Token::Kind::GreaterThanEquals)] = left(2, Node::ExprKind::GreaterThanEqual);
+        table[static_cast<size_t>(Token::Kind::Plus)] = left(3, Node::ExprKind::Add);
+        table[static_cast<size_t>(Token::Kind::Minus)] = left(3, Node::ExprKind::Minus);
+        table[static_cast<size_t>(Token::Kind::Asterisk)] = left(4, Node::ExprKind::Multiply);
+        table[static_cast<size_t>(Token::Kind::ForwardSlash)] = left(4, Node::ExprKind::Divide);
+        return table;
+    }();
+
+    constexpr const BinaryOperator& binary(Token::Kind kind)
+    {
+        return Table[static_cast<size_t>(kind)];
+    }
+}
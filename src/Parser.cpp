@@ -1,61 +1,101 @@
+#include <algorithm>
 #include <cassert>
 #include "Parser.hpp"
 #include "Nodes.hpp"
+#include "Operators.hpp"
 
-Parser::Parser(std::vector<Token> tokens, ErrorHandler& errorHandler) :
+Parser::Parser(TokenBuffer tokens, ErrorHandler& errorHandler) :
     m_tokens(std::move(tokens)),
-    m_allocator(1024 * 1024 * 4),
     m_errorHandler(errorHandler)
 {
 }
 
-std::optional<Token> Parser::peek(int64_t offset) const
+Parser::Parser(TokenBlockQueue& blocks, uint32_t fileId, ErrorHandler& errorHandler) :
+    m_tokens(fileId),
+    m_blocks(&blocks),
+    m_errorHandler(errorHandler)
 {
-    if (m_tokenPos + offset >= m_tokens.size())
+}
+
+bool Parser::atEnd(int64_t offset)
+{
+    while (m_tokenPos + offset >= m_tokens.size())
     {
-        return {};
+        if (!pullBlock())
+        {
+            return true;
+        }
     }
-    return m_tokens.at(m_tokenPos + offset);
+    return false;
 }
 
-Token Parser::consume()
+bool Parser::pullBlock()
 {
-    if (m_tokenPos < m_tokens.size()) {
-        return m_tokens.at(m_tokenPos++);
+    if (m_blocks == nullptr)
+    {
+        return false;
     }
-    return Token(Token::Kind::Unexpected, {}, {});
+    auto block = m_blocks->pop();
+    if (!block.has_value())
+    {
+        m_blocks = nullptr;
+        return false;
+    }
+    for (auto& error : block->errors)
+    {
+        m_errorHandler << std::move(error);
+    }
+    block->tokens.remapSymbols(StringInterner::global().merge(block->symbols));
+    // Drop what has already been parsed, keeping the last token as errors are reported against it
+    if (m_tokenPos > 1)
+    {
+        m_tokens.discardFront(m_tokenPos - 1);
+        m_tokenPos = 1;
+        m_discardedTokens = true;
+    }
+    m_tokens.append(block->tokens);
+    return true;
+}
+
+bool Parser::check(Token::Kind tType, int64_t offset)
+{
+    return !atEnd(offset) && m_tokens.kind(m_tokenPos + offset) == tType;
 }
 
-std::optional<Token> Parser::tryConsume(Token::Kind tType)
+Token::Info Parser::infoAt(int64_t offset) const
 {
-    if (peek().has_value() && peek().value().kind() == tType)
+    if (m_tokens.empty())
     {
-        return consume();
+        return { .FileId = m_tokens.fileId(), .Offset = 0 };
     }
-    return {};
+    const auto index = std::clamp<int64_t>(static_cast<int64_t>(m_tokenPos) + offset, 0, static_cast<int64_t>(m_tokens.size()) - 1);
+    return m_tokens.info(index);
 }
 
-std::optional<Token> Parser::tryConsume(const std::vector<Token::Kind>& tTypes, const std::string& error) {
-    std::optional<Token> token;
-    for(const auto t : tTypes) {
-        token = tryConsume(t);
+size_t Parser::consume()
+{
+    if (m_tokenPos < m_tokens.size()) {
+        return m_tokenPos++;
     }
-    if (!token.has_value())
+    return m_tokenPos;
+}
+
+std::optional<size_t> Parser::tryConsume(Token::Kind tType)
+{
+    if (check(tType))
     {
-        if (peek(-1).has_value()) {
-            addError(peek(-1).value().info().value(), error);
-        }
+        return consume();
     }
-    return token;
+    return {};
 }
 
-std::optional<Token> Parser::tryConsume(Token::Kind tType, const std::string& error)
+std::optional<size_t> Parser::tryConsume(Token::Kind tType, std::string_view error)
 {
     auto token = tryConsume(tType);
     if (!token.has_value())
     {
-        if (peek(-1).has_value()) {
-            addError(peek(-1).value().info().value(), error);
+        if (m_tokenPos > 0) {
+            addError(infoAt(-1), error);
         }
     }
     return token;
@@ -63,289 +103,814 @@ std::optional<Token> Parser::tryConsume(Token::Kind tType, const std::string& er
 
 Node::Program Parser::parse()
 {
-    Node::Program program;
-    while (peek().has_value())
+    // Arrays are reserved up front from the token count, as one that grows leaves its old copy
+    // behind in the arena. A pipelined parser doesn't know the count, so its arrays grow as needed.
+    if (m_blocks == nullptr)
     {
+        reserveFor(m_tokens.size());
+    }
+
+    // Nested scopes add their statement lists as they close, so the program's is only added once
+    // every statement has been parsed
+    std::pmr::vector<Node::Stmt> statements(&m_arena);
+    statements.reserve(Node::Tree::expected(m_tokens.size(), Node::Tree::NodesPer100Tokens.statements));
+    while (auto statement = parseNext())
+    {
+        statements.push_back(statement.value());
+    }
+
+    m_tokenPos = 0;
+    m_program = m_tree.addList(statements);
+    m_parsed = m_tree.checkpoint();
+    return { .tree = &m_tree, .statements = m_program };
+}
+
+std::optional<Node::Stmt> Parser::parseNext()
+{
+    while (!atEnd())
+    {
+        if (m_errorHandler.errorLimitReached())
+        {
+            // Give up, and stop the tokeniser too rather than letting it run to the end
+            if (m_blocks != nullptr)
+            {
+                m_blocks->cancel();
+                m_blocks = nullptr;
+            }
+            break;
+        }
         if (!tryConsume(Token::Kind::Comment)) {
-            if (auto statement = parseStatement()) {
-                program.statements.push_back(statement.value());
-            } else {
-                addError(peek().value().info().value(), "Invalid statement.");
+            auto statement = parseStatement();
+            if (!statement) {
+                addError(infoAt(), "Invalid statement.");
+                consume();
+            }
+            synchronise();
+            if (statement) {
+                return statement;
             }
         }
     }
+    return {};
+}
 
-    m_tokenPos = 0;
-    return program;
+Parser::Checkpoint Parser::checkpoint() const
+{
+    return { .arena = m_arena.checkpoint(), .tree = m_tree.checkpoint(), .nodeTokenCount = m_nodeTokens.size(), .scopeSpanCount = m_scopeSpans.size() };
 }
 
-std::optional<Node::Expr*> Parser::parseExpr(int minPrecedence)
+void Parser::rewind(Checkpoint checkpoint)
 {
-    auto termLhs = parseTerm();
-    if (!termLhs.has_value())
+    m_nodeTokens.resize(checkpoint.nodeTokenCount);
+    m_scopeSpans.resize(checkpoint.scopeSpanCount);
+    m_tree.rewind(checkpoint.tree);
+    // An array that grew since the checkpoint has moved to memory after it, so the arena can only
+    // be rewound once nothing is left in them. The work stacks are always empty between statements.
+    if (m_tree.nodeCount() == 0 && m_nodeTokens.empty() && m_scopeSpans.empty())
+    {
+        m_tree = Node::Tree(&m_arena);
+        m_nodeTokens = std::pmr::vector<Node::Index>(&m_arena);
+        m_scopeSpans = std::pmr::vector<ScopeSpan>(&m_arena);
+        m_scopeFrames = std::pmr::vector<ScopeFrame>(&m_arena);
+        m_openStatements = std::pmr::vector<Node::Stmt>(&m_arena);
+        m_exprOperands = std::pmr::vector<Node::Index>(&m_arena);
+        m_exprOperators = decltype(m_exprOperators)(&m_arena);
+        m_arena.rewind(checkpoint.arena);
+    }
+}
+
+const Parser::ScopeSpan* Parser::enclosingScope(uint32_t begin, uint32_t end) const
+{
+    const ScopeSpan* innermost = nullptr;
+    for (const auto& span : m_scopeSpans)
+    {
+        if (span.begin < begin && end < span.end && (innermost == nullptr || span.end - span.begin < innermost->end - innermost->begin))
+        {
+            innermost = &span;
+        }
+    }
+    return innermost;
+}
+
+std::optional<Node::Index> Parser::reparse(std::string_view source, Edit edit)
+{
+    // Spans index the whole token stream, which a pipelined parser doesn't keep
+    const ScopeSpan* enclosing = m_discardedTokens ? nullptr : enclosingScope(edit.begin, edit.oldEnd);
+    if (enclosing == nullptr)
+    {
+        return {};
+    }
+    ScopeSpan old = *enclosing;
+    const int64_t offsetDelta = static_cast<int64_t>(edit.newEnd) - static_cast<int64_t>(edit.oldEnd);
+    const auto newEnd = static_cast<uint32_t>(old.end + offsetDelta);
+
+    Tokeniser tokeniser(source, m_tokens.fileId(), m_errorHandler);
+    auto block = tokeniser.tokeniseSpan(old.begin, newEnd);
+    if (!block.has_value())
+    {
+        return {};
+    }
+
+    // The nodes earlier reparses replaced are compacted away once the new ones wouldn't fit, rather
+    // than letting an array grow and leave its old copy in the arena. Room for a sixteenth of the
+    // file is made after that if it isn't there, so compaction, which walks every live node, stays
+    // rare next to the reparses in between.
+    if (!hasRoomFor(block->tokens.size()))
+    {
+        old.scope = compact(old.scope);
+        reserveFor(std::max(block->tokens.size(), m_tokens.size() / 16));
+    }
+
+    // Parse the new text of the scope on its own, and give up if it isn't exactly one scope
+    block->tokens.remapSymbols(StringInterner::global().merge(block->symbols));
+    const size_t errorCount = m_errorHandler.size();
+    const auto parsed = checkpoint();
+    const size_t nodeTokenCount = parsed.nodeTokenCount;
+    const size_t scopeSpanCount = parsed.scopeSpanCount;
+    const size_t tokenPos = m_tokenPos;
+    std::swap(m_tokens, block->tokens);
+    m_tokenPos = 0;
+    const auto newScope = check(Token::Kind::OpenCurly) ? parseScope() : std::nullopt;
+    m_panicking = false;
+    const bool parsedExactly = newScope.has_value() && m_tokenPos == m_tokens.size();
+    std::swap(m_tokens, block->tokens);
+    m_tokenPos = tokenPos;
+    if (!parsedExactly)
     {
+        m_errorHandler.truncate(errorCount);
+        rewind(parsed);
         return {};
     }
 
-    auto exprLhs = m_allocator.alloc<Node::Expr>();
-    exprLhs->expr = termLhs.value();
+    const size_t newTokenCount = block->tokens.size();
+    const int64_t tokenDelta = static_cast<int64_t>(newTokenCount) - static_cast<int64_t>(old.endToken - old.firstToken);
+    m_tokens.splice(old.firstToken, old.endToken, block->tokens, offsetDelta);
+    m_errorHandler.sources().replaceContent(m_tokens.fileId(), source);
+    for (auto& error : block->errors)
+    {
+        m_errorHandler << std::move(error);
+    }
 
-    while(true)
+    // Swap the node tokens of the old scope body for the new ones, which were stored after every
+    // other, keeping source order, then move everything after the edit along. Both are done in
+    // place, so the arrays never grow here.
+    const auto parsedEnd = m_nodeTokens.begin() + static_cast<ptrdiff_t>(nodeTokenCount);
+    const size_t newNodeTokenCount = m_nodeTokens.size() - nodeTokenCount;
+    const auto byOffset = [this](Node::Index token, uint32_t offset) { return m_tree.tokens[token].info().Offset < offset; };
+    const auto first = std::lower_bound(m_nodeTokens.begin(), parsedEnd, old.begin, byOffset);
+    const auto last = std::lower_bound(first, parsedEnd, old.end, byOffset);
+    std::rotate(last, parsedEnd, m_nodeTokens.end());
+    const auto inserted = m_nodeTokens.erase(first, last);
+    for (auto it = inserted + static_cast<ptrdiff_t>(newNodeTokenCount); it != m_nodeTokens.end(); ++it)
     {
-        std::optional<Token> currentToken = peek();
-        std::optional<uint8_t> precedence;
-        if (currentToken.has_value())
+        m_tree.tokens[*it].relocate(offsetDelta);
+    }
+
+    // The reparsed scope takes the spans of the scopes nested in its new body. Kept spans are
+    // written back over the ones already read.
+    size_t spanCount = 0;
+    for (size_t i = 0; i < scopeSpanCount; ++i)
+    {
+        auto span = m_scopeSpans[i];
+        if (span.scope == old.scope || (span.begin < old.begin && span.end >= old.end))
         {
-            precedence = binaryPrecedence(currentToken->kind());
-            if (!precedence.has_value() || precedence.value() < minPrecedence) {
-                break;
-            }
+            span.end = static_cast<uint32_t>(span.end + offsetDelta);
+            span.endToken += tokenDelta;
         }
-        else
+        else if (span.begin >= old.end)
         {
-            break;
+            span.begin = static_cast<uint32_t>(span.begin + offsetDelta);
+            span.end = static_cast<uint32_t>(span.end + offsetDelta);
+            span.firstToken += tokenDelta;
+            span.endToken += tokenDelta;
         }
-        Token op = consume();
-        auto nextMinPrecedence = precedence.value() + 1;
-        auto exprRhs = parseExpr(nextMinPrecedence);
-        if (!exprRhs.has_value())
+        else if (span.begin > old.begin && span.end < old.end)
         {
-            addError(peek().value().info().value(), "Unable to parse expression");
+            continue;
         }
-        else
+        m_scopeSpans[spanCount++] = span;
+    }
+    // The last span recorded is the new scope itself, which the old one stands in for
+    for (size_t i = scopeSpanCount; i + 1 < m_scopeSpans.size(); ++i)
+    {
+        auto span = m_scopeSpans[i];
+        span.firstToken += old.firstToken;
+        span.endToken += old.firstToken;
+        m_scopeSpans[spanCount++] = span;
+    }
+    m_scopeSpans.resize(spanCount);
+
+    // The old statements are left unreferenced in the tree until a later reparse needs their room
+    m_tree.scopes[old.scope].statements = m_tree.scopes[newScope.value()].statements;
+    return old.scope;
+}
+
+Node::Index Parser::compact(Node::Index scope)
+{
+    // Everything here is scratch, allocated after the tree's arrays and released when done. The
+    // arrays only shrink, so none of them can have moved past the checkpoint.
+    const auto scratch = m_arena.checkpoint();
+
+    // Mark everything reachable from the program's statements
+    std::pmr::vector<bool> liveTokens(m_tree.tokens.size(), false, &m_arena);
+    std::pmr::vector<bool> liveExprs(m_tree.exprs.size(), false, &m_arena);
+    std::pmr::vector<bool> liveStatements(m_tree.statements.size(), false, &m_arena);
+    std::pmr::vector<bool> liveReturns(m_tree.returns.size(), false, &m_arena);
+    std::pmr::vector<bool> liveLets(m_tree.lets.size(), false, &m_arena);
+    std::pmr::vector<bool> liveAssigns(m_tree.assigns.size(), false, &m_arena);
+    std::pmr::vector<bool> liveIfs(m_tree.ifs.size(), false, &m_arena);
+    std::pmr::vector<bool> liveWhiles(m_tree.whiles.size(), false, &m_arena);
+    std::pmr::vector<bool> liveScopes(m_tree.scopes.size(), false, &m_arena);
+    std::pmr::vector<Node::Stmt> statements(&m_arena);
+    std::pmr::vector<Node::Index> exprs(&m_arena);
+    const auto markList = [&](Node::Range range) {
+        std::fill_n(liveStatements.begin() + range.first, range.count, true);
+        const auto list = m_tree.list(range);
+        statements.insert(statements.end(), list.begin(), list.end());
+    };
+    const auto markScope = [&](Node::Index index) {
+        if (index != Node::None)
+        {
+            liveScopes[index] = true;
+            markList(m_tree.scopes[index].statements);
+        }
+    };
+    const auto markExpr = [&](Node::Index expr) {
+        if (expr != Node::None)
         {
-            auto expr = m_allocator.alloc<Node::BinExpr>();
-            auto nodeLhsExpr = m_allocator.alloc<Node::Expr>();
-            if (op.kind() == Token::Kind::Plus)
+            exprs.push_back(expr);
+        }
+    };
+    markList(m_program);
+    while (!statements.empty())
+    {
+        const auto statement = statements.back();
+        statements.pop_back();
+        switch (statement.kind)
+        {
+            case Node::StmtKind::Return:
+                liveReturns[statement.index] = true;
+                markExpr(m_tree.returns[statement.index].returnExpr);
+                break;
+            case Node::StmtKind::Let:
+                liveLets[statement.index] = true;
+                liveTokens[m_tree.lets[statement.index].identifier] = true;
+                markExpr(m_tree.lets[statement.index].letExpr);
+                break;
+            case Node::StmtKind::Assign:
+                liveAssigns[statement.index] = true;
+                liveTokens[m_tree.assigns[statement.index].identifier] = true;
+                markExpr(m_tree.assigns[statement.index].assignExpr);
+                break;
+            case Node::StmtKind::Scope:
+                markScope(statement.index);
+                break;
+            case Node::StmtKind::If:
             {
-                auto addNode = m_allocator.alloc<Node::BinaryExpr::Add>();
-                nodeLhsExpr->expr = exprLhs->expr;
-                addNode->lhs = nodeLhsExpr;
-                addNode->rhs = exprRhs.value();
-                *expr = addNode;
+                liveIfs[statement.index] = true;
+                const auto& branch = m_tree.ifs[statement.index];
+                markExpr(branch.expr);
+                markScope(branch.scope);
+                if (branch.next != Node::None)
+                {
+                    statements.push_back({ Node::StmtKind::If, branch.next });
+                }
+                break;
             }
-            else if (op.kind() == Token::Kind::Asterisk)
+            case Node::StmtKind::While:
+                liveWhiles[statement.index] = true;
+                markExpr(m_tree.whiles[statement.index].expr);
+                markScope(m_tree.whiles[statement.index].scope);
+                break;
+        }
+        while (!exprs.empty())
+        {
+            const auto expr = exprs.back();
+            exprs.pop_back();
+            liveExprs[expr] = true;
+            const auto& node = m_tree.exprs[expr];
+            if (node.kind == Node::ExprKind::Identifier)
             {
-                auto multNode = m_allocator.alloc<Node::BinaryExpr::Multiply>();
-                nodeLhsExpr->expr = exprLhs->expr;
-                multNode->lhs = nodeLhsExpr;
-                multNode->rhs = exprRhs.value();
-                *expr = multNode;
+                liveTokens[node.lhs] = true;
             }
-            else if (op.kind() == Token::Kind::Minus)
+            else if (!Node::isLeaf(node.kind))
             {
-                auto minusNode = m_allocator.alloc<Node::BinaryExpr::Minus>();
-                nodeLhsExpr->expr = exprLhs->expr;
-                minusNode->lhs = nodeLhsExpr;
-                minusNode->rhs = exprRhs.value();
-                *expr = minusNode;
+                if (node.token != Node::None)
+                {
+                    liveTokens[node.token] = true;
+                }
+                exprs.push_back(node.lhs);
+                exprs.push_back(node.rhs);
             }
-            else if (op.kind() == Token::Kind::ForwardSlash)
+        }
+    }
+
+    // Pack the live nodes added since parse() down after the ones it made, returning where each
+    // node went
+    const auto pack = [this](auto& nodes, const std::pmr::vector<bool>& live, size_t kept) {
+        std::pmr::vector<Node::Index> moved(nodes.size(), Node::None, &m_arena);
+        size_t next = kept;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (i < kept)
+            {
+                moved[i] = static_cast<Node::Index>(i);
+            }
+            else if (live[i])
+            {
+                nodes[next] = nodes[i];
+                moved[i] = static_cast<Node::Index>(next++);
+            }
+        }
+        nodes.resize(next);
+        return moved;
+    };
+    const auto tokens = pack(m_tree.tokens, liveTokens, m_parsed.tokens);
+    const auto movedExprs = pack(m_tree.exprs, liveExprs, m_parsed.exprs);
+    const auto movedStatements = pack(m_tree.statements, liveStatements, m_parsed.statements);
+    const auto returns = pack(m_tree.returns, liveReturns, m_parsed.returns);
+    const auto lets = pack(m_tree.lets, liveLets, m_parsed.lets);
+    const auto assigns = pack(m_tree.assigns, liveAssigns, m_parsed.assigns);
+    const auto ifs = pack(m_tree.ifs, liveIfs, m_parsed.ifs);
+    const auto whiles = pack(m_tree.whiles, liveWhiles, m_parsed.whiles);
+    const auto scopes = pack(m_tree.scopes, liveScopes, m_parsed.scopes);
+
+    // Then point every live node at where its children went. Dead nodes from parse() are left
+    // as they are, as nothing reaches them.
+    const auto remap = [](const std::pmr::vector<Node::Index>& moved, Node::Index index) {
+        return index == Node::None ? Node::None : moved[index];
+    };
+    for (size_t i = 0; i < m_tree.exprs.size(); ++i)
+    {
+        auto& node = m_tree.exprs[i];
+        if (i < m_parsed.exprs && !liveExprs[i])
+        {
+            continue;
+        }
+        if (node.kind == Node::ExprKind::Identifier)
+        {
+            node.lhs = tokens[node.lhs];
+        }
+        else if (!Node::isLeaf(node.kind))
+        {
+            node.lhs = movedExprs[node.lhs];
+            node.rhs = movedExprs[node.rhs];
+            node.token = remap(tokens, node.token);
+        }
+    }
+    for (size_t i = 0; i < m_tree.statements.size(); ++i)
+    {
+        auto& statement = m_tree.statements[i];
+        if (i < m_parsed.statements && !liveStatements[i])
+        {
+            continue;
+        }
+        switch (statement.kind)
+        {
+            case Node::StmtKind::Return: statement.index = returns[statement.index]; break;
+            case Node::StmtKind::Let: statement.index = lets[statement.index]; break;
+            case Node::StmtKind::Assign: statement.index = assigns[statement.index]; break;
+            case Node::StmtKind::Scope: statement.index = scopes[statement.index]; break;
+            case Node::StmtKind::If: statement.index = ifs[statement.index]; break;
+            case Node::StmtKind::While: statement.index = whiles[statement.index]; break;
+        }
+    }
+    const auto isLive = [&](const std::pmr::vector<bool>& live, size_t kept, size_t i) {
+        return i >= kept || live[i];
+    };
+    for (size_t i = 0; i < m_tree.returns.size(); ++i)
+    {
+        if (isLive(liveReturns, m_parsed.returns, i))
+        {
+            m_tree.returns[i].returnExpr = remap(movedExprs, m_tree.returns[i].returnExpr);
+        }
+    }
+    for (size_t i = 0; i < m_tree.lets.size(); ++i)
+    {
+        if (isLive(liveLets, m_parsed.lets, i))
+        {
+            m_tree.lets[i].identifier = tokens[m_tree.lets[i].identifier];
+            m_tree.lets[i].letExpr = remap(movedExprs, m_tree.lets[i].letExpr);
+        }
+    }
+    for (size_t i = 0; i < m_tree.assigns.size(); ++i)
+    {
+        if (isLive(liveAssigns, m_parsed.assigns, i))
+        {
+            m_tree.assigns[i].identifier = tokens[m_tree.assigns[i].identifier];
+            m_tree.assigns[i].assignExpr = remap(movedExprs, m_tree.assigns[i].assignExpr);
+        }
+    }
+    for (size_t i = 0; i < m_tree.ifs.size(); ++i)
+    {
+        if (isLive(liveIfs, m_parsed.ifs, i))
+        {
+            auto& branch = m_tree.ifs[i];
+            branch = { .expr = remap(movedExprs, branch.expr), .scope = remap(scopes, branch.scope), .next = remap(ifs, branch.next) };
+        }
+    }
+    for (size_t i = 0; i < m_tree.whiles.size(); ++i)
+    {
+        if (isLive(liveWhiles, m_parsed.whiles, i))
+        {
+            auto& loop = m_tree.whiles[i];
+            loop = { .expr = remap(movedExprs, loop.expr), .scope = remap(scopes, loop.scope) };
+        }
+    }
+    for (size_t i = 0; i < m_tree.scopes.size(); ++i)
+    {
+        auto& range = m_tree.scopes[i].statements;
+        if (isLive(liveScopes, m_parsed.scopes, i))
+        {
+            // An empty list may start anywhere, even past the end
+            range.first = range.count > 0 ? movedStatements[range.first] : 0;
+        }
+    }
+
+    // A token stored by a statement that then failed to parse is dropped along with the rest. Only
+    // live scopes have spans.
+    for (auto& token : m_nodeTokens)
+    {
+        token = tokens[token];
+    }
+    std::erase(m_nodeTokens, Node::None);
+    for (auto& span : m_scopeSpans)
+    {
+        span.scope = scopes[span.scope];
+    }
+    const auto compacted = scopes[scope];
+    m_arena.rewind(scratch);
+    return compacted;
+}
+
+void Parser::reserveFor(size_t tokenCount)
+{
+    m_tree.reserveFor(tokenCount);
+    m_nodeTokens.reserve(m_nodeTokens.size() + Node::Tree::expected(tokenCount, Node::Tree::NodesPer100Tokens.tokens));
+    m_scopeSpans.reserve(m_scopeSpans.size() + Node::Tree::expected(tokenCount, Node::Tree::NodesPer100Tokens.scopes));
+}
+
+bool Parser::hasRoomFor(size_t tokenCount) const
+{
+    return m_tree.hasRoomFor(tokenCount) &&
+           m_nodeTokens.capacity() - m_nodeTokens.size() >= Node::Tree::expected(tokenCount, Node::Tree::NodesPer100Tokens.tokens) &&
+           m_scopeSpans.capacity() - m_scopeSpans.size() >= Node::Tree::expected(tokenCount, Node::Tree::NodesPer100Tokens.scopes);
+}
+
+Node::Index Parser::storeToken(size_t index)
+{
+    const auto token = Node::Tree::add(m_tree.tokens, m_tokens[index]);
+    m_nodeTokens.push_back(token);
+    return token;
+}
+
+std::optional<Node::Index> Parser::parseExpr()
+{
+    // Operator precedence parsing over explicit operand and operator stacks, so the depth of
+    // nesting is bounded by the heap rather than the native stack. An OpenParen on the operator
+    // stack marks a parenthesised sub-expression that hasn't been closed yet.
+    const size_t operandBase = m_exprOperands.size();
+    const size_t operatorBase = m_exprOperators.size();
+    size_t openParens = 0;
+    while (true)
+    {
+        while (tryConsume(Token::Kind::OpenParen))
+        {
+            m_exprOperators.push_back({ Token::Kind::OpenParen });
+            ++openParens;
+        }
+        auto term = parseTerm();
+        if (!term.has_value())
+        {
+            if (m_exprOperators.size() > operatorBase && m_exprOperators.back().kind == Token::Kind::OpenParen)
             {
-                auto divNode = m_allocator.alloc<Node::BinaryExpr::Divide>();
-                nodeLhsExpr->expr = exprLhs->expr;
-                divNode->lhs = nodeLhsExpr;
-                divNode->rhs = exprRhs.value();
-                *expr = divNode;
+                addError(infoAt(-1), "Expected expression after open parenthesis.");
             }
-            else
+            else if (m_exprOperands.size() > operandBase)
             {
-                assert(false);
+                // The dangling operator is dropped, keeping the expression parsed before it
+                addError(infoAt(), "Unable to parse expression");
+                m_exprOperators.pop_back();
+                break;
             }
-            exprLhs->expr = expr;
+            m_exprOperands.resize(operandBase);
+            m_exprOperators.resize(operatorBase);
+            return {};
         }
+        m_exprOperands.push_back(term.value());
+
+        while (openParens > 0 && tryConsume(Token::Kind::CloseParen))
+        {
+            closeParen();
+            --openParens;
+        }
+
+        if (atEnd())
+        {
+            break;
+        }
+        const Token::Kind op = m_tokens.kind(m_tokenPos);
+        const auto& binary = Operators::binary(op);
+        if (!binary.isOperator())
+        {
+            break;
+        }
+        // Kept for diagnostics about the operation, such as a division by zero
+        const auto token = storeToken(consume());
+        // Everything already on the stack that binds at least as tightly is complete
+        while (m_exprOperators.size() > operatorBase
+            && m_exprOperators.back().kind != Token::Kind::OpenParen
+            && Operators::binary(m_exprOperators.back().kind).reducesBefore(binary))
+        {
+            reduceExpr();
+        }
+        m_exprOperators.push_back({ op, token });
     }
-    return exprLhs;
+
+    while (m_exprOperators.size() > operatorBase)
+    {
+        if (m_exprOperators.back().kind == Token::Kind::OpenParen)
+        {
+            addError(infoAt(-1), "Expected close parenthesis.");
+            closeParen();
+        }
+        else
+        {
+            reduceExpr();
+        }
+    }
+    const auto expr = m_exprOperands.back();
+    m_exprOperands.resize(operandBase);
+    return expr;
+}
+
+void Parser::reduceExpr()
+{
+    const auto op = m_exprOperators.back();
+    m_exprOperators.pop_back();
+    auto rhs = m_exprOperands.back();
+    m_exprOperands.pop_back();
+    m_exprOperands.back() = Node::Tree::add(m_tree.exprs, { .kind = Operators::binary(op.kind).node, .lhs = m_exprOperands.back(), .rhs = rhs, .token = op.token });
 }
 
-std::optional<Node::Stmt*> Parser::parseStatement()
+void Parser::closeParen()
+{
+    while (m_exprOperators.back().kind != Token::Kind::OpenParen)
+    {
+        reduceExpr();
+    }
+    m_exprOperators.pop_back();
+}
+
+std::optional<Node::Stmt> Parser::parseStatement()
+{
+    const size_t base = m_scopeFrames.size();
+    auto stmt = startStatement();
+    parseOpenScopes(base);
+    return stmt;
+}
+
+std::optional<Node::Stmt> Parser::startStatement()
 {
-    auto stmt = m_allocator.alloc<Node::Stmt>();
     if (tryConsume(Token::Kind::Return)) {
-        auto nodeReturn = m_allocator.alloc<Node::Statement::Return>();
-        if (auto nodeExpr = parseExpr()) {
-            nodeReturn->returnExpr = nodeExpr.value();
-        } else {
-            addError(peek().value().info().value(), "Invalid expression after return.");
+        auto nodeExpr = parseExpr();
+        if (!nodeExpr) {
+            addError(infoAt(), "Invalid expression after return.");
         }
 
         tryConsume(Token::Kind::SemiColon, "Expected ; after expression.");
-        *stmt = nodeReturn;
-        return stmt;
-    } else if (
-            peek().has_value() && peek().value().kind() == Token::Kind::Let &&
-            peek(1).has_value() && peek(1).value().kind() == Token::Kind::Identifier &&
-            peek(2).has_value() && peek(2).value().kind() == Token::Kind::Equals
-    ) {
+        return Node::Stmt{ Node::StmtKind::Return, Node::Tree::add(m_tree.returns, { .returnExpr = nodeExpr.value_or(Node::None) }) };
+    } else if (check(Token::Kind::Let) && check(Token::Kind::Identifier, 1) && check(Token::Kind::Equals, 2)) {
         consume();
-        auto letStatement = m_allocator.alloc<Node::Statement::Let>();
-        letStatement->identifier = consume();
+        const auto identifier = storeToken(consume());
         consume(); // consume equals
-        if (auto expr = parseExpr()) {
-            letStatement->letExpr = expr.value();
-        } else {
-            addError(peek().value().info().value(), "Invalid expression in variable definition.");
+        auto expr = parseExpr();
+        if (!expr) {
+            addError(infoAt(), "Invalid expression in variable definition.");
         }
 
         tryConsume(Token::Kind::SemiColon, "Expected ; after expression.");
-        *stmt = letStatement;
-        return stmt;
-    } else if(
-            peek().has_value() && peek().value().kind() == Token::Kind::Identifier &&
-            peek(1).has_value() && peek(1).value().kind() == Token::Kind::Equals
-    ) {
-        auto assignStatement = m_allocator.alloc<Node::Statement::Assign>();
-        assignStatement->identifier = consume();
+        return Node::Stmt{ Node::StmtKind::Let, Node::Tree::add(m_tree.lets, { .identifier = identifier, .letExpr = expr.value_or(Node::None) }) };
+    } else if (check(Token::Kind::Identifier) && check(Token::Kind::Equals, 1)) {
+        const auto identifier = storeToken(consume());
         consume(); // consume equals
-        if (auto expr = parseExpr()) {
-            assignStatement->assignExpr = expr.value();
-        } else {
-            addError(peek().value().info().value(), "Invalid expression in variable assignment.");
+        auto expr = parseExpr();
+        if (!expr) {
+            addError(infoAt(), "Invalid expression in variable assignment.");
         }
 
         tryConsume(Token::Kind::SemiColon, "Expected ; after expression.");
-        *stmt = assignStatement;
-        return stmt;
-    } else if (peek().has_value() && peek().value().kind() == Token::Kind::OpenCurly) {
-        if (auto scope = parseScope()) {
-            *stmt = scope.value();
-            return stmt;
-        }
-        else
-        {
-            addError(peek().value().info().value(), "Invalid scope.");
-        }
+        return Node::Stmt{ Node::StmtKind::Assign, Node::Tree::add(m_tree.assigns, { .identifier = identifier, .assignExpr = expr.value_or(Node::None) }) };
+    } else if (check(Token::Kind::OpenCurly)) {
+        // The scope's statements are filled in once its } is reached, and stay empty if it never is
+        return Node::Stmt{ Node::StmtKind::Scope, openScope().value() };
     }
     else if (auto ifStatement = tryConsume(Token::Kind::If))
     {
         tryConsume(Token::Kind::OpenParen, "Expected ( after if");
-        auto ifStmt = m_allocator.alloc<Node::Statement::If>();
-        if (auto expr = parseExpr())
-        {
-            ifStmt->expr = expr.value();
-        }
+        const auto expr = parseExpr();
         tryConsume(Token::Kind::CloseParen, "Expected ) after if expression");
-        if (auto scope = parseScope())
+        const auto ifBranch = Node::Tree::add(m_tree.ifs, { .expr = expr.value_or(Node::None) });
+        // Any else is parsed once the scope is closed
+        if (const auto scope = openScope(ifBranch))
         {
-            ifStmt->scope = scope.value();
+            m_tree.ifs[ifBranch].scope = scope.value();
         }
         else
         {
-            if (peek().has_value()) {
-                addError(peek().value().info().value(), "Invalid scope.");
-            }
+            parseIfPredicate(ifBranch);
         }
-        ifStmt->pred = parseIfPredicate();
-
-        *stmt = ifStmt;
-        return stmt;
-    } else if (auto whileStatement = tryConsume(Token::Kind::While)) {
-        // TODO: Parse while statement
+        return Node::Stmt{ Node::StmtKind::If, ifBranch };
+    } else if (tryConsume(Token::Kind::While)) {
+        tryConsume(Token::Kind::OpenParen, "Expected ( after while");
+        const auto expr = parseExpr();
+        tryConsume(Token::Kind::CloseParen, "Expected ) after while expression");
+        const auto whileLoop = Node::Tree::add(m_tree.whiles, { .expr = expr.value_or(Node::None), .scope = Node::None });
+        if (const auto scope = openScope())
+        {
+            m_tree.whiles[whileLoop].scope = scope.value();
+        }
+        return Node::Stmt{ Node::StmtKind::While, whileLoop };
     }
     // Return nothing which indicates an invalid statement
     return {};
 }
 
-std::optional<Node::Term*> Parser::parseTerm()
+std::optional<Node::Index> Parser::parseTerm()
 {
     if (auto intLit = tryConsume(Token::Kind::IntLit))
     {
-        auto expr = m_allocator.alloc<Node::IntLiteral>();
-        expr->intLit = intLit.value();
-        auto term = m_allocator.alloc<Node::Term>();
-        *term = expr;
-        return term;
+        return Node::Tree::add(m_tree.exprs, Node::Expr::intLiteral(m_tokens.intValue(intLit.value())));
     }
     else if (auto ident = tryConsume(Token::Kind::Identifier))
     {
-        auto expr = m_allocator.alloc<Node::Identifier>();
-        expr->identifier = ident.value();
-        auto term = m_allocator.alloc<Node::Term>();
-        *term = expr;
-        return term;
-    }
-    else if (auto openParen = tryConsume(Token::Kind::OpenParen))
-    {
-        auto expr = parseExpr();
-        if (!expr.has_value())
-        {
-            addError(peek(-1).value().info().value(), "Expected expression after open parenthesis.");
-        }
-        tryConsume(Token::Kind::CloseParen, "Expected close parenthesis.");
-        auto termParen = m_allocator.alloc<Node::TermParen>();
-        termParen->expr = expr.value();
-        auto term = m_allocator.alloc<Node::Term>();
-        *term = termParen;
-        return term;
+        return Node::Tree::add(m_tree.exprs, { .kind = Node::ExprKind::Identifier, .lhs = storeToken(ident.value()) });
     }
     return {};
 }
 
-std::optional<Node::Scope *> Parser::parseScope()
+std::optional<Node::Index> Parser::parseScope()
 {
-    if (!tryConsume(Token::Kind::OpenCurly, "Expected }"))
+    const size_t base = m_scopeFrames.size();
+    const auto scope = openScope();
+    if (!scope)
     {
         return {};
     }
-    auto scope = m_allocator.alloc<Node::Scope>();
-    while (auto stmt = parseStatement()) {
-        scope->statements.push_back(stmt.value());
+    parseOpenScopes(base);
+    // Abandoned if the input ran out before its }
+    if (m_scopeSpans.empty() || m_scopeSpans.back().scope != scope.value())
+    {
+        return {};
     }
-    if (!tryConsume(Token::Kind::CloseCurly, "Expected }"))
+    return scope;
+}
+
+std::optional<Node::Index> Parser::openScope(Node::Index ifBranch)
+{
+    const auto openCurly = tryConsume(Token::Kind::OpenCurly, "Expected {");
+    if (!openCurly)
     {
         return {};
     }
+    // A { is as good a place to recover as any
+    m_panicking = false;
+    const auto scope = Node::Tree::add(m_tree.scopes, { .id = m_nextScopeId++ });
+    // The offset is read now, as a pipelined parser may have dropped the token by the time the
+    // scope ends
+    m_scopeFrames.push_back({
+        .scope = scope,
+        .ifBranch = ifBranch,
+        .begin = m_tokens.offset(openCurly.value()),
+        .firstToken = openCurly.value(),
+        .statementBase = m_openStatements.size()
+    });
     return scope;
 }
 
-void Parser::addError(Token::Info info, std::string message)
+void Parser::parseOpenScopes(size_t base)
 {
-    consume();
-    const auto error = makeError(info, message);
-    m_errorHandler << error;
+    while (m_scopeFrames.size() > base)
+    {
+        if (const auto closeCurly = tryConsume(Token::Kind::CloseCurly))
+        {
+            const auto frame = m_scopeFrames.back();
+            m_scopeFrames.pop_back();
+            const auto statements = std::span(m_openStatements).subspan(frame.statementBase);
+            m_tree.scopes[frame.scope].statements = m_tree.addList(statements);
+            m_openStatements.resize(frame.statementBase);
+            m_scopeSpans.push_back({
+                .begin = frame.begin,
+                .end = m_tokens.offset(closeCurly.value()) + 1,
+                .firstToken = frame.firstToken,
+                .endToken = closeCurly.value() + 1,
+                .scope = frame.scope
+            });
+            if (frame.ifBranch != Node::None)
+            {
+                parseIfPredicate(frame.ifBranch);
+            }
+            continue;
+        }
+
+        if (atEnd() || m_errorHandler.errorLimitReached())
+        {
+            // Every scope still open is abandoned, leaving it empty
+            if (atEnd())
+            {
+                addError(infoAt(), "Expected }");
+            }
+            m_openStatements.resize(m_scopeFrames[base].statementBase);
+            m_scopeFrames.resize(base);
+            return;
+        }
+
+        // Statements that open a scope of their own push a frame, which is parsed before this one
+        // carries on. The statement's slot is taken first, so that scope's statements go after it.
+        const size_t slot = m_openStatements.size();
+        m_openStatements.emplace_back();
+        if (auto stmt = startStatement())
+        {
+            m_openStatements[slot] = stmt.value();
+        }
+        else
+        {
+            m_openStatements.pop_back();
+            addError(infoAt(), "Invalid statement.");
+            consume();
+        }
+        synchronise();
+    }
 }
 
-std::optional<Node::IfPredicate*> Parser::parseIfPredicate() {
+void Parser::addError(Token::Info info, std::string_view message)
+{
+    // Only the first error is reported until the parser has synchronised, as the rest tend to be
+    // knock-on effects of it
+    if (m_panicking)
+    {
+        return;
+    }
+    m_panicking = true;
+    // The tokeniser has already reported a character it couldn't make a token of
+    if (check(Token::Kind::Unexpected))
+    {
+        return;
+    }
+    m_errorHandler << makeError(info, std::string(message));
+}
 
-    if (tryConsume(Token::Kind::Else)) {
-        auto ifPredicate = m_allocator.alloc<Node::IfPredicate>();
+void Parser::synchronise()
+{
+    if (!m_panicking)
+    {
+        return;
+    }
+    // Skip to the end of the broken statement: just past a ;, or up to a } or the keyword that
+    // starts the next statement
+    while (!atEnd())
+    {
+        const Token::Kind kind = m_tokens.kind(m_tokenPos);
+        if (kind == Token::Kind::SemiColon)
+        {
+            consume();
+            break;
+        }
+        if (kind == Token::Kind::CloseCurly || kind == Token::Kind::Return || kind == Token::Kind::Let
+            || kind == Token::Kind::If || kind == Token::Kind::While || kind == Token::Kind::For)
+        {
+            break;
+        }
+        consume();
+    }
+    m_panicking = false;
+}
+
+void Parser::parseIfPredicate(Node::Index ifBranch)
+{
+    // An else if whose scope opens returns straight away, and its own else is parsed when that
+    // scope closes. Only an else if without a scope carries on round the loop.
+    while (tryConsume(Token::Kind::Else)) {
         if (tryConsume(Token::Kind::If)) {
             tryConsume(Token::Kind::OpenParen, "Expected ( after if");
-            auto elseIfStmt = m_allocator.alloc<Node::Statement::ElseIf>();
-            if (auto expr = parseExpr())
-            {
-                elseIfStmt->expr = expr.value();
-            }
+            const auto expr = parseExpr();
             tryConsume(Token::Kind::CloseParen, "Expected ) after if expression");
-            if (auto scope = parseScope())
+            const auto elseIfBranch = Node::Tree::add(m_tree.ifs, { .expr = expr.value_or(Node::None) });
+            m_tree.ifs[ifBranch].next = elseIfBranch;
+            if (const auto scope = openScope(elseIfBranch))
             {
-                elseIfStmt->scope = scope.value();
+                m_tree.ifs[elseIfBranch].scope = scope.value();
+                return;
             }
-            else
-            {
-                if (peek().has_value()) {
-                    addError(peek().value().info().value(), "Invalid scope.");
-                }
-            }
-            elseIfStmt->pred = parseIfPredicate();
-
-            *ifPredicate = elseIfStmt;
+            ifBranch = elseIfBranch;
         } else {
-            auto elseStmt = m_allocator.alloc<Node::Statement::Else>();
-            if (auto scope = parseScope())
-            {
-                elseStmt->scope = scope.value();
-            }
-            else
+            const auto elseBranch = Node::Tree::add(m_tree.ifs, {});
+            m_tree.ifs[ifBranch].next = elseBranch;
+            if (const auto scope = openScope())
             {
-                if (peek().has_value()) {
-                    addError(peek().value().info().value(), "Invalid scope.");
-                }
+                m_tree.ifs[elseBranch].scope = scope.value();
             }
-            *ifPredicate = elseStmt;
+            return;
         }
-        return ifPredicate;
     }
-    return {};
 }
-
@@ -2,34 +2,157 @@
 
 #include <variant>
 #include "../lib/Tokeniser.hpp"
+#include "../lib/TokenBuffer.hpp"
 #include "ArenaAllocator.hpp"
 #include "Nodes.hpp"
 
 class Parser
 {
 public:
-    explicit Parser(std::vector<Token> tokens, ErrorHandler& errorHandler);
+    // Where a Node::Scope sits in the source and in the token stream, from its { to just past its }
+    struct ScopeSpan
+    {
+        uint32_t begin;
+        uint32_t end;
+        size_t firstToken;
+        size_t endToken;
+        Node::Index scope;
+    };
+
+    // A replacement of the old source bytes [begin, oldEnd) with the new bytes [begin, newEnd)
+    struct Edit
+    {
+        uint32_t begin;
+        uint32_t oldEnd;
+        uint32_t newEnd;
+    };
+
+    struct Checkpoint
+    {
+        ArenaAllocator::Checkpoint arena;
+        Node::Tree::Checkpoint tree;
+        size_t nodeTokenCount;
+        size_t scopeSpanCount;
+    };
+
+    explicit Parser(TokenBuffer tokens, ErrorHandler& errorHandler);
+    // Pulls tokens from a tokeniser running on another thread as the parser needs them. Only the
+    // unparsed part of the current block is kept, so the token stream never has to fit in memory.
+    Parser(TokenBlockQueue& blocks, uint32_t fileId, ErrorHandler& errorHandler);
 
     Node::Program parse();
 
+    // Parses the next top-level statement, or returns nothing at the end of the input. Rewinding to
+    // a checkpoint taken before the call releases the statement and everything it points to. When
+    // that leaves the tree empty, as between statements in stream mode, the arena is rewound too.
+    std::optional<Node::Stmt> parseNext();
+    [[nodiscard]] Checkpoint checkpoint() const;
+    void rewind(Checkpoint checkpoint);
+
+    // Innermost scope that contains [begin, end) without touching its braces
+    [[nodiscard]] const ScopeSpan* enclosingScope(uint32_t begin, uint32_t end) const;
+
+    // After parse(), applies an edit by relexing and reparsing only the innermost scope around it.
+    // The scope keeps its identity and is updated in place, so the program returned by parse()
+    // stays valid, and every other node is reused. Once the replaced nodes leave no room for new
+    // ones they are compacted away, which may move scopes added by earlier reparses; the index
+    // returned is the scope's current one. source is the whole edited file, which
+    // diagnostics are resolved against from then on. Returns nothing, leaving the tree untouched,
+    // if the edit is not inside a scope or changes the scope's extent; the file then needs parsing
+    // afresh.
+    std::optional<Node::Index> reparse(std::string_view source, Edit edit);
+
+    // The tree every node is added to
+    [[nodiscard]] const Node::Tree& tree() const { return m_tree; }
+    // The arena the tree and the parser's own arrays are allocated in, for its statistics
+    [[nodiscard]] const ArenaAllocator& arena() const { return m_arena; }
+
 private:
-    [[nodiscard]] std::optional<Token> peek(int64_t offset = 0) const;
-    Token consume();
-    std::optional<Token> tryConsume(const std::vector<Token::Kind>& tTypes, const std::string& error);
-    std::optional<Token> tryConsume(Token::Kind tType, const std::string& error);
-    std::optional<Token> tryConsume(Token::Kind tType);
+    // The parser only ever looks at token kinds through the cursor; tokens are materialised
+    // when they are stored in a node
+    [[nodiscard]] bool atEnd(int64_t offset = 0);
+    [[nodiscard]] bool check(Token::Kind tType, int64_t offset = 0);
+    // Location of the token at offset from the cursor, clamped to the stream so errors at the
+    // end of the input still have a position
+    [[nodiscard]] Token::Info infoAt(int64_t offset = 0) const;
+    size_t consume();
+    std::optional<size_t> tryConsume(Token::Kind tType, std::string_view error);
+    std::optional<size_t> tryConsume(Token::Kind tType);
 
-    void addError(Token::Info info, std::string message);
+    // Reports an error and enters panic mode, in which further errors are dropped
+    void addError(Token::Info info, std::string_view message);
+    // Leaves panic mode by skipping to where the next statement should start
+    void synchronise();
+    // Takes the next block from the tokeniser, returning false once the stream has ended
+    bool pullBlock();
+    // Copies the token at index into the tree, remembering it so it can be relocated after an edit
+    Node::Index storeToken(size_t index);
+    // Makes room in the tree, and in the arrays indexing it, for the nodes of tokenCount more
+    // tokens, or checks there is some without growing anything
+    void reserveFor(size_t tokenCount);
+    [[nodiscard]] bool hasRoomFor(size_t tokenCount) const;
+    // Drops the nodes that reparsing has left unreferenced. Nodes from parse() never move, so the
+    // program it returned and the scopes in it stay valid; those added since are packed down after
+    // them in their original order. Returns where scope went.
+    Node::Index compact(Node::Index scope);
 
-    std::optional<Node::Term*> parseTerm();
-    std::optional<Node::Expr*> parseExpr(int minPrecedence = 0);
-    std::optional<Node::Stmt*> parseStatement();
-    std::optional<Node::Scope*> parseScope();
-    std::optional<Node::IfPredicate*> parseIfPredicate();
+    std::optional<Node::Index> parseTerm();
+    std::optional<Node::Index> parseExpr();
+    // Pops the top operator and its two operands, pushing the node built from them
+    void reduceExpr();
+    // Reduces back to the innermost open parenthesis
+    void closeParen();
+    std::optional<Node::Stmt> parseStatement();
+    // Parses a statement up to the { of any scope it opens, leaving the scope on the frame stack
+    std::optional<Node::Stmt> startStatement();
+    std::optional<Node::Index> parseScope();
+    // Adds a scope for the { at the cursor and pushes a frame for it, which is filled in when its }
+    // is reached. Once it is, any else after the if branch ifBranch is parsed. Returns the scope.
+    std::optional<Node::Index> openScope(Node::Index ifBranch = Node::None);
+    // Parses statements until every scope frame above base has been closed
+    void parseOpenScopes(size_t base);
+    // Parses any else or else if following ifBranch and chains it on
+    void parseIfPredicate(Node::Index ifBranch);
 
 private:
-    const std::vector<Token> m_tokens;
+    TokenBuffer m_tokens;
     size_t m_tokenPos = 0;
-    ArenaAllocator m_allocator;
+    TokenBlockQueue* m_blocks = nullptr;
+    bool m_discardedTokens = false;
+    // Declared before everything allocated from it, so it's destroyed after
+    ArenaAllocator m_arena;
+    Node::Tree m_tree{ &m_arena };
+    // Index of every token stored in the tree, in source order, and every scope parsed
+    std::pmr::vector<Node::Index> m_nodeTokens{ &m_arena };
+    std::pmr::vector<ScopeSpan> m_scopeSpans{ &m_arena };
+    // The program's statements, and the tree as parse() left it
+    Node::Range m_program;
+    Node::Tree::Checkpoint m_parsed{};
+    uint32_t m_nextScopeId = 0;
+    bool m_panicking = false;
+    // Explicit work stacks, so nesting depth is limited by memory rather than the native stack
+    struct ScopeFrame
+    {
+        Node::Index scope;
+        // The if or else if branch whose else is parsed once the scope is closed, or None
+        Node::Index ifBranch;
+        uint32_t begin;
+        size_t firstToken;
+        // Where the scope's statements start in m_openStatements
+        size_t statementBase;
+    };
+    std::pmr::vector<ScopeFrame> m_scopeFrames{ &m_arena };
+    // Statements of every open scope, innermost last, until the scope closes and they are copied
+    // into the tree together
+    std::pmr::vector<Node::Stmt> m_openStatements{ &m_arena };
+    std::pmr::vector<Node::Index> m_exprOperands{ &m_arena };
+    // An operator waiting for its rhs, with the index of its token in the tree. An open parenthesis
+    // has no token.
+    struct PendingOperator
+    {
+        Token::Kind kind;
+        Node::Index token = Node::None;
+    };
+    std::pmr::vector<PendingOperator> m_exprOperators{ &m_arena };
     ErrorHandler& m_errorHandler;
 };
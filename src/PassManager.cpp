@@ -0,0 +1,214 @@
+#include "PassManager.hpp"
+#include "Passes.hpp"
+#include "IrBuilder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+
+namespace
+{
+    const std::array Registry = {
+        PassInfo{
+            .name = "fold-ast",
+            .description = "Fold operations on literals in the syntax tree before it's lowered",
+            .invalidates = AnalysisCache::None,
+            .runAst = Passes::foldTree
+        },
+        PassInfo{
+            .name = "fold",
+            .description = "Fold constant expressions and simplify algebraic identities",
+            .invalidates = AnalysisCache::None,
+            .runIr = Passes::fold
+        },
+        PassInfo{
+            .name = "mem2reg",
+            .description = "Promote variables to registers, removing their loads, stores and copies",
+            .invalidates = AnalysisCache::None,
+            .runIr = Passes::promoteVariables
+        },
+        PassInfo{
+            .name = "sccp",
+            .description = "Propagate constants through variables and control flow, pruning branches that can't be taken",
+            .invalidates = AnalysisCache::Dominators,
+            .runIr = Passes::propagateConstants
+        },
+        PassInfo{
+            .name = "gvn",
+            .description = "Reuse values computed or loaded earlier on every path instead of working them out again",
+            .invalidates = AnalysisCache::None,
+            .runIr = Passes::numberValues
+        },
+        PassInfo{
+            .name = "licm",
+            .description = "Hoist what loops compute the same every time round into a preheader",
+            .invalidates = AnalysisCache::Dominators,
+            .runIr = Passes::hoistInvariants
+        },
+        PassInfo{
+            .name = "dce",
+            .description = "Remove unreachable code, dead stores and unused variables",
+            .invalidates = AnalysisCache::Dominators,
+            .runIr = Passes::eliminateDeadCode
+        },
+        PassInfo{
+            .name = "simplify-cfg",
+            .description = "Remove unreachable blocks, thread jumps and merge straight-line blocks",
+            .invalidates = AnalysisCache::Dominators,
+            .runIr = Passes::simplifyCfg
+        },
+        PassInfo{
+            .name = "verify",
+            .description = "Check the IR is well formed",
+            .invalidates = AnalysisCache::None,
+            .runIr = Passes::verify
+        },
+    };
+}
+
+const Ir::DominatorTree& AnalysisCache::dominators()
+{
+    if (!m_dominators)
+    {
+        m_dominators.emplace(m_function);
+        ++m_computeCount;
+    }
+    return m_dominators.value();
+}
+
+void AnalysisCache::invalidate(uint32_t analyses)
+{
+    if (analyses & Dominators)
+    {
+        m_dominators.reset();
+    }
+}
+
+std::span<const PassInfo> PassManager::passes()
+{
+    return Registry;
+}
+
+const PassInfo* PassManager::find(std::string_view name)
+{
+    const auto it = std::find_if(Registry.begin(), Registry.end(), [&](const PassInfo& pass) { return pass.name == name; });
+    return it == Registry.end() ? nullptr : &*it;
+}
+
+PassManager PassManager::forLevel(int level)
+{
+    PassManager manager;
+    if (level <= 0)
+    {
+        return manager;
+    }
+    manager.add(*find("fold-ast"));
+    manager.add(*find("mem2reg"));
+    manager.add(*find("sccp"));
+    if (level >= 2)
+    {
+        manager.add(*find("gvn"));
+        manager.add(*find("licm"));
+    }
+    manager.add(*find("fold"));
+    manager.add(*find("dce"));
+    manager.add(*find("simplify-cfg"));
+    return manager;
+}
+
+std::optional<int> PassManager::parseLevel(std::string_view text)
+{
+    int level = 0;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), level);
+    if (ec != std::errc() || end != text.data() + text.size() || level < 0 || level > MaxLevel)
+    {
+        return {};
+    }
+    return level;
+}
+
+std::optional<PassManager> PassManager::parse(std::string_view names, std::string& error)
+{
+    PassManager manager;
+    bool loweredYet = false;
+    while (!names.empty())
+    {
+        const auto comma = names.find(',');
+        const auto name = names.substr(0, comma);
+        names = comma == std::string_view::npos ? std::string_view() : names.substr(comma + 1);
+        if (name.empty())
+        {
+            continue;
+        }
+        const PassInfo* pass = find(name);
+        if (pass == nullptr || (pass->runAst != nullptr && loweredYet))
+        {
+            error = name;
+            return {};
+        }
+        loweredYet = loweredYet || pass->runIr != nullptr;
+        manager.add(*pass);
+    }
+    return manager;
+}
+
+void PassManager::add(const PassInfo& pass)
+{
+    m_passes.push_back(&pass);
+}
+
+Ir::Function PassManager::run(Node::TreeView tree, Node::Range program, ErrorHandler& errors)
+{
+    using Clock = std::chrono::steady_clock;
+    size_t next = 0;
+
+    // AST passes rewrite the tree, so they get a copy of it
+    std::optional<Node::Tree> rewritten;
+    for (; next < m_passes.size() && m_passes[next]->runAst != nullptr; ++next)
+    {
+        if (!rewritten)
+        {
+            rewritten = Node::Tree::copyOf(tree);
+        }
+        AstPassContext context{ .tree = rewritten.value(), .program = program, .errors = errors };
+        const auto start = Clock::now();
+        const bool changed = m_passes[next]->runAst(context);
+        record(m_passes[next]->name, Clock::now() - start, changed);
+    }
+    if (rewritten)
+    {
+        tree = rewritten->view();
+    }
+
+    const auto start = Clock::now();
+    IrBuilder builder(tree, errors);
+    auto function = builder.build(program);
+    record("lower", Clock::now() - start, true);
+
+    AnalysisCache analyses(function);
+    for (; next < m_passes.size(); ++next)
+    {
+        const auto& pass = *m_passes[next];
+        IrPassContext context{ .function = function, .analyses = analyses, .errors = errors };
+        const auto passStart = Clock::now();
+        const bool changed = pass.runIr(context);
+        if (changed)
+        {
+            analyses.invalidate(pass.invalidates);
+        }
+        record(pass.name, Clock::now() - passStart, changed);
+    }
+    return function;
+}
+
+void PassManager::record(std::string_view name, std::chrono::nanoseconds time, bool changed)
+{
+    auto it = std::find_if(m_timings.begin(), m_timings.end(), [&](const Timing& timing) { return timing.name == name; });
+    if (it == m_timings.end())
+    {
+        it = m_timings.insert(it, { .name = name });
+    }
+    it->time += time;
+    ++it->runs;
+    it->changes += changed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Ir.hpp"
+#include "IrAnalysis.hpp"
+#include "Nodes.hpp"
+
+#include <CompilerError.hpp>
+
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Analyses of a function that passes share. Each is computed when first asked for and kept until
+// a pass that invalidates it changes the function.
+class AnalysisCache
+{
+public:
+    enum Analysis : uint32_t
+    {
+        None = 0,
+        Dominators = 1 << 0,
+        All = ~0u
+    };
+
+    explicit AnalysisCache(const Ir::Function& function) : m_function(function) {}
+
+    const Ir::DominatorTree& dominators();
+    void invalidate(uint32_t analyses);
+    // How many times any analysis has been computed
+    [[nodiscard]] size_t computeCount() const { return m_computeCount; }
+
+private:
+    const Ir::Function& m_function;
+    std::optional<Ir::DominatorTree> m_dominators;
+    size_t m_computeCount = 0;
+};
+
+// What a pass works on. AST passes run on a copy of the tree before it's lowered, IR passes on
+// the lowered function.
+struct AstPassContext
+{
+    Node::Tree& tree;
+    Node::Range& program;
+    ErrorHandler& errors;
+};
+
+struct IrPassContext
+{
+    Ir::Function& function;
+    AnalysisCache& analyses;
+    ErrorHandler& errors;
+};
+
+struct PassInfo
+{
+    std::string_view name;
+    std::string_view description;
+    // The analyses a run that changes anything leaves out of date
+    uint32_t invalidates = AnalysisCache::All;
+    // One of these is set. Each returns whether it changed anything.
+    bool (*runAst)(AstPassContext&) = nullptr;
+    bool (*runIr)(IrPassContext&) = nullptr;
+};
+
+// Runs a pipeline of passes: every AST pass, then lowering to the IR, then every IR pass, each in
+// the order given, timing each one
+class PassManager
+{
+public:
+    // Every pass that can be named in a pipeline
+    [[nodiscard]] static std::span<const PassInfo> passes();
+    [[nodiscard]] static const PassInfo* find(std::string_view name);
+
+    // The pipeline of an optimisation level. Level 0 has none: the program is generated straight
+    // from the tree.
+    [[nodiscard]] static PassManager forLevel(int level);
+    // The level written as in -O2, which must be a whole number from 0 to MaxLevel
+    [[nodiscard]] static std::optional<int> parseLevel(std::string_view text);
+    static constexpr int MaxLevel = 2;
+    // A pipeline from a comma separated list of pass names. Returns nothing, with the offending
+    // name in error, if a name is unknown or an AST pass comes after an IR pass.
+    [[nodiscard]] static std::optional<PassManager> parse(std::string_view names, std::string& error);
+
+    void add(const PassInfo& pass);
+    [[nodiscard]] bool empty() const { return m_passes.empty(); }
+
+    // Runs the pipeline on the program, returning it lowered and optimised
+    [[nodiscard]] Ir::Function run(Node::TreeView tree, Node::Range program, ErrorHandler& errors);
+
+    struct Timing
+    {
+        std::string_view name;
+        std::chrono::nanoseconds time{};
+        uint32_t runs = 0;
+        // Runs that changed the program
+        uint32_t changes = 0;
+    };
+    // Time spent in each pass, summed over every run of it, in the order each first ran. Lowering
+    // is reported as lower.
+    [[nodiscard]] const std::vector<Timing>& timings() const { return m_timings; }
+
+private:
+    void record(std::string_view name, std::chrono::nanoseconds time, bool changed);
+
+    std::vector<const PassInfo*> m_passes;
+    std::vector<Timing> m_timings;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "PassManager.hpp"
+
+// Every pass, registered by name with the pass manager in PassManager.cpp
+namespace Passes {
+    // Replaces each operation on literals in the syntax tree with the literal it makes, so lowering
+    // never emits them
+    bool foldTree(AstPassContext& context);
+    // Folds operations on constants and simplifies identities such as x * 1 and x - x, in 64 bits.
+    // A division that would trap is left alone.
+    bool fold(IrPassContext& context);
+    // Turns every variable into registers, with phis where paths that store different values
+    // meet, so loads and stores, and copies such as let b = a;, are gone
+    bool promoteVariables(IrPassContext& context);
+    // Propagates constants through variables and across blocks, along only the edges that can be
+    // taken, then replaces branches on constants with jumps and removes what that leaves unreachable
+    bool propagateConstants(IrPassContext& context);
+    // Replaces each computation already made in a dominating block, and each load of a variable
+    // whose value is known there, with the register that holds it
+    bool numberValues(IrPassContext& context);
+    // Moves what each loop computes the same every time round into a preheader before it, making
+    // one where the loop has none. Inner loops go first.
+    bool hoistInvariants(IrPassContext& context);
+    // Removes unreachable blocks, stores no load can see, and instructions whose results are
+    // unused, so variables never read are gone entirely
+    bool eliminateDeadCode(IrPassContext& context);
+    // Removes unreachable blocks, threads jumps through blocks that only jump, and merges each
+    // block into its predecessor where that is the only way in
+    bool simplifyCfg(IrPassContext& context);
+    // Reports any problem Ir::verify finds as an error
+    bool verify(IrPassContext& context);
+}
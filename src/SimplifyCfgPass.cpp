@@ -0,0 +1,147 @@
+#include "Passes.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    bool hasPhis(const Ir::Function& function, Ir::BlockId block)
+    {
+        const auto& instructions = function.blocks[block].instructions;
+        return !instructions.empty() && function.instructions[instructions.front()].op == Ir::Op::Phi;
+    }
+
+    // Sends every predecessor of block, which holds nothing but a jump, straight to its target.
+    // Returns whether it did.
+    bool threadJump(Ir::Function& function, Ir::BlockId block)
+    {
+        const auto target = function.terminator(block).targets[0];
+        std::vector<Ir::BlockId> predecessors = function.blocks[block].predecessors;
+        std::sort(predecessors.begin(), predecessors.end());
+        predecessors.erase(std::unique(predecessors.begin(), predecessors.end()), predecessors.end());
+        if (target == block || predecessors.empty())
+        {
+            return false;
+        }
+        // The phis of the target take the register they took from block from each predecessor
+        // instead, which is only possible where no predecessor already has an edge of its own there
+        if (hasPhis(function, target))
+        {
+            const auto& targetPredecessors = function.blocks[target].predecessors;
+            for (const auto predecessor : predecessors)
+            {
+                if (std::find(targetPredecessors.begin(), targetPredecessors.end(), predecessor) != targetPredecessors.end())
+                {
+                    return false;
+                }
+            }
+            for (const auto value : function.blocks[target].instructions)
+            {
+                auto& phi = function.instructions[value];
+                if (phi.op != Ir::Op::Phi)
+                {
+                    break;
+                }
+                const auto from = std::find_if(phi.incoming.begin(), phi.incoming.end(), [&](const auto& incoming) { return incoming.first == block; });
+                const auto incoming = from->second;
+                for (const auto predecessor : predecessors)
+                {
+                    phi.incoming.emplace_back(predecessor, incoming);
+                }
+            }
+        }
+        for (const auto predecessor : predecessors)
+        {
+            auto terminator = function.terminator(predecessor);
+            std::replace(terminator.targets.begin(), terminator.targets.end(), block, target);
+            terminator.incoming.clear();
+            function.replaceTerminator(predecessor, terminator);
+        }
+        function.removeBlock(block);
+        return true;
+    }
+
+    // Moves everything in successor, whose only way in is the jump ending block, onto the end of
+    // block
+    void merge(Ir::Function& function, Ir::BlockId block, Ir::BlockId successor)
+    {
+        function.remove(function.blocks[block].instructions.back());
+        function.blocks[successor].predecessors.clear();
+        for (const auto value : function.blocks[successor].instructions)
+        {
+            auto& instruction = function.instructions[value];
+            if (instruction.op == Ir::Op::Phi)
+            {
+                // With one way in, a phi is whatever came in along it
+                instruction.block = Ir::None;
+                function.replaceAllUses(value, instruction.incoming.front().second);
+                continue;
+            }
+            instruction.block = block;
+            function.blocks[block].instructions.push_back(value);
+        }
+        function.blocks[successor].instructions.clear();
+        function.blocks[successor].removed = true;
+        // The edges out of successor now leave from block
+        for (const auto next : function.successors(block))
+        {
+            std::replace(function.blocks[next].predecessors.begin(), function.blocks[next].predecessors.end(), successor, block);
+            for (const auto value : function.blocks[next].instructions)
+            {
+                auto& phi = function.instructions[value];
+                if (phi.op != Ir::Op::Phi)
+                {
+                    break;
+                }
+                for (auto& incoming : phi.incoming)
+                {
+                    if (incoming.first == successor)
+                    {
+                        incoming.first = block;
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace Passes {
+    bool simplifyCfg(IrPassContext& context)
+    {
+        auto& function = context.function;
+        bool changed = false;
+        bool changedThisRound = true;
+        while (changedThisRound)
+        {
+            changedThisRound = function.removeUnreachableBlocks();
+            for (Ir::BlockId block = 0; block < function.blocks.size(); ++block)
+            {
+                if (function.blocks[block].removed || function.terminator(block).op != Ir::Op::Jump)
+                {
+                    continue;
+                }
+                const auto successor = function.terminator(block).targets[0];
+                const auto& into = function.blocks[successor].predecessors;
+                if (successor != block && successor != function.entry && into.size() == 1)
+                {
+                    merge(function, block, successor);
+                    changedThisRound = true;
+                }
+                else if (block != function.entry && function.blocks[block].instructions.size() == 1 && threadJump(function, block))
+                {
+                    changedThisRound = true;
+                }
+            }
+            changed = changed || changedThisRound;
+        }
+        return changed;
+    }
+
+    bool verify(IrPassContext& context)
+    {
+        for (const auto& problem : Ir::verify(context.function))
+        {
+            context.errors << makeError({}, "Invalid IR: " + problem);
+        }
+        return false;
+    }
+}
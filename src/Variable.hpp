@@ -1,9 +1,14 @@
 #pragma once
 
+#include <StringInterner.hpp>
+
 #include <cstddef>
+#include <cstdint>
 
 struct Variable
 {
-    std::string name;
+    StringInterner::Symbol name;
     size_t stackPosition;
+    // Index + 1 of the outer variable with the same name that this one hides, or 0
+    uint32_t shadows = 0;
 };
\ No newline at end of file
@@ -3,80 +3,366 @@
 #include "Generator.hpp"
 #include "Assembler.hpp"
 #include "Linker.hpp"
+#include "AstCache.hpp"
+#include "DivisionCheck.hpp"
+#include "IrBuilder.hpp"
+#include "IrGenerator.hpp"
+#include "PassManager.hpp"
 #include "../lib/CompilerError.hpp"
+#include "../lib/SourceFile.hpp"
 
 #include <argparse.h>
 
-#include <iostream>
+#include <charconv>
 #include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // The level may be glued to -O, as in -O2, and long options given as --name=value. Both are
+    // split into a flag and its value before the argument parser sees them.
+    std::vector<std::string> normaliseArguments(int argc, char** argv)
+    {
+        std::vector<std::string> arguments;
+        for (int i = 0; i < argc; ++i)
+        {
+            const std::string_view argument = argv[i];
+            const auto equals = argument.find('=');
+            if (i > 0 && argument.size() > 2 && argument.starts_with("-O"))
+            {
+                arguments.emplace_back("-O");
+                arguments.emplace_back(argument.substr(2));
+            }
+            else if (i > 0 && argument.starts_with("--") && equals != std::string_view::npos)
+            {
+                arguments.emplace_back(argument.substr(1, equals - 1));
+                arguments.emplace_back(argument.substr(equals + 1));
+            }
+            else
+            {
+                arguments.emplace_back(argument);
+            }
+        }
+        return arguments;
+    }
+
+    // Each block the queue can hold has a slot allocated up front
+    constexpr size_t MaxPipelineBlocks = 4096;
+
+    // A whole number from min to max, as in -error-limit 20, or nothing if text is anything else
+    std::optional<size_t> parseCount(std::string_view text, size_t min, size_t max)
+    {
+        size_t count = 0;
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (ec != std::errc() || end != text.data() + text.size() || count < min || count > max)
+        {
+            return {};
+        }
+        return count;
+    }
+}
 
 int main(int argc, char** argv)
 {
     // Parse the arguments
     auto argParser = argparse::argument_parser("Emerald", "");
-    argParser.add_argument("src").help("Source file to compile.");
+    argParser.add_argument("src").help("Source file to compile, or - to read from stdin.");
     argParser.add_argument({"-o", "-out"}).help("Optional output name.");
-    argParser.parse_args(argc, argv);
+    argParser.add_argument({"-m", "-mode"}).help("program (default) to parse the whole program before generating, or stream to parse and generate one top-level statement at a time.");
+    argParser.add_argument({"-s", "-stats"}).help("Write compiler statistics to this file, or - for stdout.");
+    argParser.add_argument({"-p", "-pipeline"}).help("Tokenise on a separate thread while parsing, buffering at most this many blocks of tokens, from 1 to 4096.");
+    argParser.add_argument({"-e", "-error-limit"}).help("Stop after this many errors (default 100), or 0 to report them all.");
+    argParser.add_argument({"-c", "-cache"}).help("Directory of parsed programs keyed by their source. A program found there is not tokenised or parsed again.");
+    argParser.add_argument({"-i", "-ir"}).help("Write the program lowered to IR, after any passes, to this file, or - for stdout. Not available in stream mode.");
+    argParser.add_argument({"-O", "-optimise"}).help("Optimisation level: 0 (default) generates straight from the syntax tree, 1 and 2 go through the IR and its passes. Stream mode always uses 0.");
+    argParser.add_argument("-passes").help("Comma separated IR passes to run instead of those of the -O level, as in --passes=simplify-cfg,verify.");
+    auto arguments = normaliseArguments(argc, argv);
+    std::vector<char*> argumentPointers;
+    for (auto& argument : arguments)
+    {
+        argumentPointers.push_back(argument.data());
+    }
+    argParser.parse_args(static_cast<int>(argumentPointers.size()), argumentPointers.data());
+
+    // Choose the passes, and with them whether the program goes through the IR at all
+    std::string level = "0";
+    argParser.try_get<std::string>("optimise", level);
+    const auto levelNumber = PassManager::parseLevel(level);
+    if (!levelNumber)
+    {
+        std::cerr << "Unknown optimisation level " << level << ". Levels are 0 to " << PassManager::MaxLevel << "." << std::endl;
+        return 1;
+    }
+    auto passManager = PassManager::forLevel(levelNumber.value());
+    std::string passNames;
+    const bool customPasses = argParser.try_get<std::string>("passes", passNames);
+    if (customPasses)
+    {
+        std::string unknown;
+        auto custom = PassManager::parse(passNames, unknown);
+        if (!custom)
+        {
+            std::cerr << "Unknown pass " << unknown << ", or an AST pass after an IR pass. Passes are:" << std::endl;
+            for (const auto& pass : PassManager::passes())
+            {
+                std::cerr << "  " << pass.name << ": " << pass.description << std::endl;
+            }
+            return 1;
+        }
+        passManager = std::move(custom.value());
+    }
+    const bool throughIr = customPasses || !passManager.empty();
 
     // Get the source file path
     auto srcFilePath = argParser.get<std::string>("src");
 
-    // Open the file for reading
-    std::fstream srcFile(srcFilePath, std::ios::in);
+    // Map the file, or read it if it's small or stdin ("-")
+    const auto srcFile = SourceFile::open(srcFilePath);
     if (!srcFile) {
         std::cerr << "Emerald source file " << srcFilePath << " not found." << std::endl;
         return 1;
     }
 
-    // Read the file into a stream
-    std::string srcStr;
-    {
-        std::stringstream srcStream;
-        if (srcFile.is_open()) {
-            srcStream << srcFile.rdbuf();
-            srcStr = srcStream.str();
-        } else {
-            std::cerr << "Failed to open Emerald source file " << srcFilePath << std::endl;
-            return 1;
-        }
-    }
-
     // Initialise an error handler to accumulate
     // and errors
     ErrorHandler errorHandler;
+    std::string errorLimit = "100";
+    argParser.try_get<std::string>("error-limit", errorLimit);
+    const auto errorLimitNumber = parseCount(errorLimit, 0, std::numeric_limits<size_t>::max());
+    if (!errorLimitNumber)
+    {
+        std::cerr << "Invalid error limit " << errorLimit << ". The limit is a whole number, or 0 for no limit." << std::endl;
+        return 1;
+    }
+    errorHandler.setErrorLimit(errorLimitNumber.value());
+
+    // A tree cached for exactly this source skips tokenising and parsing altogether
+    std::string cacheDirectory;
+    const bool caching = argParser.try_get<std::string>("cache", cacheDirectory);
+    const uint64_t sourceHash = caching ? AstCache::hashSource(srcFile->contents()) : 0;
+    const auto cachePath = caching ? AstCache::entryPath(cacheDirectory, sourceHash) : std::filesystem::path();
+    std::optional<AstCache> cached;
+    if (caching)
+    {
+        cached = AstCache::load(cachePath, sourceHash, srcFile->contents().size());
+    }
 
     // Lexing
-    Tokeniser tokeniser(std::move(srcStr), srcFilePath, errorHandler);
-    auto tokens = tokeniser.tokenise();
+    // Tokens view the file contents directly so srcFile must stay alive until generation is done
+    Tokeniser tokeniser(srcFile->contents(), srcFilePath, errorHandler);
 
     // Parsing
-    Parser parser(std::move(tokens), errorHandler);
-    const auto ast = parser.parse();
+    // The parser owns the tree, so it has to outlive generation
+    std::optional<Parser> parser;
+    std::string pipelineBlocks;
+    const bool pipelined = argParser.try_get<std::string>("pipeline", pipelineBlocks);
+    // The tokeniser stays at most this many blocks ahead of the parser
+    const auto pipelineBlockCount = pipelined ? parseCount(pipelineBlocks, 1, MaxPipelineBlocks) : 1;
+    if (!pipelineBlockCount)
+    {
+        std::cerr << "Invalid pipeline block count " << pipelineBlocks << ". The count is 1 to " << MaxPipelineBlocks << "." << std::endl;
+        return 1;
+    }
+    TokenBlockQueue blocks(pipelineBlockCount.value());
+    std::jthread lexer;
+    if (!cached)
+    {
+        if (pipelined)
+        {
+            lexer = std::jthread([&] { tokeniser.tokeniseInto(blocks); });
+            parser.emplace(blocks, tokeniser.fileId(), errorHandler);
+        }
+        else
+        {
+            // Large sources are split across every hardware thread
+            parser.emplace(tokeniser.tokeniseParallel(), errorHandler);
+        }
+    }
+
+    // Construct output name
+    std::string outName = "out";
+    argParser.try_get<std::string>("out", outName);
+    Assembler assembler(outName);
 
     // Generation
-    Generator generator(ast, errorHandler);
-    const auto generatedAsm = generator.generateProgram();
+    std::string mode = "program";
+    argParser.try_get<std::string>("mode", mode);
+    std::string generatedAsm;
+    // A cached program is generated whole, whatever the mode
+    const bool streamed = mode == "stream" && !cached;
+    // The tree and top-level statements of a program generated whole
+    Node::TreeView programTree;
+    Node::Range programStatements;
+    std::optional<Ir::Function> function;
+    const auto generateWhole = [&](Node::TreeView tree, Node::Range statements) {
+        programTree = tree;
+        programStatements = statements;
+        // Run at -O0 too, even though nothing is folded there, so whether a program compiles
+        // doesn't depend on the level. It's a single walk over the tree, with no IR built.
+        DivisionCheck(errorHandler).checkProgram(tree, statements);
+        if (errorHandler.hasErrored())
+        {
+            return std::string();
+        }
+        if (!throughIr)
+        {
+            Generator generator(tree, statements, errorHandler);
+            return generator.generateProgram();
+        }
+        function = passManager.run(tree, statements, errorHandler);
+        if (errorHandler.hasErrored())
+        {
+            return std::string();
+        }
+        IrGenerator irGenerator(function.value());
+        return irGenerator.generateProgram();
+    };
+    if (cached)
+    {
+        generatedAsm = generateWhole(cached->tree(), cached->program());
+    }
+    else if (streamed)
+    {
+        // Each top-level statement is written out and its nodes released before the next is
+        // parsed, so memory is bounded by the largest statement rather than the whole program
+        std::ofstream asmFile(assembler.generateOutputFilename());
+        Generator generator(parser->tree(), errorHandler);
+        DivisionCheck divisionCheck(errorHandler);
+        generator.beginProgram();
+        while (true)
+        {
+            const auto checkpoint = parser->checkpoint();
+            const auto statement = parser->parseNext();
+            if (!statement.has_value())
+            {
+                break;
+            }
+            // Once there are errors nothing will be assembled, so only parse for further errors.
+            // Divisions are checked as in program mode, though stream mode is always -O0.
+            if (!errorHandler.hasErrored())
+            {
+                divisionCheck.checkStatement(parser->tree().view(), statement.value());
+            }
+            if (!errorHandler.hasErrored())
+            {
+                generator.generateStatement(statement.value());
+                generator.flush(asmFile);
+            }
+            parser->rewind(checkpoint);
+        }
+        generator.endProgram();
+        generator.flush(asmFile);
+    }
+    else
+    {
+        const auto ast = parser->parse();
+        if (!errorHandler.hasErrored())
+        {
+            generatedAsm = generateWhole(parser->tree().view(), ast.statements);
+            // Only a program that compiles cleanly is cached
+            if (caching && !errorHandler.hasErrored())
+            {
+                AstCache::store(cachePath, sourceHash, srcFile->contents().size(), parser->tree().view(), ast.statements, StringInterner::global());
+            }
+        }
+    }
+
+    std::string irPath;
+    if (argParser.try_get<std::string>("ir", irPath) && !streamed && !errorHandler.hasErrored())
+    {
+        if (!function)
+        {
+            IrBuilder builder(programTree, errorHandler);
+            function = builder.build(programStatements);
+        }
+        // Anything found here is a bug in the compiler rather than the program
+        for (const auto& problem : Ir::verify(function.value()))
+        {
+            std::cerr << "Invalid IR: " << problem << std::endl;
+        }
+        std::ofstream irFile;
+        if (irPath != "-")
+        {
+            irFile.open(irPath);
+        }
+        Ir::print(irPath == "-" ? std::cout : irFile, function.value());
+    }
 
+    // Warnings are printed too, but don't stop the program being built
+    for (const auto& message : errorHandler)
+    {
+        errorHandler.print(std::cerr, message);
+        std::cerr << std::endl;
+    }
     if (errorHandler.hasErrored())
     {
-        for(const auto& error : errorHandler)
+        if (errorHandler.errorLimitReached())
         {
-            std::cerr << error << std::endl;
+            std::cerr << "Stopped after " << errorHandler.errorCount() << " errors." << std::endl;
         }
     }
     else
     {
-        // Construct output name
-        std::string outName = "out";
-        argParser.try_get<std::string>("out", outName);
-
         // Generate assembly
-        Assembler assembler(outName);
-        assembler.generate(generatedAsm);
+        if (streamed)
+        {
+            assembler.assemble();
+        }
+        else
+        {
+            assembler.generate(generatedAsm);
+        }
 
         // Link
         Linker linker(outName);
         linker.link();
     }
+
+    std::string statsPath;
+    if (argParser.try_get<std::string>("stats", statsPath))
+    {
+        std::ofstream statsFile;
+        if (statsPath != "-")
+        {
+            statsFile.open(statsPath);
+        }
+        std::ostream& stats = statsPath == "-" ? std::cout : statsFile;
+        const auto& interner = StringInterner::global();
+        stats << "interner.symbols " << interner.size() << "\n";
+        stats << "interner.bytes " << interner.memoryBytes() << "\n";
+        if (caching)
+        {
+            stats << "cache.hit " << cached.has_value() << "\n";
+        }
+        if (parser)
+        {
+            const auto& tree = parser->tree();
+            stats << "ast.bytes " << tree.bytesUsed() << "\n";
+            stats << "ast.reserved " << tree.bytesReserved() << "\n";
+            stats << "ast.exprs " << tree.exprs.size() << "\n";
+            stats << "ast.statements " << tree.statements.size() << "\n";
+            const auto& arena = parser->arena();
+            stats << "arena.bytes " << arena.bytesUsed() << "\n";
+            stats << "arena.high_water " << arena.highWaterMark() << "\n";
+            stats << "arena.chunks " << arena.chunkCount() << "\n";
+            stats << "arena.reserved " << arena.bytesReserved() << "\n";
+        }
+        for (const auto& timing : passManager.timings())
+        {
+            const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(timing.time).count();
+            stats << "pass." << timing.name << ".us " << micros << "\n";
+            stats << "pass." << timing.name << ".runs " << timing.runs << "\n";
+            stats << "pass." << timing.name << ".changes " << timing.changes << "\n";
+        }
+        if (function)
+        {
+            stats << "ir.instructions " << function->liveInstructionCount() << "\n";
+        }
+    }
     return 0;
 }
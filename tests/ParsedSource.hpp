@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Tokeniser.hpp>
+#include <Parser.hpp>
+
+#include <string>
+
+// A source tokenised and parsed as the driver does, with the handler its diagnostics went to. The
+// parser and tree refer to the handler and the source, so this is built in place and never moved.
+struct ParsedSource
+{
+    explicit ParsedSource(std::string text)
+        : source(std::move(text))
+        , parser(Tokeniser(source, "test.emd", handler).tokenise(), handler)
+        , program(parser.parse())
+    {
+    }
+    ParsedSource(const ParsedSource& other) = delete;
+
+    [[nodiscard]] Node::TreeView tree() const { return parser.tree().view(); }
+
+    std::string source;
+    ErrorHandler handler;
+    Parser parser;
+    Node::Program program;
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <Token.hpp>
+
+#include <cctype>
+#include <charconv>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The character at a time tokeniser that the table-driven one replaced, kept to check it against.
+// It classifies through <cctype> and std::map lookups, and counts lines and columns as it goes
+// rather than through the source manager's line table.
+//
+// Multi-line comments end differently on purpose: this one stops at the first '*', or at the
+// first character followed by '#', rather than at "*#", and doesn't notice one that's never
+// closed. tokenise() returns nothing for a source that reaches either case.
+class ReferenceTokeniser
+{
+public:
+    struct Lexeme
+    {
+        Token::Kind kind;
+        size_t offset;
+        size_t line;
+        size_t pos;
+        // Identifiers and integer literals only
+        std::string text;
+        int64_t intValue = 0;
+    };
+
+    struct Result
+    {
+        std::vector<Lexeme> tokens;
+        size_t errors = 0;
+    };
+
+    explicit ReferenceTokeniser(std::string_view source) : m_src(source)
+    {
+    }
+
+    [[nodiscard]] std::optional<Result> tokenise()
+    {
+        Result result;
+
+        while (peek().has_value())
+        {
+            if (std::isspace(static_cast<unsigned char>(peek().value())))
+            {
+                // Ignore whitespace but calculate the correct position in the source code
+                advance();
+
+                // Go to the next character
+                continue;
+            }
+
+            const size_t start = m_srcPos;
+            const size_t line = m_lineNo;
+            const size_t pos = m_posInLine;
+            if (std::isalpha(static_cast<unsigned char>(peek().value())))
+            {
+                consume();
+                while (peek().has_value() && std::isalnum(static_cast<unsigned char>(peek().value()))) {
+                    consume();
+                }
+                const std::string_view text = m_src.substr(start, m_srcPos - start);
+
+                // Check if it's a key word
+                if (const auto keyword = KeywordTokenMap.find(text); keyword != KeywordTokenMap.end())
+                {
+                    result.tokens.push_back({ .kind = keyword->second, .offset = start, .line = line, .pos = pos, .text = {} });
+                }
+                else
+                {
+                    result.tokens.push_back({ .kind = Token::Kind::Identifier, .offset = start, .line = line, .pos = pos, .text = std::string(text) });
+                }
+            }
+            else if (std::isdigit(static_cast<unsigned char>(peek().value())))
+            {
+                consume();
+                while (peek().has_value() && std::isdigit(static_cast<unsigned char>(peek().value()))) {
+                    consume();
+                }
+                const std::string_view text = m_src.substr(start, m_srcPos - start);
+
+                int64_t value = 0;
+                const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+                if (ec == std::errc::result_out_of_range)
+                {
+                    result.errors++;
+                }
+                result.tokens.push_back({ .kind = Token::Kind::IntLit, .offset = start, .line = line, .pos = pos, .text = std::string(text), .intValue = value });
+            }
+            else if (peek().value() == '#') {
+                if (peek(1).has_value() && peek(1).value() == '*') {
+                    // Parse any multi-line comments
+                    consume();
+                    consume();
+                    while (peek().has_value() && peek().value() != '*' && peek(1).has_value() && peek(1).value() != '#') {
+                        advance();
+                    }
+                    if (peek() != '*' || peek(1) != '#')
+                    {
+                        return {};
+                    }
+                    consume();
+                    consume();
+                } else {
+                    // Parse any single line comments
+                    consume();
+                    while (peek().has_value() && !isNewline()) {
+                        consume();
+                    }
+                }
+            }
+            else if (SymbolTokenMap.contains(peek().value()))
+            {
+                // Two character operators are a symbol followed by =, otherwise it's a single symbol
+                const auto compound = EqualsSuffixTokenMap.find(peek().value());
+                if (compound != EqualsSuffixTokenMap.end() && peek(1) == '=')
+                {
+                    consume();
+                    consume();
+                    result.tokens.push_back({ .kind = compound->second, .offset = start, .line = line, .pos = pos, .text = {} });
+                }
+                else
+                {
+                    result.tokens.push_back({ .kind = SymbolTokenMap.at(consume()), .offset = start, .line = line, .pos = pos, .text = {} });
+                }
+            }
+            else
+            {
+                consume();
+                result.errors++;
+                result.tokens.push_back({ .kind = Token::Kind::Unexpected, .offset = start, .line = line, .pos = pos, .text = {} });
+            }
+        }
+        return result;
+    }
+
+private:
+    [[nodiscard]] std::optional<char> peek(size_t offset = 0) const
+    {
+        if (m_srcPos + offset >= m_src.size())
+        {
+            return {};
+        }
+        return m_src.at(m_srcPos + offset);
+    }
+
+    char consume()
+    {
+        m_posInLine++;
+        return m_src.at(m_srcPos++);
+    }
+
+    void consumeNewline()
+    {
+        if (peek().value() == '\n') {
+            consume();
+        } else if (peek().value() == '\r' && peek(1).value() == '\n') {
+            consume();
+            consume();
+        }
+    }
+
+    // Consumes a character, or a whole line ending after which the next line starts at column 1
+    void advance()
+    {
+        if (isNewline())
+        {
+            consumeNewline();
+            m_lineNo++;
+            m_posInLine = 1;
+        } else {
+            consume();
+        }
+    }
+
+    [[nodiscard]] bool isNewline() const
+    {
+        return peek().value() == '\n' || (peek().value() == '\r' && peek(1) == '\n');
+    }
+
+    std::string_view m_src;
+    size_t m_srcPos = 0;
+    size_t m_posInLine = 1;
+    size_t m_lineNo = 1;
+
+    static inline const std::map<char, Token::Kind> SymbolTokenMap = {
+        {';', Token::Kind::SemiColon},
+        {'(', Token::Kind::OpenParen},
+        {')', Token::Kind::CloseParen},
+        {'=', Token::Kind::Equals},
+        {'+', Token::Kind::Plus},
+        {'*', Token::Kind::Asterisk},
+        {'-', Token::Kind::Minus},
+        {'/', Token::Kind::ForwardSlash},
+        {'\\', Token::Kind::BackSlash},
+        {'{', Token::Kind::OpenCurly},
+        {'}', Token::Kind::CloseCurly},
+        {'[', Token::Kind::OpenSquare},
+        {']', Token::Kind::CloseSquare},
+        {'<', Token::Kind::LessThan},
+        {'>', Token::Kind::GreaterThan},
+        {'.', Token::Kind::Dot},
+        {',', Token::Kind::Comma},
+        {':', Token::Kind::Colon},
+        {'\'', Token::Kind::SingleQuote},
+        {'\"', Token::Kind::DoubleQuote},
+        {'|', Token::Kind::Pipe},
+        {'!', Token::Kind::Bang}
+    };
+
+    static inline const std::map<char, Token::Kind> EqualsSuffixTokenMap = {
+        {'=', Token::Kind::EqualsEquals},
+        {'!', Token::Kind::BangEquals},
+        {'<', Token::Kind::LessThanEquals},
+        {'>', Token::Kind::GreaterThanEquals}
+    };
+
+    static inline const std::map<std::string, Token::Kind, std::less<>> KeywordTokenMap = {
+        {"return", Token::Kind::Return},
+        {"let", Token::Kind::Let},
+        {"if", Token::Kind::If},
+        {"for", Token::Kind::For},
+        {"else", Token::Kind::Else},
+        {"while", Token::Kind::While}
+    };
+};
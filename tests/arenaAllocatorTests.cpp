@@ -0,0 +1,115 @@
+#include <ArenaAllocator.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+    struct alignas(32) Wide
+    {
+        char bytes[32];
+    };
+
+    struct Counted
+    {
+        explicit Counted(int& live) : live(live) { ++live; }
+        ~Counted() { --live; }
+        int& live;
+    };
+}
+
+TEST(ArenaAllocatorTests, TestGrowsPastTheFirstChunk)
+{
+    ArenaAllocator arena(1024);
+    std::vector<uint64_t*> values;
+    for (uint64_t i = 0; i < 10000; ++i)
+    {
+        values.push_back(arena.alloc<uint64_t>(i));
+    }
+    for (uint64_t i = 0; i < values.size(); ++i)
+    {
+        ASSERT_EQ(*values[i], i);
+    }
+    EXPECT_GT(arena.chunkCount(), 1);
+    EXPECT_GE(arena.bytesUsed(), 10000 * sizeof(uint64_t));
+    EXPECT_GE(arena.bytesReserved(), arena.bytesUsed());
+}
+
+TEST(ArenaAllocatorTests, TestRespectsAlignment)
+{
+    ArenaAllocator arena(1024);
+    for (int i = 0; i < 100; ++i)
+    {
+        arena.alloc<char>('x');
+        const auto wide = arena.alloc<Wide>();
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(wide) % alignof(Wide), 0);
+    }
+}
+
+TEST(ArenaAllocatorTests, TestRewindDestroysAndReusesMemory)
+{
+    int live = 0;
+    ArenaAllocator arena(1024);
+    arena.alloc<Counted>(live);
+    const auto checkpoint = arena.checkpoint();
+    const size_t usedAtCheckpoint = arena.bytesUsed();
+    for (int i = 0; i < 1000; ++i)
+    {
+        arena.alloc<Counted>(live);
+    }
+    EXPECT_EQ(live, 1001);
+    const size_t chunks = arena.chunkCount();
+    const size_t peak = arena.bytesUsed();
+
+    arena.rewind(checkpoint);
+    EXPECT_EQ(live, 1);
+    EXPECT_EQ(arena.bytesUsed(), usedAtCheckpoint);
+    EXPECT_EQ(arena.highWaterMark(), peak);
+
+    // The same allocations again fit in the chunks already held
+    for (int i = 0; i < 1000; ++i)
+    {
+        arena.alloc<Counted>(live);
+    }
+    EXPECT_EQ(arena.chunkCount(), chunks);
+    EXPECT_EQ(arena.bytesUsed(), peak);
+}
+
+TEST(ArenaAllocatorTests, TestDestructionRunsDestructors)
+{
+    int live = 0;
+    {
+        ArenaAllocator arena;
+        arena.alloc<Counted>(live);
+        arena.alloc<Counted>(live);
+        EXPECT_EQ(live, 2);
+    }
+    EXPECT_EQ(live, 0);
+}
+
+TEST(ArenaAllocatorTests, TestPmrContainersAllocateFromTheArena)
+{
+    ArenaAllocator arena(1024);
+    std::pmr::vector<uint64_t> values(&arena);
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        values.push_back(i);
+    }
+    EXPECT_EQ(values.back(), 999);
+    // Every buffer the vector grew through is still held by the arena
+    EXPECT_GE(arena.bytesUsed(), 1000 * sizeof(uint64_t));
+}
+
+TEST(ArenaAllocatorTests, TestOwnedObjectsAreNotDestroyed)
+{
+    int live = 0;
+    {
+        ArenaAllocator arena(1024);
+        arena.alloc<Counted>(live);
+        arena.allocOwned<Counted>(live);
+        EXPECT_EQ(live, 2);
+    }
+    EXPECT_EQ(live, 1);
+}
@@ -0,0 +1,112 @@
+#include "ParsedSource.hpp"
+
+#include <AstCache.hpp>
+#include <Generator.hpp>
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace
+{
+    const std::string Source = "let a = 1;\n{\n    let b = (a + 2) * 3;\n}\nif (a == 1) {\n    a = 3;\n} else if (a < 0) {\n    a = 4;\n} else {\n    a = 5;\n}\nreturn a;\n";
+
+    class AstCacheTests : public testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            m_directory = std::filesystem::temp_directory_path() / ("emerald-ast-cache-" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()));
+            std::filesystem::remove_all(m_directory);
+        }
+        void TearDown() override
+        {
+            std::filesystem::remove_all(m_directory);
+        }
+
+        // Parses Source, stores it and returns the asm generated from the parser's tree
+        std::string storeSource(uint64_t hash)
+        {
+            ParsedSource parsed(Source);
+            EXPECT_TRUE(AstCache::store(path(hash), hash, Source.size(), parsed.tree(), parsed.program.statements, StringInterner::global()));
+            Generator generator(parsed.program, parsed.handler);
+            return generator.generateProgram();
+        }
+
+        std::filesystem::path path(uint64_t hash) const { return AstCache::entryPath(m_directory, hash); }
+
+        std::filesystem::path m_directory;
+    };
+}
+
+TEST_F(AstCacheTests, TestLoadedTreeGeneratesLikeTheParsedOne)
+{
+    const auto hash = AstCache::hashSource(Source);
+    const auto expected = storeSource(hash);
+
+    const auto cache = AstCache::load(path(hash), hash, Source.size());
+    ASSERT_TRUE(cache.has_value());
+    ErrorHandler handler;
+    Generator generator(cache->tree(), cache->program(), handler);
+    EXPECT_EQ(generator.generateProgram(), expected);
+    EXPECT_FALSE(handler.hasErrored());
+}
+
+TEST_F(AstCacheTests, TestEntriesForOtherSourcesAreRejected)
+{
+    const auto hash = AstCache::hashSource(Source);
+    storeSource(hash);
+
+    EXPECT_NE(AstCache::hashSource(Source + " "), hash);
+    EXPECT_FALSE(AstCache::load(path(hash), hash + 1, Source.size()).has_value());
+    EXPECT_FALSE(AstCache::load(path(hash), hash, Source.size() + 1).has_value());
+    EXPECT_FALSE(AstCache::load(path(hash + 1), hash + 1, Source.size()).has_value());
+}
+
+TEST_F(AstCacheTests, TestTruncatedEntriesAreRejected)
+{
+    const auto hash = AstCache::hashSource(Source);
+    storeSource(hash);
+
+    std::filesystem::resize_file(path(hash), std::filesystem::file_size(path(hash)) / 2);
+    EXPECT_FALSE(AstCache::load(path(hash), hash, Source.size()).has_value());
+}
+
+TEST_F(AstCacheTests, TestEntriesDamagedInPlaceAreRejected)
+{
+    const auto hash = AstCache::hashSource(Source);
+    storeSource(hash);
+
+    // Flip a byte of the last section, leaving the header and every size as they were
+    {
+        std::fstream file(path(hash), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-1, std::ios::end);
+        const char last = static_cast<char>(file.get());
+        file.seekp(-1, std::ios::end);
+        file.put(static_cast<char>(last ^ 1));
+    }
+    EXPECT_FALSE(AstCache::load(path(hash), hash, Source.size()).has_value());
+}
+
+TEST_F(AstCacheTests, TestEntriesWithIndicesOutsideTheTreeAreRejected)
+{
+    // Stored as written, so the hash matches, but the return's expression isn't there
+    Node::Tree tree;
+    const auto literal = Node::Tree::add(tree.exprs, Node::Expr::intLiteral(1));
+    const auto returned = Node::Tree::add(tree.returns, Node::Statement::Return{ .returnExpr = literal + 1 });
+    const auto program = tree.addList(std::vector<Node::Stmt>{ { Node::StmtKind::Return, returned } });
+    const auto hash = AstCache::hashSource(Source);
+    ASSERT_TRUE(AstCache::store(path(hash), hash, Source.size(), tree.view(), program, StringInterner::global()));
+    EXPECT_FALSE(AstCache::load(path(hash), hash, Source.size()).has_value());
+
+    tree.returns[returned].returnExpr = literal;
+    ASSERT_TRUE(AstCache::store(path(hash), hash, Source.size(), tree.view(), program, StringInterner::global()));
+    EXPECT_TRUE(AstCache::load(path(hash), hash, Source.size()).has_value());
+
+    // A statement of a kind that doesn't exist
+    tree.statements[program.first].kind = static_cast<Node::StmtKind>(42);
+    ASSERT_TRUE(AstCache::store(path(hash), hash, Source.size(), tree.view(), program, StringInterner::global()));
+    EXPECT_FALSE(AstCache::load(path(hash), hash, Source.size()).has_value());
+}
@@ -0,0 +1,65 @@
+#include "ParsedSource.hpp"
+
+#include <DivisionCheck.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Message::Kind is hidden by the member of the same name
+    using Messages = std::vector<std::pair<enum Message::Kind, std::string>>;
+
+    // The kind and description of each message the check reports for source
+    Messages check(const std::string& source)
+    {
+        ParsedSource parsed(source);
+        EXPECT_FALSE(parsed.handler.hasErrored());
+        DivisionCheck(parsed.handler).checkProgram(parsed.tree(), parsed.program.statements);
+        Messages messages;
+        for (const auto& message : parsed.handler)
+        {
+            messages.emplace_back(message.Kind, message.Description);
+        }
+        return messages;
+    }
+
+    constexpr auto Error = Message::Kind::Error;
+    constexpr auto Warning = Message::Kind::Warning;
+}
+
+TEST(DivisionCheckTests, TestDivisionsOnEveryPathAreErrors)
+{
+    EXPECT_EQ(check("let a = 3;\nreturn 1 / (2 - 2);\n"), (Messages{ { Error, "Division by zero in a constant expression." } }));
+    EXPECT_EQ(check("let a = 3;\n{\n    a = a / 0;\n}\nreturn a;\n"), (Messages{ { Error, "Division by zero, as the divisor is always 0." } }));
+    EXPECT_EQ(check("return (0 - 9223372036854775807 - 1) / (0 - 1);\n"), (Messages{ { Error, "Division overflows 64 bits in a constant expression." } }));
+    // The first condition of an if, and of a while, is always evaluated
+    EXPECT_EQ(check("let a = 3;\nif (a / 0) {\n}\nwhile (1 / 0) {\n}\nreturn a;\n").size(), 2);
+    EXPECT_EQ(check("let a = 3;\nreturn a / (2 - 1) + 7 / 2;\n"), Messages{});
+}
+
+TEST(DivisionCheckTests, TestDivisionsOnSomePathsAreWarnings)
+{
+    const Messages warning{ { Warning, "Division by zero in a constant expression." } };
+    EXPECT_EQ(check("let a = 3;\nif (a) {\n    a = 1 / 0;\n}\nreturn a;\n"), warning);
+    EXPECT_EQ(check("let a = 3;\nif (a) {\n} else if (1 / 0) {\n}\nreturn a;\n"), warning);
+    EXPECT_EQ(check("let a = 3;\nwhile (a) {\n    a = 1 / 0;\n}\nreturn a;\n"), warning);
+    // After a return on every path, but not after one in an if
+    EXPECT_EQ(check("let a = 3;\n{\n    return a;\n}\nreturn 1 / 0;\n"), warning);
+    EXPECT_EQ(check("let a = 3;\nif (a) {\n    return a;\n}\nreturn 1 / 0;\n")[0].first, Error);
+}
+
+TEST(DivisionCheckTests, TestStatementsCheckedOneAtATimeMatchTheProgram)
+{
+    ParsedSource parsed("let a = 3;\nreturn a;\nreturn 1 / 0;\n");
+    DivisionCheck check(parsed.handler);
+    for (const auto statement : parsed.parser.tree().list(parsed.program.statements))
+    {
+        check.checkStatement(parsed.tree(), statement);
+    }
+    ASSERT_EQ(parsed.handler.size(), 1);
+    EXPECT_EQ(parsed.handler.begin()->Kind, Warning);
+    EXPECT_EQ(parsed.handler.begin()->Info.Offset, parsed.source.rfind('/'));
+}
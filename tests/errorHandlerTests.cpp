@@ -0,0 +1,34 @@
+#include <CompilerError.hpp>
+
+#include <gtest/gtest.h>
+
+TEST(ErrorHandlerTests, TestCountsFollowTruncate)
+{
+    ErrorHandler handler;
+    handler << makeError({}, "first");
+    handler << Message{ .Kind = Message::Kind::Warning, .Info = {}, .Description = "warning" };
+    handler << makeError({}, "second");
+    EXPECT_EQ(handler.errorCount(), 2);
+    EXPECT_EQ(handler.warningCount(), 1);
+
+    handler.truncate(1);
+    EXPECT_EQ(handler.errorCount(), 1);
+    EXPECT_EQ(handler.warningCount(), 0);
+    EXPECT_TRUE(handler.hasErrored());
+
+    handler.truncate(0);
+    EXPECT_FALSE(handler.hasErrored());
+}
+
+TEST(ErrorHandlerTests, TestErrorsPastTheLimitAreDropped)
+{
+    ErrorHandler handler;
+    handler.setErrorLimit(3);
+    for (int i = 0; i < 10; ++i)
+    {
+        handler << makeError({}, "error");
+    }
+    EXPECT_TRUE(handler.errorLimitReached());
+    EXPECT_EQ(handler.errorCount(), 3);
+    EXPECT_EQ(handler.size(), 3);
+}
@@ -0,0 +1,156 @@
+#include "ParsedSource.hpp"
+
+#include <IrBuilder.hpp>
+#include <IrAnalysis.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace
+{
+    Ir::Function lower(const std::string& source)
+    {
+        ParsedSource parsed(source);
+        IrBuilder builder(parsed.tree(), parsed.handler);
+        auto function = builder.build(parsed.program.statements);
+        EXPECT_FALSE(parsed.handler.hasErrored());
+        return function;
+    }
+
+    std::optional<int64_t> lowerAndRun(const std::string& source)
+    {
+        const auto function = lower(source);
+        EXPECT_EQ(Ir::verify(function), std::vector<std::string>{});
+        return Ir::run(function, 1000000);
+    }
+}
+
+TEST(IrTests, TestLoweredProgramsRunLikeTheSource)
+{
+    EXPECT_EQ(lowerAndRun(""), 0);
+    EXPECT_EQ(lowerAndRun("return (10 - 2 * 3) / 2;\n"), 2);
+    EXPECT_EQ(lowerAndRun("let x = 1;\n{\n    let x = x + 1;\n    x = 5;\n}\nreturn x;\n"), 1);
+    EXPECT_EQ(lowerAndRun("let a = 2;\nif (a == 1) {\n    a = 10;\n} else if (a == 2) {\n    a = 20;\n} else {\n    a = 30;\n}\nreturn a;\n"), 20);
+    EXPECT_EQ(lowerAndRun("let a = 0;\nif (a) {\n    a = 10;\n}\nreturn a + 1;\n"), 1);
+    EXPECT_EQ(lowerAndRun("let i = 0;\nlet s = 0;\nwhile (i < 10) {\n    let t = i * 2;\n    s = s + t;\n    i = i + 1;\n}\nreturn s;\n"), 90);
+    EXPECT_EQ(lowerAndRun("return 1;\nreturn 2;\n"), 1);
+    EXPECT_EQ(lowerAndRun("return 7 - 10 < 0;\n"), 1);
+}
+
+TEST(IrTests, TestDumpShowsBlocksEdgesAndShadowedSlots)
+{
+    const auto function = lower("let x = 1;\n{\n    let x = 2;\n}\nwhile (x) {\n    x = x - 1;\n}\nreturn x;\n");
+    EXPECT_EQ(Ir::toString(function),
+        "bb0:\n"
+        "    %0 = const 1\n"
+        "    store $x, %0\n"
+        "    %2 = const 2\n"
+        "    store $x.1, %2\n"
+        "    %4 = load $x\n"
+        "    br %4, bb1, bb3\n"
+        "bb1:  ; preds bb0\n"
+        "    jmp bb2\n"
+        "bb2:  ; preds bb1 bb2\n"
+        "    %7 = load $x\n"
+        "    %8 = const 1\n"
+        "    %9 = sub %7, %8\n"
+        "    store $x, %9\n"
+        "    %11 = load $x\n"
+        "    br %11, bb2, bb3\n"
+        "bb3:  ; preds bb0 bb2\n"
+        "    %13 = load $x\n"
+        "    ret %13\n");
+}
+
+TEST(IrTests, TestLoopPreheaderDominatesItsBody)
+{
+    const auto function = lower("let i = 3;\nwhile (i) {\n    if (i == 2) {\n        i = 1;\n    }\n    i = i - 1;\n}\nreturn i;\n");
+    const Ir::DominatorTree dominators(function);
+    // The first test branches to the preheader or straight past the loop
+    const Ir::BlockId preheader = function.successors(function.entry)[0];
+    const Ir::BlockId exit = function.successors(function.entry)[1];
+    const Ir::BlockId body = function.successors(preheader)[0];
+    EXPECT_EQ(dominators.idom(preheader), function.entry);
+    EXPECT_EQ(dominators.idom(body), preheader);
+    EXPECT_EQ(dominators.idom(exit), function.entry);
+    EXPECT_TRUE(dominators.dominates(preheader, body));
+    EXPECT_FALSE(dominators.dominates(body, preheader));
+    EXPECT_FALSE(dominators.dominates(body, exit));
+    // The test at the bottom goes back to the top of the body
+    const auto bottom = function.blocks[body].predecessors.back();
+    EXPECT_TRUE(dominators.dominates(body, bottom));
+}
+
+TEST(IrTests, TestSlotLivenessFollowsLoadsBackToStores)
+{
+    // j is never read, and i is read everywhere but the branch assigning it
+    const auto function = lower("let j = 5;\nlet i = 3;\nwhile (i) {\n    if (i == 2) {\n        i = 1;\n    }\n    i = i - 1;\n}\nreturn i;\n");
+    const Ir::SlotLiveness liveness(function);
+    const Ir::SlotId j = 0;
+    const Ir::SlotId i = 1;
+    const Ir::BlockId preheader = function.successors(function.entry)[0];
+    const Ir::BlockId exit = function.successors(function.entry)[1];
+    const Ir::BlockId body = function.successors(preheader)[0];
+    const Ir::BlockId assigning = function.successors(body)[0];
+    EXPECT_FALSE(liveness.liveIn(function.entry, i));
+    EXPECT_TRUE(liveness.liveOut(function.entry, i));
+    for (const auto block : { preheader, body, exit })
+    {
+        EXPECT_TRUE(liveness.liveIn(block, i)) << block;
+    }
+    EXPECT_FALSE(liveness.liveIn(assigning, i));
+    EXPECT_TRUE(liveness.liveOut(assigning, i));
+    EXPECT_FALSE(liveness.liveOut(exit, i));
+    for (Ir::BlockId block = 0; block < function.blocks.size(); ++block)
+    {
+        EXPECT_FALSE(liveness.liveIn(block, j)) << block;
+    }
+}
+
+TEST(IrTests, TestVerifierReportsBrokenFunctions)
+{
+    // A block without a terminator
+    Ir::Function unterminated;
+    unterminated.entry = unterminated.addBlock();
+    unterminated.append(unterminated.entry, { .op = Ir::Op::Const, .constant = 1 });
+    EXPECT_EQ(Ir::verify(unterminated).size(), 1);
+
+    // A register used on a path where it isn't defined
+    Ir::Function undominated;
+    const auto entry = undominated.addBlock();
+    const auto left = undominated.addBlock();
+    const auto right = undominated.addBlock();
+    const auto join = undominated.addBlock();
+    const auto condition = undominated.append(entry, { .op = Ir::Op::Const, .constant = 1 });
+    undominated.append(entry, { .op = Ir::Op::Branch, .lhs = condition, .targets = { left, right } });
+    const auto leftValue = undominated.append(left, { .op = Ir::Op::Const, .constant = 2 });
+    undominated.append(left, { .op = Ir::Op::Jump, .targets = { join, Ir::None } });
+    undominated.append(right, { .op = Ir::Op::Jump, .targets = { join, Ir::None } });
+    undominated.append(join, { .op = Ir::Op::Return, .lhs = leftValue });
+    ASSERT_EQ(Ir::verify(undominated).size(), 1);
+
+    // Merging with a phi is fine, as long as it covers every predecessor
+    auto merged = undominated;
+    const auto rightValue = merged.append(right, { .op = Ir::Op::Const, .constant = 3 });
+    auto& rightBlock = merged.blocks[right].instructions;
+    std::swap(rightBlock[0], rightBlock[1]);
+    auto& joinBlock = merged.blocks[join].instructions;
+    const auto phi = merged.append(join, { .op = Ir::Op::Phi, .incoming = { { left, leftValue }, { right, rightValue } } });
+    std::swap(joinBlock[0], joinBlock[1]);
+    merged.instructions[joinBlock[1]].lhs = phi;
+    EXPECT_EQ(Ir::verify(merged), std::vector<std::string>{});
+    EXPECT_EQ(Ir::run(merged, 100), 2);
+
+    merged.instructions[phi].incoming.pop_back();
+    EXPECT_EQ(Ir::verify(merged).size(), 1);
+}
+
+TEST(IrTests, TestDivisionTrapsLikeTheMachine)
+{
+    EXPECT_EQ(Ir::evaluate(Ir::Op::Div, -7, 2), -3);
+    EXPECT_FALSE(Ir::evaluate(Ir::Op::Div, 1, 0).has_value());
+    EXPECT_FALSE(Ir::evaluate(Ir::Op::Div, INT64_MIN, -1).has_value());
+    EXPECT_EQ(Ir::evaluate(Ir::Op::Mul, INT64_MAX, 2), -2);
+    EXPECT_FALSE(lowerAndRun("let a = 0;\nreturn 1 / a;\n").has_value());
+}
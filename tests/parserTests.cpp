@@ -0,0 +1,361 @@
+#include "ParsedSource.hpp"
+
+#include <Generator.hpp>
+#include <Operators.hpp>
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace
+{
+    std::string generate(const std::string& source)
+    {
+        ParsedSource parsed(source);
+        Generator generator(parsed.program, parsed.handler);
+        return generator.generateProgram();
+    }
+
+    Parser::Edit replace(std::string& source, const std::string& from, const std::string& to)
+    {
+        const auto begin = static_cast<uint32_t>(source.find(from));
+        source.replace(begin, from.size(), to);
+        return { .begin = begin, .oldEnd = static_cast<uint32_t>(begin + from.size()), .newEnd = static_cast<uint32_t>(begin + to.size()) };
+    }
+}
+
+TEST(ParserTests, TestReparseInsideScopeMatchesFullParse)
+{
+    const std::string original = "let a = 1;\n{\n    let b = a + 2;\n}\nif (a) {\n    a = 3;\n} else {\n    a = 4;\n}\nreturn a;\n";
+    std::string edited = original;
+
+    ParsedSource parsed(original);
+    const auto& program = parsed.program;
+    const auto& tree = parsed.parser.tree();
+    const auto statement = tree.list(program.statements)[1];
+    ASSERT_EQ(statement.kind, Node::StmtKind::Scope);
+    const auto scopeId = tree.scopes[statement.index].id;
+
+    const auto reparsed = parsed.parser.reparse(edited, replace(edited, "a + 2", "a * 20 + b0"));
+    ASSERT_TRUE(reparsed.has_value());
+    EXPECT_EQ(reparsed.value(), statement.index);
+    EXPECT_EQ(tree.scopes[statement.index].id, scopeId);
+
+    // Tokens after the edit have moved
+    const auto returnStatement = tree.list(program.statements).back();
+    ASSERT_EQ(returnStatement.kind, Node::StmtKind::Return);
+    const auto& term = tree.exprs[tree.returns[returnStatement.index].returnExpr];
+    ASSERT_EQ(term.kind, Node::ExprKind::Identifier);
+    const auto& identifier = tree.tokens[term.lhs];
+    EXPECT_EQ(identifier.info().Offset, edited.rfind("a;"));
+    EXPECT_EQ(identifier.value(), "a");
+
+    Generator generator(program, parsed.handler);
+    EXPECT_EQ(generator.generateProgram(), generate(edited));
+}
+
+TEST(ParserTests, TestRepeatedReparseOfNestedScope)
+{
+    std::string source = "let a = 1;\n{\n    let b = 2;\n    {\n        let c = b;\n    }\n}\nreturn a;\n";
+
+    ParsedSource parsed(source);
+    const auto& program = parsed.program;
+
+    // Each edit gets its own buffer, as a reparse leaves the tree viewing the source it was given
+    std::string first = source;
+    ASSERT_TRUE(parsed.parser.reparse(first, replace(first, "let c = b;", "let c = b + 1; let d = c;")).has_value());
+    std::string second = first;
+    ASSERT_TRUE(parsed.parser.reparse(second, replace(second, "let b = 2;", "let b = 5;")).has_value());
+    std::string third = second;
+    ASSERT_TRUE(parsed.parser.reparse(third, replace(third, "let d = c;", "")).has_value());
+
+    Generator generator(program, parsed.handler);
+    EXPECT_EQ(generator.generateProgram(), generate(third));
+}
+
+TEST(ParserTests, TestReparseDoesNotGrowTheTreeWithoutBound)
+{
+    std::string source = "let a = 1;\n{\n    let b = 2;\n    {\n        let c = b;\n    }\n}\nreturn a;\n";
+
+    ParsedSource parsed(source);
+    const auto& program = parsed.program;
+    const auto parsedNodes = parsed.parser.tree().nodeCount();
+
+    // Edits alternate between the outer scope and the inner one, which each outer edit replaces
+    std::deque<std::string> edits{ source };
+    size_t mostNodes = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        auto edited = edits.back();
+        const auto edit = i % 2 == 0 ? replace(edited, i % 4 == 0 ? "let b = 2;" : "let b = 3;", i % 4 == 0 ? "let b = 3;" : "let b = 2;")
+                                     : replace(edited, i % 4 == 1 ? "let c = b;" : "let c = b + 1;", i % 4 == 1 ? "let c = b + 1;" : "let c = b;");
+        edits.push_back(std::move(edited));
+        ASSERT_TRUE(parsed.parser.reparse(edits.back(), edit).has_value());
+        mostNodes = std::max(mostNodes, parsed.parser.tree().nodeCount());
+    }
+    EXPECT_LE(mostNodes, 4 * parsedNodes);
+
+    Generator generator(program, parsed.handler);
+    EXPECT_EQ(generator.generateProgram(), generate(edits.back()));
+}
+
+TEST(ParserTests, TestCompactionDropsTokensOfDroppedExpressions)
+{
+    // The identifier in the broken expression is stored before the expression is dropped
+    std::string source = "let a = 1;\n{\n    let b = (a + (;\n}\nreturn a;\n";
+
+    ParsedSource parsed(source);
+    const auto parsedNodes = parsed.parser.tree().nodeCount();
+
+    std::deque<std::string> edits{ source };
+    for (int i = 0; i < 100; ++i)
+    {
+        auto edited = edits.back();
+        const auto edit = replace(edited, i % 2 == 0 ? "(a + (;" : "(a - (;", i % 2 == 0 ? "(a - (;" : "(a + (;");
+        edits.push_back(std::move(edited));
+        ASSERT_TRUE(parsed.parser.reparse(edits.back(), edit).has_value());
+    }
+    EXPECT_LE(parsed.parser.tree().nodeCount(), 4 * parsedNodes);
+    EXPECT_TRUE(parsed.handler.hasErrored());
+}
+
+TEST(ParserTests, TestReparseKeepsTheArenaBounded)
+{
+    std::string source;
+    for (int i = 0; i < 64; ++i)
+    {
+        const auto n = std::to_string(i);
+        source += "let a" + n + " = " + n + ";\n{\n    let b = a" + n + " * 2;\n    a" + n + " = b + 1;\n}\n";
+    }
+    source += "return a0;\n";
+
+    ParsedSource parsed(source);
+    const auto& arena = parsed.parser.arena();
+    const auto parsedBytes = parsed.parser.tree().bytesUsed();
+
+    // Arrays reserved from the token count leave no grown out copies behind
+    EXPECT_LE(arena.bytesUsed(), 2 * parsedBytes);
+
+    std::deque<std::string> edits{ source };
+    size_t settledHighWaterMark = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto edited = edits.back();
+        const auto edit = replace(edited, i % 2 == 0 ? "a31 * 2;" : "a31 * 3;", i % 2 == 0 ? "a31 * 3;" : "a31 * 2;");
+        edits.push_back(std::move(edited));
+        ASSERT_TRUE(parsed.parser.reparse(edits.back(), edit).has_value());
+        if (i == 499)
+        {
+            settledHighWaterMark = arena.highWaterMark();
+        }
+    }
+
+    // Replaced nodes are compacted away before they make an array grow, so the arena stops growing
+    EXPECT_EQ(arena.highWaterMark(), settledHighWaterMark);
+    EXPECT_LE(arena.highWaterMark(), 3 * parsedBytes);
+
+    Generator generator(parsed.program, parsed.handler);
+    EXPECT_EQ(generator.generateProgram(), generate(edits.back()));
+}
+
+TEST(ParserTests, TestReparseRejectsEditsThatChangeTheScope)
+{
+    std::string source = "let a = 1;\n{\n    let b = 2;\n}\nreturn a;\n";
+
+    ParsedSource parsed(source);
+    EXPECT_EQ(parsed.program.statements.count, 3);
+
+    // Outside every scope
+    std::string topLevel = source;
+    EXPECT_FALSE(parsed.parser.reparse(topLevel, replace(topLevel, "let a = 1;", "let a = 2;")).has_value());
+
+    // Closes the scope early
+    std::string unbalanced = source;
+    EXPECT_FALSE(parsed.parser.reparse(unbalanced, replace(unbalanced, "let b = 2;", "let b = 2; }")).has_value());
+    EXPECT_FALSE(parsed.handler.hasErrored());
+}
+
+TEST(ParserTests, TestInnerLetShadowsOuterVariable)
+{
+    // The inner x is initialised from the outer one, then hides it until the scope ends
+    const auto shadowed = generate("let x = 1;\n{\n    let x = x + 1;\n    x = 5;\n}\nreturn x;\n");
+    const auto plain = generate("let x = 1;\n{\n    let y = x + 1;\n    y = 5;\n}\nreturn x;\n");
+    EXPECT_EQ(shadowed, plain);
+}
+
+TEST(ParserTests, TestDeeplyNestedParenthesesGenerateLikeTheInnerExpression)
+{
+    constexpr size_t depth = 100000;
+    const auto nested = generate("let x = " + std::string(depth, '(') + "1 + 2" + std::string(depth, ')') + ";\nreturn x;\n");
+    EXPECT_EQ(nested, generate("let x = 1 + 2;\nreturn x;\n"));
+}
+
+TEST(ParserTests, TestDeeplyNestedScopesAreEachClosed)
+{
+    constexpr size_t depth = 100000;
+    std::string source = "let a = 1;\n";
+    for (size_t i = 0; i < depth; ++i)
+    {
+        source += "{ ";
+    }
+    source += "a = a + 1;";
+    for (size_t i = 0; i < depth; ++i)
+    {
+        source += " }";
+    }
+    source += "\nreturn a;\n";
+
+    const auto generated = generate(source);
+    size_t scopeEnds = 0;
+    for (size_t at = generated.find("add rsp"); at != std::string::npos; at = generated.find("add rsp", at + 1))
+    {
+        ++scopeEnds;
+    }
+    EXPECT_EQ(scopeEnds, depth);
+}
+
+TEST(ParserTests, TestOnlyBinaryOperatorTokensAreOperators)
+{
+    const std::set<Token::Kind> operators{
+        Token::Kind::EqualsEquals, Token::Kind::BangEquals, Token::Kind::LessThan, Token::Kind::GreaterThan, Token::Kind::LessThanEquals,
+        Token::Kind::GreaterThanEquals, Token::Kind::Plus, Token::Kind::Minus, Token::Kind::Asterisk, Token::Kind::ForwardSlash
+    };
+    for (size_t kind = 0; kind < Operators::KindCount; ++kind)
+    {
+        EXPECT_EQ(Operators::binary(static_cast<Token::Kind>(kind)).isOperator(), operators.contains(static_cast<Token::Kind>(kind))) << kind;
+    }
+}
+
+TEST(ParserTests, TestOperatorsAreLeftAssociative)
+{
+    EXPECT_EQ(generate("return 10 - 3 - 2;\n"), generate("return (10 - 3) - 2;\n"));
+    EXPECT_EQ(generate("return 1 + 2 * 3 - 4;\n"), generate("return (1 + (2 * 3)) - 4;\n"));
+}
+
+TEST(ParserTests, TestComparisonsBindLooserThanArithmetic)
+{
+    EXPECT_EQ(generate("return 1 + 2 < 3 * 4;\n"), generate("return (1 + 2) < (3 * 4);\n"));
+    EXPECT_EQ(generate("return 1 == 2 <= 3 != 4;\n"), generate("return (1 == (2 <= 3)) != 4;\n"));
+    EXPECT_NE(generate("return 1 < 2;\n"), generate("return 1 >= 2;\n"));
+}
+
+TEST(ParserTests, TestRecoveryReportsOneErrorPerBrokenStatement)
+{
+    const std::string source = "let x = 1\nlet y = 2;\n}\nlet 5 = 3 + + 4;\nreturn y;\n";
+
+    ParsedSource parsed(source);
+    const auto& program = parsed.program;
+
+    // The missing ;, the stray } and the broken let, after which parsing carries on
+    EXPECT_EQ(parsed.handler.errorCount(), 3);
+    EXPECT_EQ(program.statements.count, 3);
+}
+
+TEST(ParserTests, TestErrorLimitStopsThePipelinedTokeniser)
+{
+    std::string source;
+    for (int i = 0; i < 100000; ++i)
+    {
+        source += "@ ;\n";
+    }
+
+    ErrorHandler handler;
+    handler.setErrorLimit(10);
+    Tokeniser tokeniser(source, "test.emd", handler);
+    TokenBlockQueue blocks(1);
+    std::jthread lexer([&] { tokeniser.tokeniseInto(blocks, 64); });
+    Parser parser(blocks, tokeniser.fileId(), handler);
+    parser.parse();
+
+    EXPECT_EQ(handler.errorCount(), 10);
+    EXPECT_TRUE(blocks.cancelled());
+}
+
+TEST(ParserTests, TestStatementListsAreContiguousInTheTree)
+{
+    const std::string source = "let a = 1;\n{\n    let b = (a + 2) * 3;\n    { }\n    b = b - 1;\n}\nreturn a;\n";
+
+    ParsedSource parsed(source);
+    const auto& program = parsed.program;
+    const auto& tree = parsed.parser.tree();
+
+    ASSERT_EQ(program.statements.count, 3);
+    const auto scope = tree.list(program.statements)[1];
+    ASSERT_EQ(scope.kind, Node::StmtKind::Scope);
+    const auto statements = tree.list(tree.scopes[scope.index].statements);
+    ASSERT_EQ(statements.size(), 3);
+    EXPECT_EQ(statements[0].kind, Node::StmtKind::Let);
+    EXPECT_EQ(statements[1].kind, Node::StmtKind::Scope);
+    EXPECT_EQ(statements[2].kind, Node::StmtKind::Assign);
+
+    // Parentheses leave no node: (a + 2) * 3 is a multiply of an add
+    const auto& multiply = tree.exprs[tree.lets[statements[0].index].letExpr];
+    EXPECT_EQ(multiply.kind, Node::ExprKind::Multiply);
+    EXPECT_EQ(tree.exprs[multiply.lhs].kind, Node::ExprKind::Add);
+    EXPECT_EQ(tree.exprs[multiply.rhs].kind, Node::ExprKind::IntLiteral);
+    EXPECT_EQ(tree.exprs[multiply.rhs].intValue(), 3);
+    // 1, a, 2, 3, b, 1 and a, plus the two binary operators
+    EXPECT_EQ(tree.exprs.size(), 10);
+}
+
+TEST(ParserTests, TestWhileParsesItsConditionAndScope)
+{
+    const std::string source = "let i = 3;\nwhile (i > 0) {\n    i = i - 1;\n}\nreturn i;\n";
+
+    ParsedSource parsed(source);
+    const auto& program = parsed.program;
+    const auto& tree = parsed.parser.tree();
+
+    EXPECT_FALSE(parsed.handler.hasErrored());
+    ASSERT_EQ(program.statements.count, 3);
+    const auto statement = tree.list(program.statements)[1];
+    ASSERT_EQ(statement.kind, Node::StmtKind::While);
+    const auto& loop = tree.whiles[statement.index];
+    EXPECT_EQ(tree.exprs[loop.expr].kind, Node::ExprKind::GreaterThan);
+    ASSERT_NE(loop.scope, Node::None);
+    const auto body = tree.list(tree.scopes[loop.scope].statements);
+    ASSERT_EQ(body.size(), 1);
+    EXPECT_EQ(body[0].kind, Node::StmtKind::Assign);
+    EXPECT_NE(generate(source).find("end while"), std::string::npos);
+}
+
+TEST(ParserTests, TestTreeIsAllocatedFromTheArena)
+{
+    ParsedSource parsed("let a = 1;\n{\n    let b = a + 2;\n}\nreturn a;\n");
+    const std::pmr::memory_resource* arena = &parsed.parser.arena();
+    const auto& tree = parsed.parser.tree();
+    EXPECT_EQ(tree.exprs.get_allocator().resource(), arena);
+    EXPECT_EQ(tree.statements.get_allocator().resource(), arena);
+    EXPECT_EQ(tree.scopes.get_allocator().resource(), arena);
+    EXPECT_GE(parsed.parser.arena().bytesUsed(), tree.bytesReserved());
+}
+
+TEST(ParserTests, TestRewindingBetweenStatementsReleasesTheArena)
+{
+    std::string source;
+    for (int i = 0; i < 200; ++i)
+    {
+        source += "let a" + std::to_string(i) + " = (1 + 2) * 3;\n";
+    }
+    ErrorHandler handler;
+    Parser parser(Tokeniser(source, "test.emd", handler).tokenise(), handler);
+    size_t statements = 0;
+    while (true)
+    {
+        const auto checkpoint = parser.checkpoint();
+        if (!parser.parseNext().has_value())
+        {
+            break;
+        }
+        ++statements;
+        EXPECT_GT(parser.arena().bytesUsed(), 0);
+        parser.rewind(checkpoint);
+        EXPECT_EQ(parser.arena().bytesUsed(), 0);
+        EXPECT_EQ(parser.tree().nodeCount(), 0);
+    }
+    EXPECT_EQ(statements, 200);
+    EXPECT_EQ(parser.arena().chunkCount(), 1);
+}
@@ -0,0 +1,104 @@
+#include "ParsedSource.hpp"
+
+#include <PassManager.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    struct Compiled
+    {
+        Ir::Function function;
+        std::vector<PassManager::Timing> timings;
+    };
+
+    Compiled compile(const std::string& source, PassManager passes)
+    {
+        ParsedSource parsed(source);
+        auto function = passes.run(parsed.tree(), parsed.program.statements, parsed.handler);
+        EXPECT_FALSE(parsed.handler.hasErrored());
+        EXPECT_EQ(Ir::verify(function), std::vector<std::string>{});
+        return { std::move(function), passes.timings() };
+    }
+
+    size_t liveBlocks(const Ir::Function& function)
+    {
+        return std::count_if(function.blocks.begin(), function.blocks.end(), [](const Ir::Block& block) { return !block.removed; });
+    }
+
+    const std::string Branchy = "let a = 1;\n{\n    let b = 2;\n}\nif (a) {\n    a = 2;\n} else if (a == 3) {\n    return 3;\n} else {\n    a = 4;\n}\nwhile (a < 5) {\n    a = a + 1;\n}\nreturn a;\nreturn 9;\n";
+}
+
+TEST(PassManagerTests, TestPipelinesNamePassesInOrder)
+{
+    std::string error;
+    EXPECT_TRUE(PassManager::parse("simplify-cfg,verify", error).has_value());
+    EXPECT_TRUE(PassManager::parse("", error).has_value());
+    EXPECT_FALSE(PassManager::parse("simplify-cfg,unroll-everything", error).has_value());
+    EXPECT_EQ(error, "unroll-everything");
+    // AST passes run before lowering, so they can't follow an IR pass
+    EXPECT_TRUE(PassManager::parse("fold-ast,simplify-cfg", error).has_value());
+    EXPECT_FALSE(PassManager::parse("simplify-cfg,fold-ast", error).has_value());
+    EXPECT_EQ(error, "fold-ast");
+    EXPECT_TRUE(PassManager::forLevel(0).empty());
+    EXPECT_FALSE(PassManager::forLevel(1).empty());
+    for (const auto& pass : PassManager::passes())
+    {
+        EXPECT_EQ(PassManager::find(pass.name), &pass);
+        EXPECT_TRUE((pass.runAst == nullptr) != (pass.runIr == nullptr));
+    }
+}
+
+TEST(PassManagerTests, TestLevelsAreZeroToTwo)
+{
+    EXPECT_EQ(PassManager::parseLevel("0"), 0);
+    EXPECT_EQ(PassManager::parseLevel("2"), 2);
+    for (const auto level : { "", "foo", "7", "-1", "1x", " 1" })
+    {
+        EXPECT_FALSE(PassManager::parseLevel(level).has_value()) << level;
+    }
+}
+
+TEST(PassManagerTests, TestSimplifyCfgKeepsWhatTheProgramDoes)
+{
+    std::string error;
+    const auto lowered = compile(Branchy, PassManager::parse("", error).value());
+    const auto simplified = compile(Branchy, PassManager::parse("simplify-cfg", error).value());
+    EXPECT_EQ(Ir::run(lowered.function, 10000), 5);
+    EXPECT_EQ(Ir::run(simplified.function, 10000), 5);
+    EXPECT_LT(liveBlocks(simplified.function), liveBlocks(lowered.function));
+    // The return after the return is gone
+    EXPECT_EQ(Ir::toString(simplified.function).find("const 9"), std::string::npos);
+}
+
+TEST(PassManagerTests, TestEachPassIsTimed)
+{
+    std::string error;
+    const auto compiled = compile(Branchy, PassManager::parse("simplify-cfg,verify,simplify-cfg", error).value());
+    ASSERT_EQ(compiled.timings.size(), 3);
+    EXPECT_EQ(compiled.timings[0].name, "lower");
+    EXPECT_EQ(compiled.timings[1].name, "simplify-cfg");
+    EXPECT_EQ(compiled.timings[1].runs, 2);
+    // Nothing is left for the second run to do
+    EXPECT_EQ(compiled.timings[1].changes, 1);
+    EXPECT_EQ(compiled.timings[2].name, "verify");
+    EXPECT_EQ(compiled.timings[2].changes, 0);
+}
+
+TEST(PassManagerTests, TestAnalysesAreKeptUntilInvalidated)
+{
+    std::string error;
+    const auto compiled = compile(Branchy, PassManager::parse("", error).value());
+    AnalysisCache analyses(compiled.function);
+    const auto* dominators = &analyses.dominators();
+    EXPECT_EQ(&analyses.dominators(), dominators);
+    analyses.invalidate(AnalysisCache::None);
+    analyses.dominators();
+    EXPECT_EQ(analyses.computeCount(), 1);
+    analyses.invalidate(AnalysisCache::Dominators);
+    analyses.dominators();
+    EXPECT_EQ(analyses.computeCount(), 2);
+}
@@ -0,0 +1,280 @@
+#include "ParsedSource.hpp"
+
+#include <PassManager.hpp>
+#include <IrGenerator.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    struct Optimised
+    {
+        Ir::Function function;
+        std::vector<std::string> errors;
+        std::vector<Message> messages;
+    };
+
+    Optimised optimise(const std::string& source, std::string_view passes)
+    {
+        ParsedSource parsed(source);
+        std::string unknown;
+        auto manager = PassManager::parse(passes, unknown);
+        EXPECT_TRUE(manager.has_value()) << unknown;
+        auto function = manager->run(parsed.tree(), parsed.program.statements, parsed.handler);
+        EXPECT_EQ(Ir::verify(function), std::vector<std::string>{});
+        std::vector<std::string> errors;
+        for (const auto& message : parsed.handler)
+        {
+            errors.push_back(message.Description);
+        }
+        return { std::move(function), errors, { parsed.handler.begin(), parsed.handler.end() } };
+    }
+
+    size_t count(const Ir::Function& function, Ir::Op op)
+    {
+        size_t found = 0;
+        for (const auto& block : function.blocks)
+        {
+            found += std::count_if(block.instructions.begin(), block.instructions.end(), [&](Ir::Value value) {
+                return function.instructions[value].op == op;
+            });
+        }
+        return found;
+    }
+
+    // The block an instruction with op is in, where there's just the one
+    Ir::BlockId blockOf(const Ir::Function& function, Ir::Op op)
+    {
+        for (Ir::BlockId block = 0; block < function.blocks.size(); ++block)
+        {
+            for (const auto value : function.blocks[block].instructions)
+            {
+                if (function.instructions[value].op == op)
+                {
+                    return block;
+                }
+            }
+        }
+        return Ir::None;
+    }
+
+    bool loopsBack(const Ir::Function& function, Ir::BlockId block)
+    {
+        const auto successors = function.successors(block);
+        return std::find(successors.begin(), successors.end(), block) != successors.end();
+    }
+}
+
+TEST(PassesTests, TestFoldEvaluatesConstantExpressions)
+{
+    const auto folded = optimise("let x = (10 - 2 * 3) / 2;\nreturn x * 3 - 6 + 9223372036854775807 + x;\n", "fold");
+    EXPECT_EQ(folded.errors, std::vector<std::string>{});
+    EXPECT_EQ(Ir::run(folded.function, 1000), INT64_MIN + 1);
+    EXPECT_EQ(count(folded.function, Ir::Op::Mul), 0);
+    EXPECT_EQ(count(folded.function, Ir::Op::Div), 0);
+    EXPECT_EQ(count(folded.function, Ir::Op::Sub), 0);
+    // Division rounds towards zero, as idiv does
+    EXPECT_EQ(Ir::run(optimise("return (0 - 7) / 2 + 10;\n", "fold").function, 1000), 7);
+}
+
+TEST(PassesTests, TestFoldSimplifiesIdentities)
+{
+    // a isn't known after the loop
+    const auto folded = optimise("let a = 6;\nwhile (a < 6) {\n}\nlet b = a * 1 + 0;\nlet c = b - b;\nlet d = b * 0;\nreturn b / 1 + c + d + (a == a) + (a < a);\n", "fold");
+    EXPECT_EQ(Ir::run(folded.function, 1000), 7);
+    // Down to b + 1, and the loop's test
+    EXPECT_EQ(count(folded.function, Ir::Op::Add), 1);
+    EXPECT_EQ(count(folded.function, Ir::Op::Lt), 1);
+    for (const auto op : { Ir::Op::Sub, Ir::Op::Mul, Ir::Op::Div, Ir::Op::Eq })
+    {
+        EXPECT_EQ(count(folded.function, op), 0) << Ir::name(op);
+    }
+}
+
+TEST(PassesTests, TestFoldLeavesDivisionsThatTrap)
+{
+    // Left to trap when run, as at -O0. DivisionCheck reports them before anything is lowered.
+    const auto constant = optimise("let a = 3;\nreturn 1 / (2 - 2);\n", "fold");
+    EXPECT_EQ(constant.errors, std::vector<std::string>{});
+    EXPECT_EQ(count(constant.function, Ir::Op::Div), 1);
+    EXPECT_EQ(count(constant.function, Ir::Op::Sub), 0);
+
+    const auto overflow = optimise("return (0 - 9223372036854775807 - 1) / (0 - 1);\n", "fold");
+    EXPECT_EQ(overflow.errors, std::vector<std::string>{});
+    EXPECT_EQ(count(overflow.function, Ir::Op::Div), 1);
+    EXPECT_EQ(optimise("let a = 0;\nreturn 1 / a;\n", "fold").errors, std::vector<std::string>{});
+}
+
+TEST(PassesTests, TestFoldAstFoldsLiteralsBeforeLowering)
+{
+    const auto folded = optimise("let x = (10 - 2 * 3) / 2;\nreturn x * 3 - (7 < 8);\n", "fold-ast");
+    EXPECT_EQ(Ir::run(folded.function, 1000), 5);
+    EXPECT_EQ(count(folded.function, Ir::Op::Div), 0);
+    EXPECT_EQ(count(folded.function, Ir::Op::Lt), 0);
+    // x isn't a literal
+    EXPECT_EQ(count(folded.function, Ir::Op::Mul), 1);
+    EXPECT_EQ(count(folded.function, Ir::Op::Sub), 1);
+
+    // Left to trap when run
+    const auto trapping = optimise("return 1 / (2 - 2);\n", "fold-ast");
+    EXPECT_EQ(trapping.errors, std::vector<std::string>{});
+    EXPECT_EQ(count(trapping.function, Ir::Op::Div), 1);
+    EXPECT_EQ(count(trapping.function, Ir::Op::Sub), 0);
+}
+
+TEST(PassesTests, TestSccpPrunesBranchesOnConstantFlags)
+{
+    const std::string flags = "let x = 2;\nlet on = 0;\nlet other = 1;\nif (on) {\n    x = 41;\n} else if (other) {\n    x = 42;\n} else {\n    x = 43;\n}\nwhile (on) {\n    on = on + 1;\n}\nreturn x + 5;\n";
+    const auto propagated = optimise(flags, "sccp,simplify-cfg");
+    EXPECT_EQ(Ir::run(propagated.function, 1000), 47);
+    // Straight-line code, exiting with a constant
+    const auto live = std::count_if(propagated.function.blocks.begin(), propagated.function.blocks.end(), [](const Ir::Block& block) { return !block.removed; });
+    EXPECT_EQ(live, 1);
+    EXPECT_EQ(count(propagated.function, Ir::Op::Branch), 0);
+    EXPECT_EQ(count(propagated.function, Ir::Op::Load), 0);
+}
+
+TEST(PassesTests, TestSccpLeavesVaryingVariablesAlone)
+{
+    // i changes around the loop, but k is the same on every path into its use
+    const std::string loop = "let i = 0;\nlet k = 3;\nwhile (i < 10) {\n    if (i == 4) {\n        k = 3;\n    }\n    i = i + 1;\n}\nreturn i * k;\n";
+    const auto propagated = optimise(loop, "sccp");
+    EXPECT_EQ(Ir::run(propagated.function, 10000), 30);
+    EXPECT_EQ(count(propagated.function, Ir::Op::Branch), 2);
+    EXPECT_EQ(count(propagated.function, Ir::Op::Load), 4);
+}
+
+TEST(PassesTests, TestDceRemovesDeadStoresAndUnusedVariables)
+{
+    // unused is never read, x's first value is overwritten unread, and nothing runs after the return
+    const std::string source = "let a = 0;\nwhile (a < 3) {\n    a = a + 1;\n}\nlet unused = a * 7;\nlet x = a;\nx = a + 1;\nreturn x;\nx = 9;\nreturn x;\n";
+    const auto eliminated = optimise(source, "dce");
+    EXPECT_EQ(Ir::run(eliminated.function, 1000), 4);
+    EXPECT_EQ(count(eliminated.function, Ir::Op::Mul), 0);
+    EXPECT_EQ(count(eliminated.function, Ir::Op::Return), 1);
+    // The stores to a, which the loop reads, and the one to x that return reads
+    EXPECT_EQ(count(eliminated.function, Ir::Op::Store), 3);
+}
+
+TEST(PassesTests, TestDceKeepsDivisionsThatMightTrap)
+{
+    const auto eliminated = optimise("let a = 0;\nwhile (a) {\n}\nlet unused = 1 / a;\nreturn 2;\n", "dce");
+    EXPECT_EQ(count(eliminated.function, Ir::Op::Div), 1);
+    EXPECT_FALSE(Ir::run(eliminated.function, 1000).has_value());
+}
+
+TEST(PassesTests, TestGvnReusesRepeatedExpressions)
+{
+    // a and b aren't known after the loop
+    const std::string unknowns = "let a = 3;\nlet b = 4;\nwhile (a > 5) {\n    a = b;\n    b = 3;\n}\n";
+    const auto repeated = optimise(unknowns + "return (a * b) + (b * a);\n", "gvn");
+    EXPECT_EQ(Ir::run(repeated.function, 1000), 24);
+    EXPECT_EQ(count(repeated.function, Ir::Op::Mul), 1);
+
+    // Available in the block the if dominates, and compared either way round
+    const auto acrossBlocks = optimise(unknowns + "let c = a + b;\nif (a < b) {\n    c = (b + a) * (b > a);\n}\nreturn c;\n", "gvn");
+    EXPECT_EQ(Ir::run(acrossBlocks.function, 1000), 7);
+    EXPECT_EQ(count(acrossBlocks.function, Ir::Op::Add), 1);
+    // Only the loop's tests, before it and at the bottom, are left
+    EXPECT_EQ(count(acrossBlocks.function, Ir::Op::Gt), 2);
+}
+
+TEST(PassesTests, TestGvnForgetsVariablesOnAssignment)
+{
+    const std::string unknowns = "let a = 3;\nlet b = 4;\nwhile (a > 5) {\n    a = b;\n    b = 3;\n}\n";
+    const auto assigned = optimise(unknowns + "let c = a * b;\na = a + 1;\nreturn c + a * b;\n", "gvn");
+    EXPECT_EQ(Ir::run(assigned.function, 1000), 28);
+    EXPECT_EQ(count(assigned.function, Ir::Op::Mul), 2);
+
+    // Assigned on one path into the join, or around the loop, so loaded again
+    const auto joined = optimise(unknowns + "let c = a * b;\nif (b) {\n    a = 1;\n}\nreturn c + a * b;\n", "gvn");
+    EXPECT_EQ(Ir::run(joined.function, 1000), 16);
+    EXPECT_EQ(count(joined.function, Ir::Op::Mul), 2);
+    const auto looped = optimise(unknowns + "let i = 0;\nwhile (i < 3) {\n    a = a * b;\n    i = i + 1;\n}\nreturn a;\n", "gvn");
+    EXPECT_EQ(Ir::run(looped.function, 1000), 192);
+}
+
+TEST(PassesTests, TestLicmHoistsInvariantsIntoThePreheader)
+{
+    const std::string source = "let a = 3;\nlet b = 4;\nlet s = 0;\nlet i = 0;\nwhile (i < 5) {\n    s = s + a * b;\n    i = i + 1;\n}\nreturn s;\n";
+    for (const auto passes : { "licm", "mem2reg,licm" })
+    {
+        const auto hoisted = optimise(source, passes);
+        EXPECT_EQ(Ir::run(hoisted.function, 1000), 60) << passes;
+        const auto block = blockOf(hoisted.function, Ir::Op::Mul);
+        ASSERT_NE(block, Ir::None) << passes;
+        EXPECT_FALSE(loopsBack(hoisted.function, block)) << passes;
+        // The add to s still changes each time round
+        EXPECT_TRUE(loopsBack(hoisted.function, blockOf(hoisted.function, Ir::Op::Add))) << passes;
+    }
+}
+
+TEST(PassesTests, TestLicmLeavesDivisionsThatMightTrap)
+{
+    // Hoisted out of the if, 10 / b would divide by zero before the loop
+    const std::string source = "let b = 0;\nlet s = 0;\nlet i = 0;\nwhile (i < 3) {\n    if (b != 0) {\n        s = s + 10 / b;\n    }\n    i = i + 1;\n}\nreturn s;\n";
+    const auto guarded = optimise(source, "licm");
+    EXPECT_EQ(Ir::run(guarded.function, 1000), 0);
+    EXPECT_EQ(count(guarded.function, Ir::Op::Div), 1);
+    // The != is hoisted, but the division stays behind the test
+    EXPECT_NE(blockOf(guarded.function, Ir::Op::Div), blockOf(guarded.function, Ir::Op::Ne));
+}
+
+TEST(PassesTests, TestMem2RegTurnsVariablesIntoRegisters)
+{
+    // b and c are copies of a. The loop merges two values of s and of i, and after it s is either
+    // its first value or its last.
+    const std::string source = "let a = 3;\nlet b = a;\nlet c = b;\nlet s = 0;\nlet i = 0;\nwhile (i < c) {\n    s = s + a;\n    i = i + 1;\n}\nreturn s;\n";
+    const auto promoted = optimise(source, "mem2reg");
+    EXPECT_EQ(Ir::run(promoted.function, 1000), 9);
+    EXPECT_EQ(count(promoted.function, Ir::Op::Load), 0);
+    EXPECT_EQ(count(promoted.function, Ir::Op::Store), 0);
+    EXPECT_EQ(count(promoted.function, Ir::Op::Phi), 3);
+
+    // Only values that spill touch the stack
+    IrGenerator generator(promoted.function);
+    const auto program = generator.generateProgram();
+    EXPECT_EQ(program.find("[rbp"), std::string::npos);
+    // The copies into the loop's phis come before its test at the bottom, leaving one branch
+    // each time round
+    const auto body = program.substr(program.find("bb2:"), program.find("bb3:") - program.find("bb2:"));
+    size_t branches = 0;
+    for (auto jump = body.find("\tj"); jump != std::string::npos; jump = body.find("\tj", jump + 1))
+    {
+        ++branches;
+    }
+    EXPECT_EQ(branches, 1);
+    EXPECT_NE(body.find("jne bb2"), std::string::npos);
+}
+
+TEST(PassesTests, TestPhiCopiesSwapThroughRegisters)
+{
+    // a and b swap every time round, so the copies into their phis form a cycle
+    const std::string source = "let a = 1;\nlet b = 2;\nlet i = 0;\nwhile (i < 5) {\n    let t = a;\n    a = b;\n    b = t;\n    i = i + 1;\n}\nreturn a * 10 + b;\n";
+    const auto promoted = optimise(source, "mem2reg");
+    EXPECT_EQ(Ir::run(promoted.function, 1000), 21);
+
+    IrGenerator generator(promoted.function);
+    const auto program = generator.generateProgram();
+    EXPECT_EQ(program.find("[rbp"), std::string::npos);
+    EXPECT_EQ(program.find("push"), std::string::npos);
+    EXPECT_EQ(program.find("pop"), std::string::npos);
+}
+
+TEST(PassesTests, TestRegistersSpillWhenTooManyAreLive)
+{
+    std::string source;
+    std::string sum = "0";
+    for (int i = 0; i < 20; ++i)
+    {
+        source += "let a" + std::to_string(i) + " = " + std::to_string(i) + ";\nwhile (a" + std::to_string(i) + " > 100) {\n    a" + std::to_string(i) + " = 0;\n}\n";
+        sum += " + a" + std::to_string(i);
+    }
+    const auto promoted = optimise(source + "return " + sum + ";\n", "mem2reg");
+    EXPECT_EQ(Ir::run(promoted.function, 10000), 190);
+    IrGenerator generator(promoted.function);
+    EXPECT_NE(generator.generateProgram().find("[rbp"), std::string::npos);
+}
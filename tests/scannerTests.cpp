@@ -0,0 +1,88 @@
+#include <Scanner.hpp>
+#include <Keywords.hpp>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+namespace
+{
+    // Builds a buffer biased towards the characters the scanners care about so runs of every
+    // length, including ones that straddle vector boundaries, are exercised
+    std::string randomSource(std::mt19937& rng, size_t length)
+    {
+        static const std::string alphabet = "  \t\n\r\vabcXYZ09_*#;(+\x80\xff";
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        std::uniform_int_distribution<size_t> runLength(0, 70);
+        std::string source;
+        while (source.size() < length)
+        {
+            source.append(runLength(rng), alphabet[pick(rng)]);
+        }
+        source.resize(length);
+        return source;
+    }
+
+    template<typename Vector, typename Scalar>
+    void expectSameAtEveryOffset(const std::string& source, Vector vector, Scalar scalar)
+    {
+        const char* end = source.data() + source.size();
+        for (size_t offset = 0; offset <= source.size(); ++offset)
+        {
+            const char* begin = source.data() + offset;
+            ASSERT_EQ(vector(begin, end), scalar(begin, end)) << "offset " << offset;
+        }
+    }
+}
+
+TEST(ScannerTests, TestVectorScannersMatchScalarOnRandomInput)
+{
+    std::mt19937 rng(1234);
+    for (size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 64, 200, 1000})
+    {
+        const auto source = randomSource(rng, length);
+        expectSameAtEveryOffset(source, Scanner::skipWhitespace, Scanner::Scalar::skipWhitespace);
+        expectSameAtEveryOffset(source, Scanner::skipAlnum, Scanner::Scalar::skipAlnum);
+        expectSameAtEveryOffset(source, Scanner::skipDigits, Scanner::Scalar::skipDigits);
+        expectSameAtEveryOffset(source, Scanner::findNewline, Scanner::Scalar::findNewline);
+        expectSameAtEveryOffset(source, Scanner::findCommentEnd, Scanner::Scalar::findCommentEnd);
+    }
+}
+
+TEST(ScannerTests, TestLongRunsAreSkipped)
+{
+    const std::string source = std::string(100, ' ') + std::string(100, 'a') + std::string(100, '7') + "*#";
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+
+    EXPECT_EQ(Scanner::skipWhitespace(begin, end), begin + 100);
+    EXPECT_EQ(Scanner::skipAlnum(begin + 100, end), begin + 300);
+    EXPECT_EQ(Scanner::skipDigits(begin + 200, end), begin + 300);
+    EXPECT_EQ(Scanner::findNewline(begin, end), end);
+    EXPECT_EQ(Scanner::findCommentEnd(begin, end), begin + 300);
+}
+
+TEST(ScannerTests, TestCommentEndSplitAcrossVectorBoundary)
+{
+    for (size_t position = 0; position < 70; ++position)
+    {
+        std::string source(72, 'x');
+        source[position] = '*';
+        source[position + 1] = '#';
+        EXPECT_EQ(Scanner::findCommentEnd(source.data(), source.data() + source.size()), source.data() + position);
+    }
+}
+
+TEST(ScannerTests, TestKeywordLookup)
+{
+    for (const auto& entry : Keywords::List)
+    {
+        EXPECT_EQ(Keywords::lookup(entry.text), entry.kind);
+    }
+    EXPECT_FALSE(Keywords::lookup("lettuce").has_value());
+    EXPECT_FALSE(Keywords::lookup("iff").has_value());
+    EXPECT_FALSE(Keywords::lookup("x").has_value());
+    EXPECT_FALSE(Keywords::lookup("retur").has_value());
+    EXPECT_FALSE(Keywords::lookup("whilst").has_value());
+}
@@ -0,0 +1,57 @@
+#include <SourceFile.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    std::filesystem::path writeTempFile(const std::string& name, const std::string& contents)
+    {
+        const auto path = std::filesystem::temp_directory_path() / name;
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        file << contents;
+        return path;
+    }
+}
+
+TEST(SourceFileTests, TestSmallFileIsBuffered)
+{
+    const std::string contents = "let x = 1;\nreturn x;";
+    const auto path = writeTempFile("emerald_small.emd", contents);
+
+    const auto file = SourceFile::open(path.string());
+    ASSERT_TRUE(file.has_value());
+    EXPECT_FALSE(file->isMapped());
+    EXPECT_EQ(file->contents(), contents);
+    std::filesystem::remove(path);
+}
+
+TEST(SourceFileTests, TestLargeFileIsMapped)
+{
+    std::string contents;
+    while (contents.size() < SourceFile::MapThreshold)
+    {
+        contents += "let x = 1; # padding\n";
+    }
+    const auto path = writeTempFile("emerald_large.emd", contents);
+
+    auto file = SourceFile::open(path.string());
+    ASSERT_TRUE(file.has_value());
+#if !defined(_WIN32)
+    EXPECT_TRUE(file->isMapped());
+#endif
+    EXPECT_EQ(file->contents(), contents);
+
+    // Moving keeps the mapping alive in the new owner
+    const SourceFile moved = std::move(file.value());
+    EXPECT_EQ(moved.contents(), contents);
+    std::filesystem::remove(path);
+}
+
+TEST(SourceFileTests, TestMissingFile)
+{
+    EXPECT_FALSE(SourceFile::open("/this/file/does/not/exist.emd").has_value());
+}
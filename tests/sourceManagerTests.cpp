@@ -0,0 +1,60 @@
+#include <SourceManager.hpp>
+
+#include <gtest/gtest.h>
+
+TEST(SourceManagerTests, TestResolveOffsetsToLinesAndColumns)
+{
+    SourceManager sources;
+    const std::string content = "let x = 1;\n\nreturn x;";
+    const auto fileId = sources.addFile("test.emd", content);
+
+    const auto first = sources.resolve({ .FileId = fileId, .Offset = 0 });
+    EXPECT_EQ(first.File, "test.emd");
+    EXPECT_EQ(first.Line, 1);
+    EXPECT_EQ(first.Pos, 1);
+
+    const auto semiColon = sources.resolve({ .FileId = fileId, .Offset = 9 });
+    EXPECT_EQ(semiColon.Line, 1);
+    EXPECT_EQ(semiColon.Pos, 10);
+
+    const auto returnKeyword = sources.resolve({ .FileId = fileId, .Offset = 12 });
+    EXPECT_EQ(returnKeyword.Line, 3);
+    EXPECT_EQ(returnKeyword.Pos, 1);
+}
+
+TEST(SourceManagerTests, TestResolveMultipleFiles)
+{
+    SourceManager sources;
+    const std::string first = "return 1;";
+    const std::string second = "\n\n  return 2;";
+    const auto firstId = sources.addFile("first.emd", first);
+    const auto secondId = sources.addFile("second.emd", second);
+
+    const auto location = sources.resolve({ .FileId = secondId, .Offset = 4 });
+    EXPECT_EQ(location.File, "second.emd");
+    EXPECT_EQ(location.Line, 3);
+    EXPECT_EQ(location.Pos, 3);
+    EXPECT_EQ(sources.resolve({ .FileId = firstId, .Offset = 7 }).Pos, 8);
+}
+
+TEST(SourceManagerTests, TestResolvedFileOutlivesLaterFiles)
+{
+    SourceManager sources;
+    const std::string content = "return 1;";
+    const auto location = sources.resolve({ .FileId = sources.addFile("a.emd", content), .Offset = 0 });
+    const auto name = sources.filename(0);
+    for (int i = 0; i < 100; ++i)
+    {
+        sources.addFile("file" + std::to_string(i) + ".emd", content);
+    }
+    EXPECT_EQ(location.File, "a.emd");
+    EXPECT_EQ(name, "a.emd");
+}
+
+TEST(SourceManagerTests, TestResolveWithoutFile)
+{
+    SourceManager sources;
+    const auto location = sources.resolve({});
+    EXPECT_TRUE(location.File.empty());
+    EXPECT_EQ(location.Line, 0);
+}
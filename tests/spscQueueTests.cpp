@@ -0,0 +1,58 @@
+#include <SpscQueue.hpp>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+TEST(SpscQueueTests, TestPopAfterCloseDrainsThenEnds)
+{
+    SpscQueue<int> queue(4);
+    queue.push(1);
+    queue.push(2);
+    queue.close();
+
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_FALSE(queue.pop().has_value());
+}
+
+TEST(SpscQueueTests, TestValuesArriveInOrderAcrossThreads)
+{
+    constexpr int count = 100'000;
+    // A tiny ring so both sides block on each other many times
+    SpscQueue<int> queue(3);
+    std::jthread producer([&] {
+        for (int i = 0; i < count; ++i)
+        {
+            queue.push(i);
+        }
+        queue.close();
+    });
+
+    int expected = 0;
+    while (auto value = queue.pop())
+    {
+        ASSERT_EQ(value.value(), expected);
+        ++expected;
+    }
+    EXPECT_EQ(expected, count);
+}
+
+TEST(SpscQueueTests, TestCancelReleasesABlockedProducer)
+{
+    SpscQueue<int> queue(2);
+    int pushed = 0;
+    {
+        std::jthread producer([&] {
+            // Fills the ring, then blocks until the consumer cancels
+            while (queue.push(pushed))
+            {
+                ++pushed;
+            }
+        });
+        EXPECT_EQ(queue.pop(), 0);
+        queue.cancel();
+    }
+    EXPECT_GE(pushed, 1);
+    EXPECT_FALSE(queue.push(-1));
+}
@@ -0,0 +1,51 @@
+#include <StringInterner.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+TEST(StringInternerTests, TestSameTextGivesSameSymbol)
+{
+    StringInterner interner;
+    const auto a = interner.intern("alpha");
+    const auto b = interner.intern("beta");
+    EXPECT_EQ(a, 0);
+    EXPECT_EQ(b, 1);
+    EXPECT_EQ(interner.intern(std::string("alpha")), a);
+    EXPECT_EQ(interner.name(b), "beta");
+    EXPECT_EQ(interner.size(), 2);
+}
+
+TEST(StringInternerTests, TestNamesStayValidAsTheTableGrows)
+{
+    StringInterner interner;
+    const auto first = interner.name(interner.intern("v0"));
+    // Enough names to rehash several times and fill more than one storage block
+    for (int i = 1; i < 20'000; ++i)
+    {
+        ASSERT_EQ(interner.intern("v" + std::to_string(i)), static_cast<StringInterner::Symbol>(i));
+    }
+    const std::string longName(100'000, 'x');
+    EXPECT_EQ(interner.name(interner.intern(longName)), longName);
+
+    EXPECT_EQ(first, "v0");
+    EXPECT_EQ(first.data(), interner.name(0).data());
+    EXPECT_EQ(interner.intern("v12345"), 12345);
+    EXPECT_GT(interner.memoryBytes(), longName.size());
+}
+
+TEST(StringInternerTests, TestMergeMapsLocalSymbols)
+{
+    StringInterner global;
+    global.intern("shared");
+
+    StringInterner local;
+    local.intern("fresh");
+    local.intern("shared");
+
+    const auto symbols = global.merge(local);
+    ASSERT_EQ(symbols.size(), 2);
+    EXPECT_EQ(symbols[0], 1);
+    EXPECT_EQ(symbols[1], 0);
+    EXPECT_EQ(global.name(symbols[0]), "fresh");
+}